@@ -0,0 +1,1259 @@
+/**
+* @file benchmark_bvh.cpp
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Benchmark bounding volume hierarchy
+*	Disabled by default, run as "cs350_project.exe --gtest_also_run_disabled_tests --gtest_filter=bvh_benchmark.*"
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <chrono>
+
+namespace {
+	using bench_clock = std::chrono::high_resolution_clock;
+	/**
+	*
+	* @param start
+	* @return miliseconds since start
+	*/
+	double elapsed_ms(bench_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+	}
+	/**
+	*
+	* @brief objects scattered on XZ like Demo::add_random_object, only the aabb is set (no mesh needed)
+	* @param count
+	* @param MIN
+	* @param MAX
+	* @return
+	*/
+	std::vector<Object> make_random_objects(int count, float MIN, float MAX)
+	{
+		std::vector<Object> objects(count);
+		for (int i = 0; i < count; ++i) {
+			vec3 pos = vec3{ glm::linearRand(MIN, MAX), glm::linearRand(-5.f, 5.f), glm::linearRand(MIN, MAX) };
+			vec3 half = vec3{ glm::linearRand(0.5f, 5.f) } * 0.5f;
+			objects[i].set_name("Object_" + std::to_string(i));
+			objects[i].set_pos(pos);
+			objects[i].set_aabb(AABB{ pos - half, pos + half });
+		}
+		return objects;
+	}
+	/**
+	*
+	* @param objects
+	* @return
+	*/
+	std::vector<Object*> make_pointers(std::vector<Object>& objects)
+	{
+		std::vector<Object*> result;
+		result.reserve(objects.size());
+		for (auto& o : objects)
+			result.push_back(&o);
+		return result;
+	}
+	/**
+	*
+	* @param count
+	* @param MIN
+	* @param MAX
+	* @param size
+	* @return
+	*/
+	std::vector<AABB> make_random_queries(int count, float MIN, float MAX, float size)
+	{
+		std::vector<AABB> queries(count);
+		for (auto& q : queries) {
+			vec3 p = vec3{ glm::linearRand(MIN, MAX), 0.f, glm::linearRand(MIN, MAX) };
+			q = AABB{ p - vec3{size}, p + vec3{size} };
+		}
+		return queries;
+	}
+
+	// node layout before the tree was flattened: one allocation per node
+	struct legacy_node {
+		mutable bool draw_bv = true;
+		std::vector <Object*> objects{};
+		AABB bounding_volume{};
+		legacy_node* parent = nullptr;
+		std::array<legacy_node*, 2> children{ nullptr };
+		~legacy_node() {
+			delete children[0];
+			delete children[1];
+		}
+	};
+	/**
+	*
+	* @brief copy same topology into a pointer based tree
+	* @param bvh
+	* @param n
+	* @param parent
+	* @return
+	*/
+	legacy_node* copy_legacy(const BVH& bvh, const BVH::node& n, legacy_node* parent)
+	{
+		legacy_node* l = new legacy_node;
+		l->parent = parent;
+		l->bounding_volume = n.bounding_volume;
+		for (u32 i = 0; i < n.count; ++i)
+			l->objects.push_back(bvh.object(n, i));
+		if (!n.is_leaf()) {
+			auto c = bvh.children(n);
+			l->children[0] = copy_legacy(bvh, *c[0], l);
+			l->children[1] = copy_legacy(bvh, *c[1], l);
+		}
+		return l;
+	}
+
+	/**
+	*
+	* @param filepath
+	* @return objects from a bounding_volume_hierarchy fixture (only aabb)
+	*/
+	std::vector<Object> read_fixture(const std::string& filepath)
+	{
+		std::vector<Object> objects;
+		std::ifstream file(filepath);
+		std::string word;
+		while (file >> word) {
+			if (word != "aabb")
+				continue;
+			AABB ab;
+			file >> ab.min_point.x >> ab.min_point.y >> ab.min_point.z;
+			file >> ab.max_point.x >> ab.max_point.y >> ab.max_point.z;
+			objects.emplace_back();
+			objects.back().set_aabb(ab);
+		}
+		return objects;
+	}
+	/**
+	*
+	* @param bvh
+	* @param queries
+	* @return overlapping leaves found
+	*/
+	u64 run_aabb_queries(const BVH& bvh, const std::vector<AABB>& queries)
+	{
+		u64 hits = 0;
+		std::vector<const BVH::node*> stack;
+		for (const AABB& q : queries) {
+			stack.push_back(bvh.root());
+			while (!stack.empty()) {
+				const BVH::node* n = stack.back();
+				stack.pop_back();
+				if (!intersection_aabb_aabb(n->bounding_volume, q))
+					continue;
+				if (n->count == 1) {
+					hits++;
+					continue;
+				}
+				// bigger leaves test every object
+				if (n->is_leaf()) {
+					for (u32 i = 0; i < n->count; ++i)
+						hits += intersection_aabb_aabb(bvh.object_aabb(*n, i), q);
+					continue;
+				}
+				auto c = bvh.children(*n);
+				stack.push_back(c[1]);
+				stack.push_back(c[0]);
+			}
+		}
+		return hits;
+	}
+	/**
+	*
+	* @param count
+	* @param MIN
+	* @param MAX
+	* @return rays starting in the scene with random directions
+	*/
+	std::vector<Ray> make_random_rays(int count, float MIN, float MAX)
+	{
+		std::vector<Ray> rays;
+		rays.reserve(count);
+		for (int i = 0; i < count; ++i)
+			rays.emplace_back(vec3{ glm::linearRand(MIN, MAX), glm::linearRand(-5.f, 5.f), glm::linearRand(MIN, MAX) }, glm::sphericalRand(1.f));
+		return rays;
+	}
+	/**
+	*
+	* @param count
+	* @param MIN
+	* @param MAX
+	* @param size	half extent of the boxes
+	* @return oriented boxes given as six inward planes
+	*/
+	std::vector<Frustum> make_random_frustums(int count, float MIN, float MAX, float size)
+	{
+		std::vector<Frustum> frustums;
+		frustums.reserve(count);
+		for (int i = 0; i < count; ++i) {
+			vec3 c = vec3{ glm::linearRand(MIN, MAX), 0.f, glm::linearRand(MIN, MAX) };
+			mat3 r = glm::mat3_cast(glm::angleAxis(glm::linearRand(0.f, glm::two_pi<float>()), glm::sphericalRand(1.f)));
+			std::array<Plane, 6> planes;
+			for (int j = 0; j < 3; ++j) {
+				planes[2 * j] = Plane(r[j], c - r[j] * size);
+				planes[2 * j + 1] = Plane(-r[j], c + r[j] * size);
+			}
+			frustums.emplace_back(planes);
+		}
+		return frustums;
+	}
+	/**
+	*
+	* @brief closest hit front to back
+	* @param bvh
+	* @param rays
+	* @return rays that hit something
+	*/
+	u64 run_ray_queries(const BVH& bvh, const std::vector<Ray>& rays)
+	{
+		u64 hits = 0;
+		std::vector<std::pair<const BVH::node*, float>> stack;
+		for (const Ray& r : rays) {
+			float closest = FLT_MAX;
+			stack.push_back({ bvh.root(), 0.f });
+			while (!stack.empty()) {
+				auto [n, t] = stack.back();
+				stack.pop_back();
+				if (t > closest)
+					continue;
+				if (n->is_leaf()) {
+					for (u32 i = 0; i < n->count; ++i) {
+						float hit = intersection_ray_aabb(r, bvh.object_aabb(*n, i));
+						if (hit >= 0.f)
+							closest = glm::min(closest, hit);
+					}
+					continue;
+				}
+				auto c = bvh.children(*n);
+				float t0 = intersection_ray_aabb(r, c[0]->bounding_volume);
+				float t1 = intersection_ray_aabb(r, c[1]->bounding_volume);
+				// nearest on top
+				if (t0 > t1) {
+					std::swap(c[0], c[1]);
+					std::swap(t0, t1);
+				}
+				if (t1 >= 0.f)
+					stack.push_back({ c[1], t1 });
+				if (t0 >= 0.f)
+					stack.push_back({ c[0], t0 });
+			}
+			hits += closest != FLT_MAX;
+		}
+		return hits;
+	}
+	/**
+	*
+	* @param bvh
+	* @param frustums
+	* @return objects not outside
+	*/
+	u64 run_frustum_queries(const BVH& bvh, const std::vector<Frustum>& frustums)
+	{
+		u64 hits = 0;
+		std::vector<const BVH::node*> stack;
+		for (const Frustum& f : frustums) {
+			stack.push_back(bvh.root());
+			while (!stack.empty()) {
+				const BVH::node* n = stack.back();
+				stack.pop_back();
+				if (intersection_frustum_aabb(f, n->bounding_volume) == OUTSIDE)
+					continue;
+				if (n->is_leaf()) {
+					for (u32 i = 0; i < n->count; ++i)
+						hits += intersection_frustum_aabb(f, bvh.object_aabb(*n, i)) != OUTSIDE;
+					continue;
+				}
+				auto c = bvh.children(*n);
+				stack.push_back(c[1]);
+				stack.push_back(c[0]);
+			}
+		}
+		return hits;
+	}
+	/**
+	*
+	* @param name
+	* @param objects
+	* @param queries
+	*/
+	void compare_splits(const std::string& name, std::vector<Object>& objects, const std::vector<AABB>& queries)
+	{
+		auto pointers = make_pointers(objects);
+		for (int split = 0; split < bvh_split_count; ++split) {
+			BVH bvh;
+			bvh.build_config().split = (BVHSplit)split;
+			auto start = bench_clock::now();
+			bvh.build_top_down(pointers);
+			double build_time = elapsed_ms(start);
+			start = bench_clock::now();
+			u64 hits = run_aabb_queries(bvh, queries);
+			double query_time = elapsed_ms(start);
+			std::cout << "[ BENCH    ] " << name << (split == bvh_split_sah ? " sah     " : " midpoint")
+				<< " cost " << bvh.sah_cost() << ", build " << build_time << " ms, "
+				<< queries.size() << " queries " << query_time << " ms (" << hits << " hits)" << std::endl;
+		}
+	}
+
+	TEST(bvh_benchmark, DISABLED_midpoint_vs_sah)
+	{
+		for (const char* fixture : { "random_objects_50", "random_objects_100", "random_objects_1000" }) {
+			auto objects = read_fixture(std::string("../tests/bounding_volume_hierarchy/") + fixture);
+			ASSERT_FALSE(objects.empty());
+			compare_splits(fixture, objects, make_random_queries(10000, -10.f, 10.f, 1.f));
+		}
+		auto objects = make_random_objects(100000, -1000.f, 1000.f);
+		compare_splits("random_100k", objects, make_random_queries(20000, -1000.f, 1000.f, 10.f));
+		// clustered scene
+		std::vector<Object> clustered;
+		clustered.reserve(100000);
+		for (int i = 0; i < 100; ++i) {
+			vec3 center = glm::linearRand(vec3{ -1000.f }, vec3{ 1000.f });
+			for (auto& o : make_random_objects(1000, -20.f, 20.f)) {
+				AABB ab = o.get_aabb();
+				o.set_aabb(AABB{ ab.min_point + center, ab.max_point + center });
+				clustered.push_back(o);
+			}
+		}
+		compare_splits("clustered_100k", clustered, make_random_queries(20000, -1000.f, 1000.f, 10.f));
+	}
+
+	TEST(bvh_benchmark, DISABLED_flat_vs_pointer_traversal)
+	{
+		const int OBJ_COUNT = 100000, QUERY_COUNT = 20000;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		auto queries = make_random_queries(QUERY_COUNT, -1000.f, 1000.f, 10.f);
+		BVH bvh;
+		bvh.build_top_down(make_pointers(objects));
+		legacy_node* legacy = copy_legacy(bvh, *bvh.root(), nullptr);
+
+		// flat tree
+		auto start = bench_clock::now();
+		u64 flat_hits = run_aabb_queries(bvh, queries);
+		double flat_time = elapsed_ms(start);
+
+		// pointer tree
+		u64 legacy_hits = 0;
+		start = bench_clock::now();
+		std::vector<const legacy_node*> legacy_stack;
+		for (const AABB& q : queries) {
+			legacy_stack.push_back(legacy);
+			while (!legacy_stack.empty()) {
+				const legacy_node* n = legacy_stack.back();
+				legacy_stack.pop_back();
+				if (!intersection_aabb_aabb(n->bounding_volume, q))
+					continue;
+				if (n->children[0] == nullptr) {
+					legacy_hits += n->objects.size();
+					continue;
+				}
+				legacy_stack.push_back(n->children[1]);
+				legacy_stack.push_back(n->children[0]);
+			}
+		}
+		double legacy_time = elapsed_ms(start);
+		delete legacy;
+
+		EXPECT_EQ(flat_hits, legacy_hits);
+		std::cout << "[ BENCH    ] " << OBJ_COUNT << " objects, " << QUERY_COUNT << " aabb queries" << std::endl;
+		std::cout << "[ BENCH    ] pointer nodes: " << legacy_time << " ms, flat nodes: " << flat_time << " ms" 
+			<< " (x" << legacy_time / flat_time << ")" << std::endl;
+	}
+
+	TEST(bvh_benchmark, DISABLED_linear_vs_top_down)
+	{
+		const int OBJ_COUNT = 1000000, QUERY_COUNT = 20000;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		auto pointers = make_pointers(objects);
+		auto queries = make_random_queries(QUERY_COUNT, -1000.f, 1000.f, 10.f);
+		std::cout << "[ BENCH    ] " << OBJ_COUNT << " objects, " << worker_count() << " workers" << std::endl;
+		for (int builder = 0; builder < 4; ++builder) {
+			BVH bvh;
+			const char* name = "top-down midpoint";
+			auto start = bench_clock::now();
+			switch (builder) {
+			case 0: bvh.build_top_down(pointers); break;
+			case 1: name = "top-down sah     "; bvh.build_config().split = bvh_split_sah; bvh.build_top_down(pointers); break;
+			case 2: name = "linear 30 bits   "; bvh.build_linear(pointers); break;
+			case 3: name = "linear 63 bits   "; bvh.build_config().morton_bits = 63; bvh.build_linear(pointers); break;
+			}
+			double build_time = elapsed_ms(start);
+			start = bench_clock::now();
+			u64 hits = run_aabb_queries(bvh, queries);
+			double query_time = elapsed_ms(start);
+			std::cout << "[ BENCH    ] " << name << " build " << build_time << " ms, cost " << bvh.sah_cost()
+				<< ", " << QUERY_COUNT << " queries " << query_time << " ms (" << hits << " hits)" << std::endl;
+		}
+	}
+
+	TEST(bvh_benchmark, DISABLED_bottom_up_scaling)
+	{
+		const int QUERY_COUNT = 20000;
+		auto queries = make_random_queries(QUERY_COUNT, -1000.f, 1000.f, 10.f);
+		for (int count : { 1000, 10000, 100000, 1000000 }) {
+			auto objects = make_random_objects(count, -1000.f, 1000.f);
+			auto pointers = make_pointers(objects);
+			for (int radius : { 4, 16, 64 }) {
+				BVH bvh;
+				bvh.build_config().search_radius = radius;
+				auto start = bench_clock::now();
+				bvh.build_bottom_up(pointers);
+				double build_time = elapsed_ms(start);
+				start = bench_clock::now();
+				u64 hits = run_aabb_queries(bvh, queries);
+				double query_time = elapsed_ms(start);
+				std::cout << "[ BENCH    ] " << count << " objects, radius " << radius << ": build " << build_time
+					<< " ms, cost " << bvh.sah_cost() << ", queries " << query_time << " ms (" << hits << " hits)" << std::endl;
+			}
+			BVH top_down;
+			top_down.build_config().split = bvh_split_sah;
+			auto start = bench_clock::now();
+			top_down.build_top_down(pointers);
+			double build_time = elapsed_ms(start);
+			std::cout << "[ BENCH    ] " << count << " objects, top-down sah: build " << build_time
+				<< " ms, cost " << top_down.sah_cost() << std::endl;
+		}
+	}
+
+	TEST(bvh_benchmark, DISABLED_top_down_core_scaling)
+	{
+		const int OBJ_COUNT = 1000000;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		auto pointers = make_pointers(objects);
+		const u32 workers = worker_count();
+		const u32 hardware = glm::max(1u, std::thread::hardware_concurrency());
+		std::vector<u32> core_counts;
+		for (u32 cores = 1; cores < hardware; cores *= 2)
+			core_counts.push_back(cores);
+		core_counts.push_back(hardware);
+		for (int split = 0; split < bvh_split_count; ++split) {
+			double serial_time = 0.0;
+			float serial_cost = 0.f;
+			for (u32 cores : core_counts) {
+				set_worker_count(cores);
+				BVH bvh;
+				bvh.build_config().split = (BVHSplit)split;
+				auto start = bench_clock::now();
+				bvh.build_top_down(pointers);
+				double build_time = elapsed_ms(start);
+				if (cores == 1) {
+					serial_time = build_time;
+					serial_cost = bvh.sah_cost();
+				}
+				// same tree with any core count
+				EXPECT_EQ(serial_cost, bvh.sah_cost());
+				std::cout << "[ BENCH    ] " << OBJ_COUNT << " objects, " << (split == bvh_split_sah ? "sah     " : "midpoint")
+					<< ", " << cores << " cores: build " << build_time << " ms (x" << serial_time / build_time << ")" << std::endl;
+			}
+		}
+		set_worker_count(workers);
+	}
+
+	TEST(bvh_benchmark, DISABLED_incremental_rotations)
+	{
+		const int OBJ_COUNT = 100000;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		// objects inserted as they appear along x, worst case for the greedy descent
+		std::sort(objects.begin(), objects.end(), [](const Object& a, const Object& b) {
+			return a.get_aabb().min_point.x < b.get_aabb().min_point.x;
+		});
+		BVH top_down;
+		top_down.build_top_down(make_pointers(objects));
+		std::cout << "[ BENCH    ] " << OBJ_COUNT << " sorted insertions, top-down cost " << top_down.sah_cost() << std::endl;
+		top_down.destroy();
+		for (int rotations = 0; rotations < 2; ++rotations) {
+			BVH bvh;
+			bvh.build_config().rotations = rotations != 0;
+			auto start = bench_clock::now();
+			for (auto& o : objects)
+				bvh.add_object(o);
+			double insert_time = elapsed_ms(start);
+			std::cout << "[ BENCH    ] " << (rotations ? "rotations   " : "no rotations") << ": insert " << insert_time
+				<< " ms, cost " << bvh.sah_cost() << std::endl;
+			// spend a fixed budget per call like a game would every frame
+			start = bench_clock::now();
+			u32 rotated = 0;
+			for (int frame = 0; frame < 100; ++frame)
+				rotated += bvh.optimize(OBJ_COUNT / 10, 1.0);
+			std::cout << "[ BENCH    ] " << "  100 optimize calls (1 ms budget): " << elapsed_ms(start) << " ms, "
+				<< rotated << " rotations, cost " << bvh.sah_cost() << std::endl;
+		}
+	}
+
+	TEST(bvh_benchmark, DISABLED_greedy_vs_branch_and_bound_insertion)
+	{
+		auto fixture = read_fixture("../tests/bounding_volume_hierarchy/random_objects_1000");
+		ASSERT_FALSE(fixture.empty());
+		auto fixture_queries = make_random_queries(100000, -10.f, 10.f, 1.f);
+		auto random = make_random_objects(100000, -1000.f, 1000.f);
+		auto random_queries = make_random_queries(20000, -1000.f, 1000.f, 10.f);
+		for (auto [name, objects, queries] : { std::make_tuple("random_objects_1000", &fixture, &fixture_queries),
+			std::make_tuple("random_100k", &random, &random_queries) }) {
+			for (int insertion = 0; insertion < bvh_insertion_count; ++insertion) {
+				BVH bvh;
+				bvh.build_config().insertion = (BVHInsertion)insertion;
+				auto start = bench_clock::now();
+				for (auto& o : *objects)
+					bvh.add_object(o);
+				double insert_time = elapsed_ms(start);
+				start = bench_clock::now();
+				u64 hits = run_aabb_queries(bvh, *queries);
+				double query_time = elapsed_ms(start);
+				std::cout << "[ BENCH    ] " << name << (insertion == bvh_insertion_greedy ? " greedy          " : " branch and bound")
+					<< ": insert " << insert_time << " ms, cost " << bvh.sah_cost() << ", " << queries->size()
+					<< " queries " << query_time << " ms (" << hits << " hits)" << std::endl;
+			}
+		}
+	}
+
+	TEST(bvh_benchmark, DISABLED_leaf_size)
+	{
+		const int OBJ_COUNT = 100000, QUERY_COUNT = 20000;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		auto pointers = make_pointers(objects);
+		auto queries = make_random_queries(QUERY_COUNT, -1000.f, 1000.f, 10.f);
+		for (int leaf_size : { 1, 2, 4, 8, 16 }) {
+			BVH bvh;
+			bvh.build_config().split = bvh_split_sah;
+			bvh.build_config().max_leaf_size = leaf_size;
+			// visiting a node costs more than testing one more aabb
+			bvh.build_config().traversal_cost = 2.f;
+			auto start = bench_clock::now();
+			bvh.build_top_down(pointers);
+			double build_time = elapsed_ms(start);
+			start = bench_clock::now();
+			u64 hits = run_aabb_queries(bvh, queries);
+			double query_time = elapsed_ms(start);
+			std::cout << "[ BENCH    ] max leaf size " << leaf_size << ": " << bvh.node_capacity() << " nodes, build "
+				<< build_time << " ms, cost " << bvh.sah_cost() << ", queries " << query_time << " ms (" << hits << " hits)" << std::endl;
+		}
+	}
+
+	TEST(bvh_benchmark, DISABLED_binary_vs_wide)
+	{
+		const int OBJ_COUNT = 100000, QUERY_COUNT = 20000;
+		auto random = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		std::vector<Object> clustered;
+		clustered.reserve(OBJ_COUNT);
+		for (int i = 0; i < 100; ++i) {
+			vec3 center = glm::linearRand(vec3{ -1000.f }, vec3{ 1000.f });
+			for (auto& o : make_random_objects(OBJ_COUNT / 100, -20.f, 20.f)) {
+				AABB ab = o.get_aabb();
+				o.set_aabb(AABB{ ab.min_point + center, ab.max_point + center });
+				clustered.push_back(o);
+			}
+		}
+		auto aabbs = make_random_queries(QUERY_COUNT, -1000.f, 1000.f, 10.f);
+		auto rays = make_random_rays(QUERY_COUNT, -1000.f, 1000.f);
+		auto frustums = make_random_frustums(QUERY_COUNT, -1000.f, 1000.f, 30.f);
+		for (auto [name, objects] : { std::make_pair("random_100k", &random), std::make_pair("clustered_100k", &clustered) }) {
+			BVH bvh;
+			bvh.build_config().split = bvh_split_sah;
+			bvh.build_top_down(make_pointers(*objects));
+			BVH4 bvh4;
+			BVH8 bvh8;
+			auto start = bench_clock::now();
+			bvh4.build(bvh);
+			double build4 = elapsed_ms(start);
+			start = bench_clock::now();
+			bvh8.build(bvh);
+			double build8 = elapsed_ms(start);
+			std::cout << "[ BENCH    ] " << name << ": binary " << bvh.node_capacity() << " nodes, bvh4 " << bvh4.node_count()
+				<< " nodes (" << build4 << " ms), bvh8 " << bvh8.node_count() << " nodes (" << build8 << " ms)" << std::endl;
+
+			// binary
+			start = bench_clock::now();
+			u64 aabb_hits = run_aabb_queries(bvh, aabbs);
+			double aabb_time = elapsed_ms(start);
+			start = bench_clock::now();
+			u64 ray_hits = run_ray_queries(bvh, rays);
+			double ray_time = elapsed_ms(start);
+			start = bench_clock::now();
+			u64 frustum_hits = run_frustum_queries(bvh, frustums);
+			double frustum_time = elapsed_ms(start);
+			std::cout << "[ BENCH    ]   binary: aabb " << aabb_time << " ms (" << aabb_hits << "), ray " << ray_time << " ms ("
+				<< ray_hits << "), frustum " << frustum_time << " ms (" << frustum_hits << ")" << std::endl;
+
+			// wide, same queries
+			auto run_wide = [&](const char* label, const auto& wide) {
+				std::vector<Object*> found;
+				auto start = bench_clock::now();
+				u64 aabb_hits = 0;
+				for (const AABB& q : aabbs) {
+					found.clear();
+					wide.query_aabb(q, found);
+					aabb_hits += found.size();
+				}
+				double aabb_time = elapsed_ms(start);
+				start = bench_clock::now();
+				u64 ray_hits = 0;
+				for (const Ray& r : rays) {
+					float t;
+					ray_hits += wide.raycast(r, t) != nullptr;
+				}
+				double ray_time = elapsed_ms(start);
+				start = bench_clock::now();
+				u64 frustum_hits = 0;
+				for (const Frustum& f : frustums) {
+					found.clear();
+					wide.query_frustum(f, found);
+					frustum_hits += found.size();
+				}
+				double frustum_time = elapsed_ms(start);
+				std::cout << "[ BENCH    ]   " << label << ": aabb " << aabb_time << " ms (" << aabb_hits << "), ray " << ray_time << " ms ("
+					<< ray_hits << "), frustum " << frustum_time << " ms (" << frustum_hits << ")" << std::endl;
+			};
+			run_wide("bvh4  ", bvh4);
+			run_wide("bvh8  ", bvh8);
+		}
+	}
+
+	TEST(bvh_benchmark, DISABLED_ray_aabb_slab)
+	{
+		// a handful of rays against many boxes, like a bvh traversal
+		const int RAY_COUNT = 100, BOX_COUNT = 100000;
+		auto objects = make_random_objects(BOX_COUNT, -1000.f, 1000.f);
+		std::vector<AABB> boxes;
+		boxes.reserve(BOX_COUNT);
+		for (auto& o : objects)
+			boxes.push_back(o.get_aabb());
+		auto rays = make_random_rays(RAY_COUNT, -1000.f, 1000.f);
+
+		auto start = bench_clock::now();
+		u64 hits = 0;
+		double sum = 0.0;
+		for (const Ray& r : rays) {
+			for (const AABB& ab : boxes) {
+				float t = intersection_ray_aabb(r, ab);
+				hits += t >= 0.f;
+				sum += t;
+			}
+		}
+		double ray_time = elapsed_ms(start);
+		start = bench_clock::now();
+		u64 query_hits = 0;
+		double query_sum = 0.0;
+		for (const Ray& r : rays) {
+			const RayQuery query(r);
+			for (const AABB& ab : boxes) {
+				float t = intersection_ray_aabb(query, ab);
+				query_hits += t >= 0.f;
+				query_sum += t;
+			}
+		}
+		double query_time = elapsed_ms(start);
+		EXPECT_EQ(hits, query_hits);
+		EXPECT_EQ(sum, query_sum);
+		const double tests = (double)RAY_COUNT * BOX_COUNT;
+		std::cout << "[ BENCH    ] Ray     : " << ray_time << " ms, " << tests / ray_time / 1000.0 << " M tests/s (" << hits << " hits)" << std::endl;
+		std::cout << "[ BENCH    ] RayQuery: " << query_time << " ms, " << tests / query_time / 1000.0 << " M tests/s (" << query_hits << " hits)" << std::endl;
+	}
+
+	TEST(bvh_benchmark, DISABLED_ray_packets)
+	{
+		const int OBJ_COUNT = 100000, SIDE = 256;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		BVH bvh;
+		bvh.build_config().split = bvh_split_sah;
+		bvh.build_top_down(make_pointers(objects));
+		// camera grid in 4x2 tiles so every 4 or 8 consecutive rays are neighbours
+		std::vector<Ray> coherent;
+		coherent.reserve(SIDE * SIDE);
+		const vec3 eye{ 0.f, 100.f, -300.f };
+		for (int ty = 0; ty < SIDE; ty += 2)
+			for (int tx = 0; tx < SIDE; tx += 4)
+				for (int y = ty; y < ty + 2; ++y)
+					for (int x = tx; x < tx + 4; ++x)
+						coherent.emplace_back(eye, vec3{ x * 600.f / SIDE - 300.f, 0.f, y * 600.f / SIDE - 300.f } - eye);
+		auto incoherent = make_random_rays(SIDE * SIDE, -1000.f, 1000.f);
+
+		for (auto [name, rays] : { std::make_pair("coherent  ", &coherent), std::make_pair("incoherent", &incoherent) }) {
+			auto start = bench_clock::now();
+			u64 hits = 0;
+			for (const Ray& r : *rays)
+				hits += bvh.raycast_closest(r).object != nullptr;
+			double single_time = elapsed_ms(start);
+
+			auto run_packets = [&](auto width) {
+				constexpr u32 WIDTH = decltype(width)::value;
+				std::array<bvh_ray_hit, WIDTH> packet_hits;
+				u64 hits = 0;
+				for (size_t i = 0; i < rays->size(); i += WIDTH) {
+					u32 count = (u32)glm::min(rays->size() - i, (size_t)WIDTH);
+					bvh.raycast_packet(RayPacket<WIDTH>(&(*rays)[i], count), packet_hits.data());
+					for (u32 lane = 0; lane < count; ++lane)
+						hits += packet_hits[lane].object != nullptr;
+				}
+				return hits;
+			};
+			start = bench_clock::now();
+			u64 hits4 = run_packets(std::integral_constant<u32, 4>{});
+			double packet4_time = elapsed_ms(start);
+			start = bench_clock::now();
+			u64 hits8 = run_packets(std::integral_constant<u32, 8>{});
+			double packet8_time = elapsed_ms(start);
+			EXPECT_EQ(hits4, hits);
+			EXPECT_EQ(hits8, hits);
+			const double count = (double)rays->size();
+			std::cout << "[ BENCH    ] " << name << " (" << hits << " hits): single " << count / single_time / 1000.0 << " M rays/s, packet4 "
+				<< count / packet4_time / 1000.0 << " M rays/s, packet8 " << count / packet8_time / 1000.0 << " M rays/s" << std::endl;
+		}
+	}
+
+	TEST(bvh_benchmark, DISABLED_raycast_batch)
+	{
+		const int OBJ_COUNT = 100000, RAY_COUNT = 1 << 16;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		BVH bvh;
+		bvh.build_config().split = bvh_split_sah;
+		bvh.build_top_down(make_pointers(objects));
+		// sensor like rays from many points, submitted in random order
+		std::vector<Ray> rays;
+		rays.reserve(RAY_COUNT);
+		for (int i = 0; i < RAY_COUNT / 64; ++i) {
+			vec3 eye = vec3{ glm::linearRand(-1000.f, 1000.f), 20.f, glm::linearRand(-1000.f, 1000.f) };
+			for (int j = 0; j < 64; ++j)
+				rays.emplace_back(eye, vec3{ glm::linearRand(-1.f, 1.f), -0.5f, glm::linearRand(-1.f, 1.f) });
+		}
+		for (size_t i = rays.size() - 1; i > 0; --i)
+			std::swap(rays[i], rays[glm::linearRand<size_t>(0, i)]);
+		std::vector<bvh_ray_hit> hits(rays.size());
+
+		auto start = bench_clock::now();
+		u64 single_hits = 0;
+		for (const Ray& r : rays)
+			single_hits += bvh.raycast_closest(r).object != nullptr;
+		double single_time = elapsed_ms(start);
+		std::cout << "[ BENCH    ] one by one: " << single_time << " ms, " << rays.size() / single_time / 1000.0 << " M rays/s" << std::endl;
+
+		bvh_ray_batch batch;
+		for (u32 workers : { 1u, std::thread::hardware_concurrency() }) {
+			set_worker_count(workers);
+			for (int sort = 0; sort < 2; ++sort) {
+				batch.sort = sort != 0;
+				// first call sizes the scratch
+				bvh.raycast_batch(rays.data(), rays.size(), hits.data(), batch);
+				start = bench_clock::now();
+				bvh.raycast_batch(rays.data(), rays.size(), hits.data(), batch);
+				double batch_time = elapsed_ms(start);
+				u64 batch_hits = 0;
+				for (const auto& h : hits)
+					batch_hits += h.object != nullptr;
+				EXPECT_EQ(batch_hits, single_hits);
+				std::cout << "[ BENCH    ] batch " << workers << " workers" << (sort ? " sorted  " : " unsorted") << ": " << batch_time << " ms, "
+					<< rays.size() / batch_time / 1000.0 << " M rays/s" << std::endl;
+			}
+		}
+		set_worker_count(0);
+	}
+
+	TEST(bvh_benchmark, DISABLED_frustum_culling)
+	{
+		const int OBJ_COUNT = 100000, FRAME_COUNT = 200;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		BVH bvh;
+		bvh.build_config().split = bvh_split_sah;
+		bvh.build_top_down(make_pointers(objects));
+		// camera flying over the objects
+		std::vector<Frustum> frustums;
+		Camera camera;
+		camera.far = 1000.f;
+		for (int i = 0; i < FRAME_COUNT; ++i) {
+			float a = glm::two_pi<float>() * i / FRAME_COUNT;
+			camera.pos = vec3{ std::cos(a) * 800.f, 50.f, std::sin(a) * 800.f };
+			camera.target = vec3{ 0.f };
+			frustums.push_back(camera.get_frustum());
+		}
+
+		auto start = bench_clock::now();
+		u64 linear_hits = 0;
+		for (const Frustum& f : frustums)
+			for (const Object& o : objects)
+				linear_hits += intersection_frustum_aabb(f, o.get_aabb()) != OUTSIDE;
+		double linear_time = elapsed_ms(start);
+		start = bench_clock::now();
+		u64 tree_hits = run_frustum_queries(bvh, frustums);
+		double tree_time = elapsed_ms(start);
+		start = bench_clock::now();
+		u64 query_hits = 0;
+		for (const Frustum& f : frustums)
+			bvh.query_frustum(f, [&query_hits](Object&) { query_hits++; });
+		double query_time = elapsed_ms(start);
+		EXPECT_EQ(tree_hits, linear_hits);
+		EXPECT_EQ(query_hits, linear_hits);
+		std::cout << "[ BENCH    ] " << linear_hits / FRAME_COUNT << " visible of " << OBJ_COUNT << " per frame" << std::endl;
+		std::cout << "[ BENCH    ] linear " << linear_time / FRAME_COUNT << " ms/frame, tree " << tree_time / FRAME_COUNT
+			<< " ms/frame, query_frustum " << query_time / FRAME_COUNT << " ms/frame" << std::endl;
+	}
+
+	TEST(bvh_benchmark, DISABLED_frustum_aabb_simd)
+	{
+		const int BOX_COUNT = 100000, FRUSTUM_COUNT = 20;
+		auto objects = make_random_objects(BOX_COUNT, -1000.f, 1000.f);
+		std::vector<AABB> boxes;
+		boxes.reserve(objects.size());
+		for (const Object& o : objects)
+			boxes.push_back(o.get_aabb());
+		auto frustums = make_random_frustums(FRUSTUM_COUNT, -1000.f, 1000.f, 300.f);
+		std::vector<intersection_type> results(boxes.size());
+
+		auto start = bench_clock::now();
+		u64 corner_hits = 0;
+		for (const Frustum& f : frustums)
+			for (const AABB& ab : boxes)
+				corner_hits += intersection_frustum_aabb(f, ab) != OUTSIDE;
+		double corner_time = elapsed_ms(start);
+		start = bench_clock::now();
+		u64 query_hits = 0;
+		for (const Frustum& f : frustums) {
+			const FrustumQuery query(f);
+			for (const AABB& ab : boxes)
+				query_hits += intersection_frustum_aabb(query, ab) != OUTSIDE;
+		}
+		double query_time = elapsed_ms(start);
+		start = bench_clock::now();
+		u64 batch_hits = 0;
+		for (const Frustum& f : frustums) {
+			intersection_frustum_aabb(FrustumQuery(f), boxes.data(), boxes.size(), results.data());
+			for (intersection_type r : results)
+				batch_hits += r != OUTSIDE;
+		}
+		double batch_time = elapsed_ms(start);
+		EXPECT_EQ(query_hits, corner_hits);
+		EXPECT_EQ(batch_hits, corner_hits);
+		const double tests = (double)BOX_COUNT * FRUSTUM_COUNT / 1000.0;
+		std::cout << "[ BENCH    ] 8 corners " << tests / corner_time << " M tests/s, FrustumQuery " << tests / query_time
+			<< " M tests/s, batch " << tests / batch_time << " M tests/s" << std::endl;
+	}
+
+	TEST(bvh_benchmark, DISABLED_frustum_coherence)
+	{
+		const int OBJ_COUNT = 100000, FRAME_COUNT = 600;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		BVH bvh;
+		bvh.build_config().split = bvh_split_sah;
+		bvh.build_top_down(make_pointers(objects));
+		// fly-through, the camera moves a bit every frame
+		std::vector<Frustum> frustums;
+		Camera camera;
+		camera.far = 1000.f;
+		for (int i = 0; i < FRAME_COUNT; ++i) {
+			float a = glm::two_pi<float>() * i / FRAME_COUNT;
+			camera.pos = vec3{ std::cos(a) * 600.f, 20.f, std::sin(a) * 600.f };
+			camera.target = vec3{ 0.f };
+			frustums.push_back(camera.get_frustum());
+		}
+		bvh_frustum_cache cache;
+		auto run = [&](const char* label, bool coherence) {
+			u64 hits = 0, plane_tests = 0, cached = 0;
+			double time = 0.0;
+			for (const Frustum& f : frustums) {
+				// nothing cached every frame without coherence
+				if (!coherence) {
+					std::fill(cache.node_planes.begin(), cache.node_planes.end(), cNoPlane);
+					std::fill(cache.primitive_planes.begin(), cache.primitive_planes.end(), cNoPlane);
+				}
+				cache.stats = frustum_cull_stats{};
+				auto start = bench_clock::now();
+				bvh.query_frustum(f, [&hits](Object&) { hits++; }, cache);
+				time += elapsed_ms(start);
+				plane_tests += cache.stats.plane_tests;
+				cached += cache.stats.cached_rejections;
+			}
+			std::cout << "[ BENCH    ] " << label << ": " << time / FRAME_COUNT << " ms/frame, " << plane_tests / FRAME_COUNT << " plane tests/frame, "
+				<< cached / FRAME_COUNT << " cached rejections/frame (" << hits / FRAME_COUNT << " visible)" << std::endl;
+		};
+		run("tree, no coherence", false);
+		run("tree, last plane  ", true);
+
+		// object by object, no plane masking
+		std::vector<u8> last_planes(objects.size(), cNoPlane);
+		for (int coherence = 0; coherence < 2; ++coherence) {
+			u64 hits = 0;
+			frustum_cull_stats stats;
+			auto start = bench_clock::now();
+			for (const Frustum& f : frustums) {
+				for (size_t i = 0; i < objects.size(); ++i) {
+					u8 plane = coherence ? last_planes[i] : cNoPlane;
+					hits += intersection_frustum_aabb(f, objects[i].get_aabb(), plane, &stats) != OUTSIDE;
+					last_planes[i] = plane;
+				}
+			}
+			double time = elapsed_ms(start);
+			std::cout << "[ BENCH    ] linear, " << (coherence ? "last plane  " : "no coherence") << ": " << time / FRAME_COUNT << " ms/frame, "
+				<< stats.plane_tests / FRAME_COUNT << " plane tests/frame, " << stats.cached_rejections / FRAME_COUNT << " cached rejections/frame ("
+				<< hits / FRAME_COUNT << " visible)" << std::endl;
+		}
+	}
+
+	TEST(bvh_benchmark, DISABLED_overlapping_pairs)
+	{
+		for (int count : { 10000, 100000 }) {
+			// same density for both sizes
+			const float half = 1000.f * std::sqrt(count / 100000.f);
+			auto objects = make_random_objects(count, -half, half);
+			BVH bvh;
+			bvh.build_config().split = bvh_split_sah;
+			bvh.build_top_down(make_pointers(objects));
+
+			if (count <= 10000) {
+				auto start = bench_clock::now();
+				u64 brute_pairs = 0;
+				for (int i = 0; i < count; ++i)
+					for (int j = i + 1; j < count; ++j)
+						brute_pairs += intersection_aabb_aabb(objects[i].get_aabb(), objects[j].get_aabb());
+				std::cout << "[ BENCH    ] " << count << " objects, n^2: " << elapsed_ms(start) << " ms (" << brute_pairs << " pairs)" << std::endl;
+			}
+			auto start = bench_clock::now();
+			u64 tree_pairs = 0;
+			bvh.query_overlapping_pairs([&tree_pairs](Object&, Object&) { tree_pairs++; });
+			std::cout << "[ BENCH    ] " << count << " objects, tree: " << elapsed_ms(start) << " ms (" << tree_pairs << " pairs)" << std::endl;
+			std::vector<bvh_object_pair> pairs;
+			for (u32 workers : { 1u, std::thread::hardware_concurrency() }) {
+				set_worker_count(workers);
+				pairs.clear();
+				start = bench_clock::now();
+				bvh.query_overlapping_pairs_parallel(pairs);
+				std::cout << "[ BENCH    ] " << count << " objects, parallel " << workers << " workers: " << elapsed_ms(start) << " ms (" << pairs.size() << " pairs)" << std::endl;
+				EXPECT_EQ(pairs.size(), tree_pairs);
+			}
+			set_worker_count(0);
+		}
+	}
+	/**
+	*
+	* @brief persistent pairs against a full pair query every frame, for several ratios of moving objects
+	*/
+	TEST(bvh_benchmark, DISABLED_pair_manager)
+	{
+		const int OBJ_COUNT = 100000;
+		const int FRAMES = 20;
+		for (float moving : { 0.01f, 0.1f, 0.5f }) {
+			auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+			BVH bvh;
+			bvh.build_config().split = bvh_split_sah;
+			bvh.build_config().fat_leaves = true;
+			bvh.build_top_down(make_pointers(objects));
+			bvh_pair_manager manager;
+			manager.reserve(OBJ_COUNT);
+			for (auto& o : objects)
+				manager.add_object(o);
+			manager.update(bvh);
+
+			double manager_ms = 0.0, full_ms = 0.0;
+			u64 events = 0;
+			const int move_count = (int)(moving * OBJ_COUNT);
+			for (int frame = 0; frame < FRAMES; ++frame) {
+				for (int i = 0; i < move_count; ++i) {
+					Object& o = objects[glm::linearRand(0, OBJ_COUNT - 1)];
+					const vec3 offset = glm::linearRand(vec3{ -0.2f }, vec3{ 0.2f });
+					const AABB ab = o.get_aabb();
+					o.set_aabb(AABB{ ab.min_point + offset, ab.max_point + offset });
+					bvh.move_object(o);
+					manager.mark_moved(o);
+				}
+				auto start = bench_clock::now();
+				manager.update(bvh);
+				manager_ms += elapsed_ms(start);
+				events += manager.begin_events().size() + manager.end_events().size();
+
+				start = bench_clock::now();
+				u64 pairs = 0;
+				bvh.query_overlapping_pairs([&pairs](Object&, Object&) { pairs++; });
+				full_ms += elapsed_ms(start);
+				EXPECT_EQ(pairs, manager.pair_count());
+			}
+			std::cout << "[ BENCH    ] " << moving * 100.f << "% moving: manager " << manager_ms / FRAMES << " ms/frame (" << events / FRAMES << " events), full query "
+				<< full_ms / FRAMES << " ms/frame (" << manager.pair_count() << " pairs)" << std::endl;
+		}
+	}
+	/**
+	*
+	* @brief update + pair query per frame, sweep and prune against the dynamic bvh
+	*	for several object counts and ratios of moving objects
+	*/
+	TEST(bvh_benchmark, DISABLED_sweep_and_prune)
+	{
+		const int FRAMES = 10;
+		for (int count : { 10000, 100000 }) {
+			const float half = 1000.f * std::sqrt(count / 100000.f);
+			for (float moving : { 0.01f, 0.1f, 0.5f, 1.f }) {
+				auto objects = make_random_objects(count, -half, half);
+				auto objects_ptr = make_pointers(objects);
+				BVH bvh;
+				bvh.build_config().split = bvh_split_sah;
+				bvh.build_config().fat_leaves = true;
+				bvh.build_top_down(objects_ptr);
+				SAP sap;
+				sap.build(objects_ptr);
+
+				double bvh_ms = 0.0, sap_ms = 0.0;
+				u64 bvh_pairs = 0, sap_pairs = 0;
+				const int move_count = (int)(moving * count);
+				for (int frame = 0; frame < FRAMES; ++frame) {
+					for (int i = 0; i < move_count; ++i) {
+						Object& o = objects[moving < 1.f ? glm::linearRand(0, count - 1) : i];
+						const vec3 offset = glm::linearRand(vec3{ -0.5f }, vec3{ 0.5f });
+						const AABB ab = o.get_aabb();
+						o.set_aabb(AABB{ ab.min_point + offset, ab.max_point + offset });
+					}
+					auto start = bench_clock::now();
+					for (auto& o : objects)
+						bvh.move_object(o);
+					bvh.query_overlapping_pairs([&bvh_pairs](Object&, Object&) { bvh_pairs++; });
+					bvh_ms += elapsed_ms(start);
+
+					start = bench_clock::now();
+					for (auto& o : objects)
+						sap.move_object(o);
+					sap.query_overlapping_pairs([&sap_pairs](Object&, Object&) { sap_pairs++; });
+					sap_ms += elapsed_ms(start);
+				}
+				EXPECT_EQ(bvh_pairs, sap_pairs);
+				std::cout << "[ BENCH    ] " << count << " objects, " << moving * 100.f << "% moving: bvh " << bvh_ms / FRAMES << " ms/frame, sap "
+					<< sap_ms / FRAMES << " ms/frame (" << sap_pairs / FRAMES << " pairs)" << std::endl;
+			}
+		}
+	}
+	/**
+	*
+	* @brief flat scene of mixed sizes, hash grid against the dynamic bvh and sweep and prune
+	*/
+	TEST(bvh_benchmark, DISABLED_hash_grid)
+	{
+		const int OBJ_COUNT = 100000, QUERY_COUNT = 10000, RAY_COUNT = 10000;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		auto objects_ptr = make_pointers(objects);
+		std::vector<AABB> boxes(QUERY_COUNT);
+		for (auto& ab : boxes) {
+			const vec3 p = vec3{ glm::linearRand(-1000.f, 1000.f), 0.f, glm::linearRand(-1000.f, 1000.f) };
+			ab = AABB{ p - vec3{ 5.f }, p + vec3{ 5.f } };
+		}
+		std::vector<Ray> rays;
+		for (int i = 0; i < RAY_COUNT; ++i)
+			rays.emplace_back(vec3{ glm::linearRand(-1000.f, 1000.f), 20.f, glm::linearRand(-1000.f, 1000.f) }, vec3{ glm::linearRand(-1.f, 1.f), -0.5f, glm::linearRand(-1.f, 1.f) });
+
+		BVH bvh;
+		bvh.build_config().split = bvh_split_sah;
+		bvh.build_config().fat_leaves = true;
+		SAP sap;
+		hash_grid grid;
+		grid.config().cell_size = 2.f;
+		grid.config().columns = true;
+		auto start = bench_clock::now();
+		bvh.build_top_down(objects_ptr);
+		const double bvh_build = elapsed_ms(start);
+		start = bench_clock::now();
+		sap.build(objects_ptr);
+		const double sap_build = elapsed_ms(start);
+		start = bench_clock::now();
+		grid.build(objects_ptr);
+		const double grid_build = elapsed_ms(start);
+		std::cout << "[ BENCH    ] build: bvh " << bvh_build << " ms, sap " << sap_build << " ms, grid " << grid_build << " ms" << std::endl;
+
+		// every object moves a little
+		for (auto& o : objects) {
+			const vec3 offset = glm::linearRand(vec3{ -0.5f }, vec3{ 0.5f });
+			const AABB ab = o.get_aabb();
+			o.set_aabb(AABB{ ab.min_point + offset, ab.max_point + offset });
+		}
+		start = bench_clock::now();
+		for (auto& o : objects)
+			bvh.move_object(o);
+		const double bvh_move = elapsed_ms(start);
+		start = bench_clock::now();
+		for (auto& o : objects)
+			sap.move_object(o);
+		const double sap_move = elapsed_ms(start);
+		start = bench_clock::now();
+		for (auto& o : objects)
+			grid.move_object(o);
+		const double grid_move = elapsed_ms(start);
+		std::cout << "[ BENCH    ] move all: bvh " << bvh_move << " ms, sap " << sap_move << " ms, grid " << grid_move << " ms" << std::endl;
+
+		u64 bvh_found = 0, sap_found = 0, grid_found = 0;
+		start = bench_clock::now();
+		for (const AABB& ab : boxes)
+			bvh.query_aabb(ab, [&bvh_found](Object&) { bvh_found++; });
+		const double bvh_query = elapsed_ms(start);
+		start = bench_clock::now();
+		for (const AABB& ab : boxes)
+			sap.query_aabb(ab, [&sap_found](Object&) { sap_found++; });
+		const double sap_query = elapsed_ms(start);
+		start = bench_clock::now();
+		for (const AABB& ab : boxes)
+			grid.query_aabb(ab, [&grid_found](Object&) { grid_found++; });
+		const double grid_query = elapsed_ms(start);
+		EXPECT_EQ(bvh_found, grid_found);
+		EXPECT_EQ(sap_found, grid_found);
+		std::cout << "[ BENCH    ] " << QUERY_COUNT << " aabb queries: bvh " << bvh_query << " ms, sap " << sap_query << " ms, grid " << grid_query << " ms (" << grid_found << " found)" << std::endl;
+
+		bvh_found = sap_found = grid_found = 0;
+		start = bench_clock::now();
+		bvh.query_overlapping_pairs([&bvh_found](Object&, Object&) { bvh_found++; });
+		const double bvh_pairs = elapsed_ms(start);
+		start = bench_clock::now();
+		sap.query_overlapping_pairs([&sap_found](Object&, Object&) { sap_found++; });
+		const double sap_pairs = elapsed_ms(start);
+		start = bench_clock::now();
+		grid.query_overlapping_pairs([&grid_found](Object&, Object&) { grid_found++; });
+		const double grid_pairs = elapsed_ms(start);
+		EXPECT_EQ(bvh_found, grid_found);
+		EXPECT_EQ(sap_found, grid_found);
+		std::cout << "[ BENCH    ] pairs: bvh " << bvh_pairs << " ms, sap " << sap_pairs << " ms, grid " << grid_pairs << " ms (" << grid_found << " pairs)" << std::endl;
+
+		bvh_found = grid_found = 0;
+		start = bench_clock::now();
+		for (const Ray& r : rays)
+			bvh_found += bvh.raycast_closest(r).object != nullptr;
+		const double bvh_rays = elapsed_ms(start);
+		start = bench_clock::now();
+		for (const Ray& r : rays)
+			grid_found += grid.raycast_closest(r).object != nullptr;
+		const double grid_rays = elapsed_ms(start);
+		EXPECT_EQ(bvh_found, grid_found);
+		std::cout << "[ BENCH    ] " << RAY_COUNT << " rays: bvh " << bvh_rays << " ms, grid " << grid_rays << " ms (" << grid_found << " hits)" << std::endl;
+	}
+	TEST(bvh_benchmark, DISABLED_loose_octree)
+	{
+		const int OBJ_COUNT = 100000, QUERY_COUNT = 10000, RAY_COUNT = 10000, FRUSTUM_COUNT = 1000;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		auto objects_ptr = make_pointers(objects);
+		std::vector<AABB> boxes(QUERY_COUNT);
+		for (auto& ab : boxes) {
+			const vec3 p = vec3{ glm::linearRand(-1000.f, 1000.f), 0.f, glm::linearRand(-1000.f, 1000.f) };
+			ab = AABB{ p - vec3{ 5.f }, p + vec3{ 5.f } };
+		}
+		std::vector<Ray> rays;
+		for (int i = 0; i < RAY_COUNT; ++i)
+			rays.emplace_back(vec3{ glm::linearRand(-1000.f, 1000.f), 20.f, glm::linearRand(-1000.f, 1000.f) }, vec3{ glm::linearRand(-1.f, 1.f), -0.5f, glm::linearRand(-1.f, 1.f) });
+		const auto frustums = make_random_frustums(FRUSTUM_COUNT, -1000.f, 1000.f, 50.f);
+
+		BVH bvh;
+		bvh.build_config().split = bvh_split_sah;
+		bvh.build_config().fat_leaves = true;
+		loose_octree octree;
+		auto start = bench_clock::now();
+		bvh.build_top_down(objects_ptr);
+		const double bvh_build = elapsed_ms(start);
+		start = bench_clock::now();
+		octree.build(objects_ptr);
+		const double octree_build = elapsed_ms(start);
+		std::cout << "[ BENCH    ] build: bvh " << bvh_build << " ms, octree " << octree_build << " ms (" << octree.node_capacity() << " nodes)" << std::endl;
+
+		// every object moves a little, most stay in their loose cell
+		for (auto& o : objects) {
+			const vec3 offset = glm::linearRand(vec3{ -0.5f }, vec3{ 0.5f });
+			const AABB ab = o.get_aabb();
+			o.set_aabb(AABB{ ab.min_point + offset, ab.max_point + offset });
+		}
+		start = bench_clock::now();
+		for (auto& o : objects)
+			bvh.move_object(o);
+		const double bvh_move = elapsed_ms(start);
+		u32 reinserted = 0;
+		start = bench_clock::now();
+		for (auto& o : objects)
+			reinserted += octree.move_object(o);
+		const double octree_move = elapsed_ms(start);
+		std::cout << "[ BENCH    ] move all: bvh " << bvh_move << " ms, octree " << octree_move << " ms (" << reinserted << " reinserted)" << std::endl;
+
+		u64 bvh_found = 0, octree_found = 0;
+		start = bench_clock::now();
+		for (const AABB& ab : boxes)
+			bvh.query_aabb(ab, [&bvh_found](Object&) { bvh_found++; });
+		const double bvh_query = elapsed_ms(start);
+		start = bench_clock::now();
+		for (const AABB& ab : boxes)
+			octree.query_aabb(ab, [&octree_found](Object&) { octree_found++; });
+		const double octree_query = elapsed_ms(start);
+		EXPECT_EQ(bvh_found, octree_found);
+		std::cout << "[ BENCH    ] " << QUERY_COUNT << " aabb queries: bvh " << bvh_query << " ms, octree " << octree_query << " ms (" << octree_found << " found)" << std::endl;
+
+		bvh_found = octree_found = 0;
+		start = bench_clock::now();
+		for (const Frustum& f : frustums)
+			bvh.query_frustum(f, [&bvh_found](Object&) { bvh_found++; });
+		const double bvh_frustum = elapsed_ms(start);
+		start = bench_clock::now();
+		for (const Frustum& f : frustums)
+			octree.query_frustum(f, [&octree_found](Object&) { octree_found++; });
+		const double octree_frustum = elapsed_ms(start);
+		EXPECT_EQ(bvh_found, octree_found);
+		std::cout << "[ BENCH    ] " << FRUSTUM_COUNT << " frustums: bvh " << bvh_frustum << " ms, octree " << octree_frustum << " ms (" << octree_found << " found)" << std::endl;
+
+		bvh_found = octree_found = 0;
+		start = bench_clock::now();
+		for (const Ray& r : rays)
+			bvh_found += bvh.raycast_closest(r).object != nullptr;
+		const double bvh_rays = elapsed_ms(start);
+		start = bench_clock::now();
+		for (const Ray& r : rays)
+			octree_found += octree.raycast_closest(r).object != nullptr;
+		const double octree_rays = elapsed_ms(start);
+		EXPECT_EQ(bvh_found, octree_found);
+		std::cout << "[ BENCH    ] " << RAY_COUNT << " rays: bvh " << bvh_rays << " ms, octree " << octree_rays << " ms (" << octree_found << " hits)" << std::endl;
+	}
+	TEST(bvh_benchmark, DISABLED_query_nearest)
+	{
+		const int OBJ_COUNT = 100000, POINT_COUNT = 10000;
+		const u32 K = 8;
+		const float RADIUS = 10.f;
+		auto objects = make_random_objects(OBJ_COUNT, -1000.f, 1000.f);
+		auto objects_ptr = make_pointers(objects);
+		std::vector<vec3> points(POINT_COUNT);
+		for (auto& p : points)
+			p = vec3{ glm::linearRand(-1000.f, 1000.f), 0.f, glm::linearRand(-1000.f, 1000.f) };
+		const bvh_distance_callback to_center = [](Object& o, const vec3& p, float) { return glm::distance2(o.get_aabb().center(), p); };
+
+		BVH bvh;
+		bvh.build_config().split = bvh_split_sah;
+		bvh.build_config().fat_leaves = true;
+		bvh.build_top_down(objects_ptr);
+
+		std::vector<bvh_nearest_hit> hits;
+		double sum = 0.0;
+		auto start = bench_clock::now();
+		for (const vec3& p : points) {
+			bvh.query_nearest(p, K, hits);
+			sum += hits.back().distance2;
+		}
+		const double serial = elapsed_ms(start);
+		start = bench_clock::now();
+		for (const vec3& p : points) {
+			bvh.query_nearest(p, K, hits, FLT_MAX, to_center);
+			sum += hits.back().distance2;
+		}
+		const double serial_exact = elapsed_ms(start);
+		std::vector<bvh_nearest_hit> batch(points.size() * K);
+		start = bench_clock::now();
+		bvh.query_nearest_batch(points.data(), points.size(), K, batch.data());
+		const double batched = elapsed_ms(start);
+		start = bench_clock::now();
+		bvh.query_nearest_batch(points.data(), points.size(), K, batch.data(), FLT_MAX, to_center);
+		const double batched_exact = elapsed_ms(start);
+		std::cout << "[ BENCH    ] " << POINT_COUNT << " nearest " << K << ": " << serial << " ms (exact " << serial_exact << " ms), batch on "
+			<< worker_count() << " workers " << batched << " ms (exact " << batched_exact << " ms)" << std::endl;
+
+		// radius query against an aabb query filtered by distance
+		u64 radius_found = 0, aabb_found = 0;
+		start = bench_clock::now();
+		for (const vec3& p : points)
+			bvh.query_radius(p, RADIUS, [&radius_found](Object&, float) { radius_found++; });
+		const double radius = elapsed_ms(start);
+		const float radius2 = RADIUS * RADIUS;
+		start = bench_clock::now();
+		for (const vec3& p : points)
+			bvh.query_aabb(AABB{ p - vec3{ RADIUS }, p + vec3{ RADIUS } }, [&aabb_found, &p, radius2](Object& o) {
+				aabb_found += distance2_point_aabb(p, o.get_aabb()) <= radius2;
+			});
+		const double aabb = elapsed_ms(start);
+		EXPECT_EQ(radius_found, aabb_found);
+		std::cout << "[ BENCH    ] " << POINT_COUNT << " radius " << RADIUS << ": " << radius << " ms, aabb query + filter " << aabb << " ms (" << radius_found << " found)" << std::endl;
+		EXPECT_GT(sum, 0.0);
+	}
+}
@@ -44,6 +44,224 @@ namespace {
 	{
 		sph.radius += cEpsilon * epsilon_mul;
 	}
+	/**
+*
+* @param ab0
+* @param ab1
+* @return aabb containing both
+*/
+	inline AABB merge_aabb(const AABB &ab0, const AABB &ab1)
+	{
+		return AABB{ glm::min(ab0.min_point, ab1.min_point), glm::max(ab0.max_point, ab1.max_point) };
+	}
+	/**
+*
+* @param ab0
+* @param ab1
+* @return true if they overlap or touch
+*/
+	inline bool overlap_aabb(const AABB &ab0, const AABB &ab1)
+	{
+		return glm::all(glm::lessThanEqual(ab0.min_point, ab1.max_point)) && glm::all(glm::lessThanEqual(ab1.min_point, ab0.max_point));
+	}
+	/**
+*
+* @param x
+* @return
+*/
+	inline int count_leading_zeros(u64 x)
+	{
+#ifdef _MSC_VER
+		unsigned long idx;
+		return _BitScanReverse64(&idx, x) ? 63 - (int)idx : 64;
+#else
+		return x ? __builtin_clzll(x) : 64;
+#endif
+	}
+	/**
+*
+* @brief insert two zeros between the lower 10 bits
+* @param x
+* @return
+*/
+	inline u64 expand_bits_10(u64 x)
+	{
+		x &= 0x3ff;
+		x = (x | x << 16) & 0x30000ff;
+		x = (x | x << 8) & 0x300f00f;
+		x = (x | x << 4) & 0x30c30c3;
+		x = (x | x << 2) & 0x9249249;
+		return x;
+	}
+	/**
+*
+* @brief insert two zeros between the lower 21 bits
+* @param x
+* @return
+*/
+	inline u64 expand_bits_21(u64 x)
+	{
+		x &= 0x1fffff;
+		x = (x | x << 32) & 0x1f00000000ffff;
+		x = (x | x << 16) & 0x1f0000ff0000ff;
+		x = (x | x << 8) & 0x100f00f00f00f00f;
+		x = (x | x << 4) & 0x10c30c30c30c30c3;
+		x = (x | x << 2) & 0x1249249249249249;
+		return x;
+	}
+	/**
+*
+* @param p		point normalized to [0, 1]
+* @param bits	30 or 63
+* @return
+*/
+	inline u64 morton_code(const vec3& p, int bits)
+	{
+		if (bits > 30) {
+			const float scale = (float)((1 << 21) - 1);
+			vec3 q = glm::clamp(p * scale, vec3{ 0.f }, vec3{ scale });
+			return (expand_bits_21((u64)q.x) << 2) | (expand_bits_21((u64)q.y) << 1) | expand_bits_21((u64)q.z);
+		}
+		const float scale = (float)((1 << 10) - 1);
+		vec3 q = glm::clamp(p * scale, vec3{ 0.f }, vec3{ scale });
+		return (expand_bits_10((u64)q.x) << 2) | (expand_bits_10((u64)q.y) << 1) | expand_bits_10((u64)q.z);
+	}
+	/**
+*
+* @brief parallel least significant digit radix sort (8 bits per pass, stable)
+* @param keys
+* @param values	sorted along with the keys
+* @param bits	significant bits of the keys
+* @param keys_tmp, values_tmp, histograms	scratch, only grows
+*/
+	void radix_sort(std::vector<u64>& keys, std::vector<u32>& values, int bits,
+		std::vector<u64>& keys_tmp, std::vector<u32>& values_tmp, std::vector<std::array<u32, 256>>& histograms)
+	{
+		const size_t cMinChunk = 1 << 14;
+		const size_t count = keys.size();
+		const u32 chunks = parallel_chunks(count, cMinChunk);
+		keys_tmp.resize(count);
+		values_tmp.resize(count);
+		histograms.resize(chunks);
+		for (int shift = 0; shift < bits; shift += 8) {
+			// count digits of each chunk
+			parallel_for(count, cMinChunk, [&](size_t begin, size_t end, u32 chunk) {
+				auto& h = histograms[chunk];
+				h.fill(0);
+				for (size_t i = begin; i < end; ++i)
+					h[(keys[i] >> shift) & 0xff]++;
+			});
+			// exclusive prefix sum, chunk order keeps the sort stable
+			u32 offset = 0;
+			for (int digit = 0; digit < 256; ++digit) {
+				for (u32 c = 0; c < chunks; ++c) {
+					u32 n = histograms[c][digit];
+					histograms[c][digit] = offset;
+					offset += n;
+				}
+			}
+			// scatter
+			parallel_for(count, cMinChunk, [&](size_t begin, size_t end, u32 chunk) {
+				auto& h = histograms[chunk];
+				for (size_t i = begin; i < end; ++i) {
+					u32 dst = h[(keys[i] >> shift) & 0xff]++;
+					keys_tmp[dst] = keys[i];
+					values_tmp[dst] = values[i];
+				}
+			});
+			keys.swap(keys_tmp);
+			values.swap(values_tmp);
+		}
+	}
+	/**
+*
+* @param keys
+* @param values
+* @param bits
+*/
+	void radix_sort(std::vector<u64>& keys, std::vector<u32>& values, int bits)
+	{
+		std::vector<u64> keys_tmp;
+		std::vector<u32> values_tmp;
+		std::vector<std::array<u32, 256>> histograms;
+		radix_sort(keys, values, bits, keys_tmp, values_tmp, histograms);
+	}
+	/**
+*
+* @brief sort objects by the morton code of their centroids
+* @param objects
+* @param bits	30 or 63
+* @param codes	sorted codes
+* @param order	object index of every sorted code
+*/
+	void morton_sort(const std::vector<Object*>& objects, int bits, std::vector<u64>& codes, std::vector<u32>& order)
+	{
+		const size_t cMinChunk = 1 << 12;
+		const size_t count = objects.size();
+		// bounds of the centroids
+		std::vector<AABB> chunk_bounds(parallel_chunks(count, cMinChunk), AABB{ vec3{FLT_MAX}, vec3{-FLT_MAX} });
+		parallel_for(count, cMinChunk, [&](size_t begin, size_t end, u32 chunk) {
+			AABB& ab = chunk_bounds[chunk];
+			for (size_t i = begin; i < end; ++i) {
+				vec3 c = objects[i]->get_aabb().center();
+				ab.min_point = glm::min(ab.min_point, c);
+				ab.max_point = glm::max(ab.max_point, c);
+			}
+		});
+		AABB centroids = chunk_bounds[0];
+		for (const AABB& ab : chunk_bounds)
+			centroids = merge_aabb(centroids, ab);
+		// same scale on every axis, flat scenes would split the thin axis too often otherwise
+		const vec3 extent = centroids.max_point - centroids.min_point;
+		const float max_extent = glm::max(extent.x, glm::max(extent.y, extent.z));
+		const float scale = max_extent > 0.f ? 1.f / max_extent : 0.f;
+		// quantize and sort
+		codes.resize(count);
+		order.resize(count);
+		parallel_for(count, cMinChunk, [&](size_t begin, size_t end, u32) {
+			for (size_t i = begin; i < end; ++i) {
+				codes[i] = morton_code((objects[i]->get_aabb().center() - centroids.min_point) * scale, bits);
+				order[i] = (u32)i;
+			}
+		});
+		radix_sort(codes, order, bits);
+	}
+	// ray traversal stack entry, t is where the ray enters the node
+	struct ray_entry { u32 node; float t; };
+	// frustum traversal stack entry, planes the parent is not fully in front of
+	struct frustum_entry { u32 node; u32 planes; };
+	// pair query entry, a node of each tree (a == b in a self query is the pairs inside that subtree)
+	struct pair_entry { u32 a, b; };
+	// traversal stack on the stack, only trees deeper than N spill to the heap
+	template<typename T, u32 N = 64>
+	class traversal_stack {
+	public:
+		traversal_stack() = default;
+		// m_data may point into m_local, a copy would point into the original
+		traversal_stack(const traversal_stack&) = delete;
+		traversal_stack& operator=(const traversal_stack&) = delete;
+		inline bool empty() const { return m_size == 0; }
+		inline void clear() { m_size = 0; }
+		inline T pop() { return m_data[--m_size]; }
+		inline void push(const T& v) {
+			if (m_size == m_capacity)
+				grow();
+			m_data[m_size++] = v;
+		}
+	private:
+		void grow() {
+			if (m_data == m_local.data())
+				m_heap.assign(m_local.begin(), m_local.end());
+			m_capacity *= 2;
+			m_heap.resize(m_capacity);
+			m_data = m_heap.data();
+		}
+		std::array<T, N> m_local;
+		std::vector<T> m_heap;
+		T* m_data = m_local.data();
+		u32 m_size = 0;
+		u32 m_capacity = N;
+	};
 	// Give the user the option to fit th BV perfectly (this makes some tests to fail)
 #define BV_TIGHT 0
 #if BV_TIGHT
@@ -344,227 +562,543 @@ Sphere compute_bv_sphere_pca(const mat4 &transform, const vec3* points, const si
 	return sph;
 }
 
+/**
+*
+* @return first index of the pair
+*/
+u32 bounding_volume_hierarchy::allocate_pair()
+{
+	if (!m_free_pairs.empty()) {
+		u32 first = m_free_pairs.back();
+		m_free_pairs.pop_back();
+		m_nodes[first] = m_nodes[first + 1] = node{};
+		m_info[first] = m_info[first + 1] = node_info{};
+		return first;
+	}
+	u32 first = (u32)m_nodes.size();
+	m_nodes.resize(m_nodes.size() + 2);
+	m_info.resize(m_info.size() + 2);
+	return first;
+}
+/**
+*
+* @param first
+*/
+void bounding_volume_hierarchy::release_pair(u32 first)
+{
+	// leave them as dead intermediate nodes, nobody links them
+	m_nodes[first] = m_nodes[first + 1] = node{};
+	m_info[first] = m_info[first + 1] = node_info{};
+	m_free_pairs.push_back(first);
+}
 /**
 *
 * @param obj
 * @return
 */
-bool bounding_volume_hierarchy::add_object(Object& obj) {
-	// if room empty, create first node
-	if (m_root == nullptr) {
-		m_root = new node;
-		m_root->objects.push_back(&obj);
-		m_root->bounding_volume = obj.get_aabb();
-		return true;
+u32 bounding_volume_hierarchy::allocate_primitive(Object* obj)
+{
+	u32 idx;
+	if (!m_free_primitives.empty()) {
+		idx = m_free_primitives.back();
+		m_free_primitives.pop_back();
+		m_primitives[idx] = obj;
+		m_primitive_aabbs[idx] = obj->get_aabb();
 	}
-	// use stack to traverse the tree the best way
-	std::stack<node*> nodes;
-	nodes.push(m_root);
-
+	else {
+		idx = (u32)m_primitives.size();
+		m_primitives.push_back(obj);
+		m_primitive_aabbs.push_back(obj->get_aabb());
+		m_primitive_leaf.push_back(invalid_index);
+		m_slot_handles.push_back(invalid_index);
+	}
+	u32 handle;
+	if (!m_free_handles.empty()) {
+		handle = m_free_handles.back();
+		m_free_handles.pop_back();
+	}
+	else {
+		handle = (u32)m_handle_slots.size();
+		m_handle_slots.push_back(invalid_index);
+	}
+	m_handle_slots[handle] = idx;
+	m_slot_handles[idx] = handle;
+	obj->set_bvh_proxy(this, handle);
+	return idx;
+}
+/**
+*
+* @param idx
+*/
+void bounding_volume_hierarchy::release_primitive(u32 idx)
+{
+	m_primitives[idx] = nullptr;
+	m_primitive_leaf[idx] = invalid_index;
+	m_free_primitives.push_back(idx);
+	m_handle_slots[m_slot_handles[idx]] = invalid_index;
+	m_free_handles.push_back(m_slot_handles[idx]);
+	m_slot_handles[idx] = invalid_index;
+}
+/**
+*
+*/
+void bounding_volume_hierarchy::reset_handles()
+{
+	const u32 count = (u32)m_primitives.size();
+	m_slot_handles.resize(count);
+	m_handle_slots.resize(count);
+	m_free_handles.clear();
+	for (u32 i = 0; i < count; ++i) {
+		m_slot_handles[i] = m_handle_slots[i] = i;
+		m_primitives[i]->set_bvh_proxy(this, i);
+	}
+}
+/**
+*
+* @param n
+* @param first
+* @param count
+*/
+void bounding_volume_hierarchy::set_leaf(u32 n, u32 first, u32 count)
+{
+	m_nodes[n].first = first;
+	m_nodes[n].count = count;
+	for (u32 i = first; i < first + count; ++i) {
+		m_primitive_leaf[i] = n;
+		m_primitive_aabbs[i] = m_primitives[i]->get_aabb();
+	}
+}
+/**
+*
+* @param n
+*/
+void bounding_volume_hierarchy::rebuild_up(u32 n)
+{
+	while (n != invalid_index) {
+		node& nd = m_nodes[n];
+		nd.bounding_volume = merge_aabb(m_nodes[nd.first].bounding_volume, m_nodes[nd.first + 1].bounding_volume);
+		if (m_build_config.rotations)
+			rotate(n);
+		n = m_info[n].parent;
+	}
+}
+/**
+*
+* @param tmp
+* @param tmp_root
+*/
+void bounding_volume_hierarchy::flatten(const std::vector<build_node>& tmp, u32 tmp_root)
+{
+	assert(m_nodes.empty());
+	// a binary tree with leaf_count leaves always has 2 * leaf_count - 1 nodes
+	m_nodes.reserve(tmp.size());
+	m_info.reserve(tmp.size());
+	m_nodes.emplace_back();
+	m_info.emplace_back();
+	// {temporal node, flat node}
+	std::stack<std::pair<u32, u32>> nodes;
+	nodes.push({ tmp_root, 0 });
 	while (!nodes.empty()) {
-		auto n = nodes.top();
+		auto [t, n] = nodes.top();
 		nodes.pop();
+		const build_node& bn = tmp[t];
+		m_nodes[n].bounding_volume = bn.bounding_volume;
+		if (bn.object) {
+			set_leaf(n, allocate_primitive(bn.object), 1);
+			continue;
+		}
+		u32 c = allocate_pair();
+		m_nodes[n].first = c;
+		m_info[c].parent = m_info[c + 1].parent = n;
+		nodes.push({ bn.children[1], c + 1 });
+		nodes.push({ bn.children[0], c });
+	}
+}
+/**
+*
+*/
+void bounding_volume_hierarchy::destroy()
+{
+	// objects whose handle is still ours are in no tree now (a later build may have taken them)
+	for (u32 slot = 0; slot < (u32)m_primitives.size(); ++slot)
+		if (m_primitives[slot] && find_slot(*m_primitives[slot]) == slot)
+			m_primitives[slot]->set_bvh_proxy(nullptr, invalid_index);
+	m_nodes.clear();
+	m_info.clear();
+	m_primitives.clear();
+	m_primitive_aabbs.clear();
+	m_primitive_leaf.clear();
+	m_free_pairs.clear();
+	m_free_primitives.clear();
+	m_slot_handles.clear();
+	m_handle_slots.clear();
+	m_free_handles.clear();
+	m_build_quality = 0.f;
+}
 
+/**
+*
+* @param obj
+* @return
+*/
+u32 bounding_volume_hierarchy::add_object(Object& obj) {
+	if (find_leaf(obj) != invalid_index)
+		return invalid_index;	// already here
+	// obj is in another tree, an object is in one at most (remove it from the other first)
+	assert(obj.get_bvh_owner() == nullptr);
+	// if room empty, create first node
+	if (m_nodes.empty()) {
+		m_nodes.emplace_back();
+		m_info.emplace_back();
+		m_nodes[0].bounding_volume = leaf_aabb(obj);
+		set_leaf(0, allocate_primitive(&obj), 1);
+		return obj.get_bvh_proxy();
+	}
+	const AABB bv_obj = leaf_aabb(obj);
+	const u32 n = find_sibling(bv_obj);
+	// create new nodes (may reallocate, do not keep references)
+	u32 c = allocate_pair();
+	//move the sibling down
+	m_nodes[c] = m_nodes[n];
+	if (m_nodes[c].is_leaf())
+		set_leaf(c, m_nodes[c].first, m_nodes[c].count);
+	else
+		m_info[m_nodes[c].first].parent = m_info[m_nodes[c].first + 1].parent = c;
+	m_nodes[c + 1].bounding_volume = bv_obj;
+	set_leaf(c + 1, allocate_primitive(&obj), 1);
+	//link
+	m_info[c].parent = m_info[c + 1].parent = n;
+	m_nodes[n].first = c;
+	m_nodes[n].count = 0;
+	// compute new aabb and dont forget to rebuild up!
+	rebuild_up(n);
+	return obj.get_bvh_proxy();
+}
+/**
+*
+* @param bv
+* @return
+*/
+u32 bounding_volume_hierarchy::find_sibling(const AABB& bv)
+{
+	if (m_build_config.insertion == bvh_insertion_greedy) {
+		u32 n = 0;
 		// find best node by delta surface
-		// if leaf node, found it
-		bool is_leaf = n->children[0] == nullptr && n->children[1] == nullptr;
-		if (is_leaf) {
-			//check that not already here
-			assert(n->objects.size() == 1);
-			if (n->objects[0] == &obj)
-				return false;
-			// create new nodes
-			node* new_child0 = new node;
-			node* new_child1 = new node;
-			//link
-			new_child0->parent = new_child1->parent = n;
-			n->children = { new_child0, new_child1 };
-			//move objects
-			new_child0->objects = std::move(n->objects);
-			new_child1->objects.push_back(&obj);
-			// set aabb
-			const AABB &bv_node = new_child0->bounding_volume = n->bounding_volume;
-			const AABB &bv_obj = new_child1->bounding_volume = obj.get_aabb();
-			// compute new aabb
-			n->bounding_volume = AABB{ glm::min(bv_obj.min_point, bv_node.min_point), glm::max(bv_obj.max_point, bv_node.max_point) };
-
-			// also dont forget to rebuild up!
-			node* grandparent = n->parent;
-			while (grandparent) {
-				const AABB &bv0 = grandparent->children[0]->bounding_volume;
-				const AABB &bv1 = grandparent->children[1]->bounding_volume;
-				grandparent->bounding_volume = AABB{ glm::min(bv0.min_point, bv1.min_point), glm::max(bv0.max_point, bv1.max_point) };
-
-				grandparent = grandparent->parent;
-			}
-			return true;
-		}
-		else   // keep iterating... but choose best surface!
-		//if (n->children[0] != nullptr) 
-		{
-			assert(n->children[0]);	// must have children
-			assert(n->children[1]);	// must have sibling
-			const AABB &bv_obj = obj.get_aabb();
-			const AABB &bv0 = n->children[0]->bounding_volume;
-			const AABB &bv1 = n->children[1]->bounding_volume;
+		while (!m_nodes[n].is_leaf()) {
+			// keep iterating... but choose best surface!
+			const node& nd = m_nodes[n];
+			const AABB &bv0 = m_nodes[nd.first].bounding_volume;
+			const AABB &bv1 = m_nodes[nd.first + 1].bounding_volume;
 			// compare addition of aabb bounding volumes
-			AABB bv_obj0 = AABB{ glm::min(bv0.min_point, bv_obj.min_point), glm::max(bv0.max_point, bv_obj.max_point) };
-			AABB bv_obj1 = AABB{ glm::min(bv_obj.min_point, bv1.min_point), glm::max(bv_obj.max_point, bv1.max_point) };
-			// delta surface
-			float dSurface = bv_obj0.surface_area() - bv_obj1.surface_area();
-			if (dSurface < 0.f) {
-				// child 1 is bigger, go to child 0
-				nodes.push(n->children[0]);
-			}
-			else {
-				// child 0 is bigger
-				nodes.push(n->children[1]);
+			float dSurface = merge_aabb(bv0, bv).surface_area() - merge_aabb(bv, bv1).surface_area();
+			// if child 1 is bigger, go to child 0
+			n = dSurface < 0.f ? nd.first : nd.first + 1;
+		}
+		return n;
+	}
+	/*
+		cost(sibling) = area(merge(sibling, bv)) + growth of all the ancestors (inherited)
+		children of n can not cost less than area(bv) + inherited(n) + growth(n)
+	*/
+	const float area = bv.surface_area();
+	auto cheapest_first = [](const std::pair<float, u32>& a, const std::pair<float, u32>& b) { return a.first > b.first; };
+	u32 best = 0;
+	float best_cost = merge_aabb(m_nodes[0].bounding_volume, bv).surface_area();
+	m_insert_heap.clear();
+	m_insert_heap.push_back({ 0.f, 0 });
+	while (!m_insert_heap.empty()) {
+		std::pop_heap(m_insert_heap.begin(), m_insert_heap.end(), cheapest_first);
+		auto [inherited, n] = m_insert_heap.back();
+		m_insert_heap.pop_back();
+		if (inherited + area >= best_cost)
+			break;	// the rest of the heap is not cheaper
+		const node& nd = m_nodes[n];
+		const float direct = merge_aabb(nd.bounding_volume, bv).surface_area();
+		if (direct + inherited < best_cost) {
+			best_cost = direct + inherited;
+			best = n;
+		}
+		if (nd.is_leaf())
+			continue;
+		const float child_inherited = inherited + direct - nd.bounding_volume.surface_area();
+		if (child_inherited + area < best_cost) {
+			for (u32 c : { nd.first, nd.first + 1 }) {
+				m_insert_heap.push_back({ child_inherited, c });
+				std::push_heap(m_insert_heap.begin(), m_insert_heap.end(), cheapest_first);
 			}
 		}
-
 	}
-	return false;
+	return best;
 }
 
 /**
 *
 * @param obj
-* @param current
 * @return
 */
-bool bounding_volume_hierarchy::remove_object(const Object& obj, node* current) {
-
-	// base case: return if node null
-	if (current == nullptr)
-		return false;
-
-	assert(current != nullptr);
-	auto & objs = current->objects;
-
-	std::pair<node*, node*> best_order = select_branch_by_position(obj, *current);
-	// leaf check
-	bool is_leaf = best_order.first == nullptr && best_order.second == nullptr;
-	if (!is_leaf) {
-		assert(objs.empty());	// intermediate always empty
-		return remove_object(obj, best_order.first) || remove_object(obj, best_order.second);
-	}
-	assert(objs.size() <= 1);	// one object per node
-	// object may be here...
-	auto it = std::find(objs.begin(), objs.end(), &obj);
-	if (it == objs.end())
+u32 bounding_volume_hierarchy::find_slot(const Object& obj) const
+{
+	if (obj.get_bvh_owner() != this)
+		return invalid_index;
+	const u32 proxy = obj.get_bvh_proxy();
+	assert(proxy < m_handle_slots.size());
+	const u32 slot = m_handle_slots[proxy];
+	if (slot == invalid_index || m_primitives[slot] != &obj)
+		return invalid_index;
+	return slot;
+}
+/**
+*
+* @param obj
+* @return
+*/
+u32 bounding_volume_hierarchy::find_leaf(const Object& obj) const
+{
+	const u32 slot = find_slot(obj);
+	return slot == invalid_index ? invalid_index : m_primitive_leaf[slot];
+}
+/**
+*
+* @param obj
+* @return
+*/
+bool bounding_volume_hierarchy::remove_object(Object& obj)
+{
+	const u32 slot = find_slot(obj);
+	if (slot == invalid_index)
 		return false;	// not here
+	remove_primitive(slot);
+	obj.set_bvh_proxy(nullptr, invalid_index);
+	return true;
+}
+/**
+*
+* @param obj
+* @return
+*/
+bool bounding_volume_hierarchy::update_object(Object& obj)
+{
+	u32 leaf = find_leaf(obj);
+	if (leaf == invalid_index)
+		return false;
+	refit_node(leaf);
+	rebuild_up(m_info[leaf].parent);
+	return true;
+}
+/**
+*
+* @param leaf
+*/
+void bounding_volume_hierarchy::remove_leaf(u32 leaf)
+{
+	assert(m_nodes[leaf].count == 1);	// one object per node
+	release_primitive(m_nodes[leaf].first);
 
-	std::swap(*it, objs[objs.size() - 1]);
-	objs.pop_back();
-
-	// get grandparent; if dont, pass last single object to root node, its parent
-	if (current == m_root) {
-		assert(current->parent == nullptr);
-		delete m_root;
-		m_root = nullptr;
-		return true;
+	// if no parent, the tree is empty now
+	if (leaf == 0) {
+		assert(m_info[0].parent == invalid_index);
+		destroy();
+		return;
 	}
-	node* parent = current->parent;
+	u32 parent = m_info[leaf].parent;
+	u32 pair = m_nodes[parent].first;
 	// get sibling before updating grandpa
-	node* sibling = parent->children[0] == current ? parent->children[1] : parent->children[0];
+	u32 sibling = pair == leaf ? pair + 1 : pair;
 	// copy sibling to parent (no need to know grandpa)
-	parent->bounding_volume = sibling->bounding_volume;
-	parent->objects = std::move(sibling->objects);
+	m_nodes[parent] = m_nodes[sibling];
 	// relink children with parent (if any)
-	if (sibling->children[0]) {
-		sibling->children[0]->parent = sibling->children[1]->parent = parent;
-	}
-	parent->children = std::move(sibling->children);	// copy since sibling might be intermediate node
-	sibling->children = { nullptr, nullptr };			// make sure not deleting their subtree
+	if (!m_nodes[parent].is_leaf())
+		m_info[m_nodes[parent].first].parent = m_info[m_nodes[parent].first + 1].parent = parent;
+	else
+		set_leaf(parent, m_nodes[parent].first, m_nodes[parent].count);
 	// delete nodes
-	delete current;
-	delete sibling;
+	release_pair(pair);
 	// also dont forget to rebuild up!
-	parent = parent->parent;
-	while (parent) {
-		const AABB &bv0 = parent->children[0]->bounding_volume;
-		const AABB &bv1 = parent->children[1]->bounding_volume;
-		parent->bounding_volume = AABB{ glm::min(bv0.min_point, bv1.min_point), glm::max(bv0.max_point, bv1.max_point) };
-
-		parent = parent->parent;
+	rebuild_up(m_info[parent].parent);
+}
+/**
+*
+* @param slot
+*/
+void bounding_volume_hierarchy::remove_primitive(u32 slot)
+{
+	const u32 leaf = m_primitive_leaf[slot];
+	node& nd = m_nodes[leaf];
+	if (nd.count == 1) {
+		remove_leaf(leaf);
+		return;
 	}
-
-	// done
+	// keep the range contiguous, the handles swap slots so the moved object keeps its handle
+	const u32 last = nd.first + nd.count - 1;
+	if (slot != last) {
+		m_primitives[slot] = m_primitives[last];
+		m_primitive_aabbs[slot] = m_primitive_aabbs[last];
+		m_primitive_leaf[slot] = leaf;
+		std::swap(m_slot_handles[slot], m_slot_handles[last]);
+		m_handle_slots[m_slot_handles[slot]] = slot;
+	}
+	release_primitive(last);
+	nd.count--;
+	refit_node(leaf);
+	rebuild_up(m_info[leaf].parent);
+}
+/**
+*
+*/
+void bounding_volume_hierarchy::collapse_leaves()
+{
+	if (m_build_config.max_leaf_size <= 1 || m_nodes.empty())
+		return;
+	const u32 max_leaf_size = (u32)m_build_config.max_leaf_size;
+	// builders keep the objects of every subtree contiguous
+	std::vector<u32> counts(m_nodes.size()), firsts(m_nodes.size());
+	std::vector<float> costs(m_nodes.size());
+	std::vector<bool> collapse(m_nodes.size(), false);
+	m_refit_order.clear();
+	m_refit_order.push_back(0);
+	for (size_t i = 0; i < m_refit_order.size(); ++i) {
+		const node& nd = m_nodes[m_refit_order[i]];
+		if (nd.is_leaf())
+			continue;
+		m_refit_order.push_back(nd.first);
+		m_refit_order.push_back(nd.first + 1);
+	}
+	// bottom-up cheapest cost of every subtree
+	for (auto it = m_refit_order.rbegin(); it != m_refit_order.rend(); ++it) {
+		const u32 n = *it;
+		const node& nd = m_nodes[n];
+		const float area = nd.bounding_volume.surface_area();
+		if (nd.is_leaf()) {
+			counts[n] = nd.count;
+			firsts[n] = nd.first;
+			costs[n] = area * nd.count * m_build_config.intersection_cost;
+			continue;
+		}
+		const u32 l = nd.first, r = nd.first + 1;
+		assert(firsts[l] + counts[l] == firsts[r] || firsts[r] + counts[r] == firsts[l]);
+		counts[n] = counts[l] + counts[r];
+		firsts[n] = glm::min(firsts[l], firsts[r]);
+		const float split_cost = area * m_build_config.traversal_cost + costs[l] + costs[r];
+		const float leaf_cost = area * counts[n] * m_build_config.intersection_cost;
+		collapse[n] = counts[n] <= max_leaf_size && leaf_cost <= split_cost;
+		costs[n] = collapse[n] ? leaf_cost : split_cost;
+	}
+	// copy depth-first, stop at the first collapsed node
+	std::vector<node> nodes;
+	std::vector<node_info> info;
+	nodes.reserve(m_refit_order.size());
+	info.reserve(m_refit_order.size());
+	nodes.emplace_back();
+	info.emplace_back();
+	std::stack<std::pair<u32, u32>> stack;	// {old node, new node}
+	stack.push({ 0, 0 });
+	while (!stack.empty()) {
+		auto [o, n] = stack.top();
+		stack.pop();
+		const node& nd = m_nodes[o];
+		nodes[n].bounding_volume = nd.bounding_volume;
+		if (nd.is_leaf() || collapse[o]) {
+			nodes[n].first = firsts[o];
+			nodes[n].count = counts[o];
+			continue;
+		}
+		u32 c = (u32)nodes.size();
+		nodes.resize(nodes.size() + 2);
+		info.resize(info.size() + 2);
+		nodes[n].first = c;
+		info[c].parent = info[c + 1].parent = n;
+		stack.push({ nd.first + 1, c + 1 });
+		stack.push({ nd.first, c });
+	}
+	m_nodes.swap(nodes);
+	m_info.swap(info);
+	m_free_pairs.clear();
+	for (u32 n = 0; n < (u32)m_nodes.size(); ++n)
+		if (m_nodes[n].is_leaf())
+			set_leaf(n, m_nodes[n].first, m_nodes[n].count);
+}
+/**
+*
+* @param obj
+* @return
+*/
+bool bounding_volume_hierarchy::move_object(Object& obj)
+{
+	const u32 slot = find_slot(obj);
+	if (slot == invalid_index)
+		return false;
+	m_counters.moves++;
+	const AABB& fat = m_nodes[m_primitive_leaf[slot]].bounding_volume;
+	const AABB& ab = obj.get_aabb();
+	if (glm::all(glm::lessThanEqual(fat.min_point, ab.min_point)) && glm::all(glm::greaterThanEqual(fat.max_point, ab.max_point))) {
+		m_primitive_aabbs[slot] = ab;
+		return false;
+	}
+	m_counters.reinsertions++;
+	remove_primitive(slot);
+	obj.set_bvh_proxy(nullptr, invalid_index);
+	add_object(obj);
 	return true;
 }
 /**
 *
 * @param obj
-* @param current
 * @return
 */
-std::pair<BVH::node*, BVH::node*> bounding_volume_hierarchy::select_branch_by_position(const Object& obj, const node& current )
-{
-	// if some child null, return null (but be sure the other is null too)
-	if (current.children[0] == nullptr) {
-		assert(current.children[1] == nullptr);	// sibling null too
-		return {nullptr, nullptr};
-	}
-
-	// select branch node with aabb closest to obj
-	const AABB& obj_bv = obj.get_aabb();
-	vec3 obj_center = obj_bv.center();
-	intersection_type result = intersection_point_aabb(obj_center, current.children[0]->bounding_volume);
-	// if inside, good candidate
-	if (result == intersection_type::INSIDE) {
-		return { current.children[0], current.children[1] };
-	}
-	result = intersection_point_aabb(obj_center, current.children[0]->bounding_volume);
-	// if inside, good candidate
-	if (result == intersection_type::INSIDE) {
-		return { current.children[1], current.children[0] };
-	}
-#if 0	// select method of choice
-	// select closest center
-	vec3 center0 = current.children[0]->bounding_volume.center();
-	vec3 center1 = current.children[1]->bounding_volume.center();
-	if (glm::distance2(obj_center, center0) < glm::distance2(obj_center, center1)) 
-		return { current.children[0], current.children[1] };
-	else
-		return {current.children[1], current.children[0]};
-#else
-	// select lesser surface area
-	AABB ab0 = AABB{ glm::min(obj_bv.min_point, current.children[0]->bounding_volume.min_point),
-					 glm::max(obj_bv.max_point, current.children[0]->bounding_volume.max_point) };
-	AABB ab1 = AABB{ glm::min(obj_bv.min_point, current.children[1]->bounding_volume.min_point),
-					 glm::max(obj_bv.max_point, current.children[1]->bounding_volume.max_point) };
-	if(ab0.surface_area() < ab1.surface_area())
-		return { current.children[0], current.children[1] };
-		return { current.children[1], current.children[0] };
-#endif
-#if 0
-	assert(0 && "Could happen?");	// NO
-	return {};
-#endif
+AABB bounding_volume_hierarchy::leaf_aabb(const Object& obj) const
+{
+	AABB ab = obj.get_aabb();
+	if (!m_build_config.fat_leaves)
+		return ab;
+	ab.min_point -= vec3{ m_build_config.fat_margin };
+	ab.max_point += vec3{ m_build_config.fat_margin };
+	// predict the motion, only on the moving direction
+	const vec3 displacement = obj.get_vel() * m_build_config.fat_prediction;
+	ab.min_point += glm::min(displacement, vec3{ 0.f });
+	ab.max_point += glm::max(displacement, vec3{ 0.f });
+	return ab;
 }
 /**
 *
 * @param objects
+* @param count
 * @return
 */
-AABB compute_aabb(const std::vector<Object*>& objects) {
-	//assert(objects.size() > 1);	// allow single object
+AABB compute_aabb(Object* const* objects, size_t count) {
+	//assert(count > 1);	// allow single object
 	AABB result = objects[0]->get_aabb();
-	for (int i = 1; i < objects.size(); ++i) {
-		const AABB& ab = objects[i]->get_aabb();
-		result.min_point = glm::min(result.min_point, ab.min_point);
-		result.max_point = glm::max(result.max_point, ab.max_point);
-	}
+	for (size_t i = 1; i < count; ++i)
+		result = merge_aabb(result, objects[i]->get_aabb());
 	return result;
 }
 /**
 *
+* @brief compute_aabb splitting big ranges among the workers
 * @param objects
-* @param bv_all
+* @param count
 * @return
 */
-std::pair<std::vector<Object*>, std::vector<Object*>> partition(const std::vector<Object*> & objects, const AABB& bv_all){
-	assert(objects.size() > 1);	// must!
+AABB compute_aabb_parallel(Object* const* objects, size_t count) {
+	const size_t cMinChunk = 1 << 14;
+	std::vector<AABB> chunk_bounds(parallel_chunks(count, cMinChunk));
+	parallel_for(count, cMinChunk, [&](size_t begin, size_t end, u32 chunk) {
+		chunk_bounds[chunk] = compute_aabb(objects + begin, end - begin);
+	});
+	AABB result = chunk_bounds[0];
+	for (const AABB& ab : chunk_bounds)
+		result = merge_aabb(result, ab);
+	return result;
+}
+/**
+*
+* @brief partition objects in place
+* @param first
+* @param last
+* @param bv_all
+* @return first object of the second half
+*/
+Object** partition(Object** first, Object** last, const AABB& bv_all){
+	assert(last - first > 1);	// must!
 
 	// get biggest axis for partition plane
 	vec3 dir = bv_all.max_point - bv_all.min_point;
@@ -581,42 +1115,103 @@ std::pair<std::vector<Object*>, std::vector<Object*>> partition(const std::vecto
 	// create plane
 	Plane pl(normal, bv_all.center());
 	// assign each object {INSIDE first, OUTSIDE second}
-	std::pair<std::vector<Object*>, std::vector<Object*>> result;
-	for (int i = (int)objects.size() - 1; i >= 0; --i) {
-		Object* o = objects[i];
-		// get bv center
-		const AABB ab = o->get_aabb();
-		vec3 pos = ab.center();
-		// select side
-		intersection_type intersection_result = intersection_point_plane(pos, pl);
-		if (intersection_result == INSIDE) {
-			result.first.push_back(o);
-		}
-		else
-			result.second.push_back(o);
-	}
+	Object** mid = std::partition(first, last, [&pl](Object* o) {
+		// select side by bv center
+		return intersection_point_plane(o->get_aabb().center(), pl) == INSIDE;
+	});
 	// balance if one side without objects
-	if (result.first.empty()) {
-		// randomly?
-		result.first.push_back(result.second.back());
-		result.second.pop_back();
+	if (mid == first)
+		++mid;
+	else if (mid == last)
+		--mid;
+
+	return mid;
+}
+/**
+*
+* @brief partition objects in place by the cheapest binned sah plane
+* @param first
+* @param last
+* @param bv_all
+* @param config
+* @return first object of the second half
+*/
+Object** partition_sah(Object** first, Object** last, const AABB& bv_all, const bvh_build_config& config) {
+	assert(last - first > 1);	// must!
+	const int cMaxBins = 64;
+	struct bin {
+		AABB bounding_volume{ vec3{FLT_MAX}, vec3{-FLT_MAX} };
+		int count = 0;
+	};
+	const int bin_count = glm::clamp(config.bin_count, 2, cMaxBins);
+
+	// bin by centroid, so bounds of the centroids
+	AABB centroids{ vec3{FLT_MAX}, vec3{-FLT_MAX} };
+	for (Object** o = first; o != last; ++o) {
+		vec3 c = (*o)->get_aabb().center();
+		centroids.min_point = glm::min(centroids.min_point, c);
+		centroids.max_point = glm::max(centroids.max_point, c);
 	}
-	else if (result.second.empty()) {
-		result.second.push_back(result.first.back());
-		result.first.pop_back();
+	const vec3 extent = centroids.max_point - centroids.min_point;
+
+	float best_cost = FLT_MAX;
+	int best_axis = -1, best_split = 0;
+	for (int axis = 0; axis < 3; ++axis) {
+		if (extent[axis] <= 0.f)
+			continue;	// all centroids on the same plane
+		const float to_bin = bin_count / extent[axis];
+		std::array<bin, cMaxBins> bins;
+		for (Object** o = first; o != last; ++o) {
+			const AABB& ab = (*o)->get_aabb();
+			int b = glm::min(bin_count - 1, (int)((ab.center()[axis] - centroids.min_point[axis]) * to_bin));
+			bins[b].bounding_volume = merge_aabb(bins[b].bounding_volume, ab);
+			bins[b].count++;
+		}
+		// sweep from the right to get the cost of the right side of each plane
+		// (plane i splits bins [0, i) and [i, bin_count))
+		std::array<float, cMaxBins> right_cost;
+		bin right;
+		for (int i = bin_count - 1; i > 0; --i) {
+			right.bounding_volume = merge_aabb(right.bounding_volume, bins[i].bounding_volume);
+			right.count += bins[i].count;
+			right_cost[i] = right.count ? right.bounding_volume.surface_area() * right.count : -1.f;
+		}
+		// sweep from the left
+		AABB left = bins[0].bounding_volume;
+		int left_count = 0;
+		for (int i = 1; i < bin_count; ++i) {
+			left = merge_aabb(left, bins[i - 1].bounding_volume);
+			left_count += bins[i - 1].count;
+			if (left_count == 0 || right_cost[i] < 0.f)
+				continue;	// no empty sides
+			float cost = left.surface_area() * left_count + right_cost[i];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_split = i;
+			}
+		}
 	}
+	// every centroid in the same point, just split by count
+	if (best_axis == -1)
+		return first + (last - first) / 2;
 
-	return result;
+	const float to_bin = bin_count / extent[best_axis];
+	return std::partition(first, last, [&](Object* o) {
+		int b = glm::min(bin_count - 1, (int)((o->get_aabb().center()[best_axis] - centroids.min_point[best_axis]) * to_bin));
+		return b < best_split;
+	});
 }
 /**
 *
-* @param objects
 * @param n
-* @return
+* @param begin
+* @param end
+* @param c		index for the children pair of n
+* @param tasks	spawn subtrees here (null builds serially)
 */
-bounding_volume_hierarchy::node* bounding_volume_hierarchy::build_top_down(std::vector <Object*>& objects, node* n)
+void bounding_volume_hierarchy::build_top_down(u32 n, u32 begin, u32 end, u32 c, task_group* tasks)
 {
-	recursion_counter++;
 	/*
 		// compute bounding volume for all
 		bv_all = compute_bv(objects);
@@ -632,34 +1227,35 @@ bounding_volume_hierarchy::node* bounding_volume_hierarchy::build_top_down(std::
 			bvh_topdown(right, node)
 
 	*/
-	// exit if no objects
-	if (objects.empty())
-		return nullptr;
-	assert(!objects.empty());
-	assert(n != nullptr);	// parent node must be valid
+	assert(end > begin);
+	Object** objects = m_primitives.data();
 	// compute common aabb
-	node* new_node = new node;
-	new_node->bounding_volume = compute_aabb(objects);
+	m_nodes[n].bounding_volume = tasks && end - begin >= 4 * (u32)m_build_config.parallel_threshold
+		? compute_aabb_parallel(objects + begin, end - begin)
+		: compute_aabb(objects + begin, end - begin);
 	// check if we are finished
-	if (objects.size() == 1) {
-		new_node->objects = objects;
-		return new_node;
+	if (end - begin == 1) {
+		set_leaf(n, begin, 1);
+		return;
 	}
 	//assign sides
-	auto part = partition(objects, new_node->bounding_volume);
-	// clear memory from old objects 
-	//objects.clear();
-	//objects.shrink_to_fit();
-	// recursion
-	node* child0 = build_top_down(part.first, new_node);
-	node* child1 = build_top_down(part.second, new_node);
+	Object** split = m_build_config.split == bvh_split_sah
+		? partition_sah(objects + begin, objects + end, m_nodes[n].bounding_volume, m_build_config)
+		: partition(objects + begin, objects + end, m_nodes[n].bounding_volume);
+	u32 mid = (u32)(split - objects);
 	// link children
-	assert(child0 && child1);	// should?
-	new_node->children[0] = child0;
-	new_node->children[1] = child1;
-	child0->parent = child1->parent = new_node;
-	// return new_node to allow link
-	return new_node;
+	m_nodes[n].first = c;
+	m_info[c].parent = m_info[c + 1].parent = n;
+	// recursion, a subtree of k leaves uses 2k - 1 nodes so indices do not depend on the build order
+	const u32 left_count = mid - begin;
+	if (tasks && end - begin >= (u32)m_build_config.parallel_threshold) {
+		tasks->spawn([=]() { build_top_down(c, begin, mid, c + 2, tasks); });
+		build_top_down(c + 1, mid, end, c + 2 * left_count, tasks);
+	}
+	else {
+		build_top_down(c, begin, mid, c + 2, nullptr);
+		build_top_down(c + 1, mid, end, c + 2 * left_count, nullptr);
+	}
 }
 /**
 *
@@ -670,52 +1266,784 @@ void bounding_volume_hierarchy::build_top_down(const std::vector  <Object* >& ob
 	// exit if no objects
 	if (objects.empty())
 		return;
-	assert(m_root == nullptr);	// tree should be cleared
-	m_root = new node;
-	// compute common aabb
-	m_root->bounding_volume = compute_aabb(objects);
-	// check if we are finished
-	if (objects.size() == 1) {
-		m_root->objects = objects;
+	assert(m_nodes.empty());	// tree should be cleared
+	m_primitives = objects;
+	m_primitive_aabbs.resize(objects.size());
+	m_primitive_leaf.resize(objects.size());
+	m_nodes.resize(2 * objects.size() - 1);
+	m_info.resize(2 * objects.size() - 1);
+	if (m_build_config.parallel_threshold > 0 && worker_count() > 1) {
+		task_group tasks;
+		build_top_down(0, 0, (u32)objects.size(), 1, &tasks);
+		tasks.wait();
+	}
+	else
+		build_top_down(0, 0, (u32)objects.size(), 1, nullptr);
+	finish_build();
+}
+/**
+*
+* @brief for trees that got too bad after refits, handles are reset as in any build
+*/
+void bounding_volume_hierarchy::rebuild()
+{
+	std::vector<Object*> objects;
+	objects.reserve(m_primitives.size());
+	for (Object* obj : m_primitives)
+		if (obj)
+			objects.push_back(obj);
+	destroy();
+	build_top_down(objects);
+}
+/**
+*
+* @return sum of node costs weighted by the probability of being hit (area relative to the root)
+*/
+float bounding_volume_hierarchy::sah_cost() const
+{
+	if (m_nodes.empty())
+		return 0.f;
+	float cost = 0.f;
+	traverse_preorder([&](const node& n) {
+		float area = n.bounding_volume.surface_area();
+		if (n.is_leaf())
+			cost += area * n.count * m_build_config.intersection_cost;
+		else
+			cost += area * m_build_config.traversal_cost;
+	});
+	float root_area = m_nodes[0].bounding_volume.surface_area();
+	return root_area > 0.f ? cost / root_area : cost;
+}
+/**
+*
+* @return
+*/
+float bounding_volume_hierarchy::area_ratio() const
+{
+	float intermediate_area = 0.f, leaf_area = 0.f;
+	traverse_preorder([&](const node& n) {
+		if (n.is_leaf())
+			leaf_area += n.bounding_volume.surface_area();
+		else
+			intermediate_area += n.bounding_volume.surface_area();
+	});
+	return leaf_area > 0.f ? intermediate_area / leaf_area : 0.f;
+}
+/**
+*
+* @return
+*/
+float bounding_volume_hierarchy::quality_ratio() const
+{
+	if (m_build_quality <= 0.f)
+		return 1.f;
+	return area_ratio() / m_build_quality;
+}
+/**
+*
+* @brief builders fit the leaves to the objects, dynamic mode enlarges them here (without rotations,
+*	the built topology is kept) so the first moves after a build do not all reinsert
+*/
+void bounding_volume_hierarchy::finish_build()
+{
+	collapse_leaves();
+	if (!m_nodes.empty())
+		reset_handles();
+	if (m_build_config.fat_leaves && !m_nodes.empty()) {
+		m_refit_order.clear();
+		m_refit_order.push_back(0);
+		for (size_t i = 0; i < m_refit_order.size(); ++i) {
+			const node& nd = m_nodes[m_refit_order[i]];
+			if (nd.is_leaf())
+				continue;
+			m_refit_order.push_back(nd.first);
+			m_refit_order.push_back(nd.first + 1);
+		}
+		for (auto it = m_refit_order.rbegin(); it != m_refit_order.rend(); ++it)
+			refit_node(*it);
+	}
+	m_build_quality = area_ratio();
+}
+/**
+*
+* @param n
+*/
+void bounding_volume_hierarchy::refit_node(u32 n)
+{
+	node& nd = m_nodes[n];
+	if (nd.is_leaf()) {
+		nd.bounding_volume = leaf_aabb(*m_primitives[nd.first]);
+		for (u32 i = 1; i < nd.count; ++i)
+			nd.bounding_volume = merge_aabb(nd.bounding_volume, leaf_aabb(*m_primitives[nd.first + i]));
+		for (u32 i = nd.first; i < nd.first + nd.count; ++i)
+			m_primitive_aabbs[i] = m_primitives[i]->get_aabb();
+	}
+	else
+		nd.bounding_volume = merge_aabb(m_nodes[nd.first].bounding_volume, m_nodes[nd.first + 1].bounding_volume);
+}
+/**
+*
+*/
+void bounding_volume_hierarchy::refit_flagged()
+{
+	if (m_nodes.empty() || !m_info[0].refit)
 		return;
+	// preorder of the flagged nodes, reversed children go before parents
+	m_refit_order.clear();
+	m_refit_order.push_back(0);
+	for (size_t i = 0; i < m_refit_order.size(); ++i) {
+		const node& nd = m_nodes[m_refit_order[i]];
+		if (nd.is_leaf())
+			continue;
+		if (m_info[nd.first].refit)
+			m_refit_order.push_back(nd.first);
+		if (m_info[nd.first + 1].refit)
+			m_refit_order.push_back(nd.first + 1);
 	}
-	//assign sides
-	auto part = partition(objects, m_root->bounding_volume);
-	// recursion
-	node* child0 = build_top_down(part.first, m_root);
-	node* child1 = build_top_down(part.second, m_root);
-	// link children
-	assert(child0 && child1);	// should?
-	m_root->children[0] = child0;
-	m_root->children[1] = child1;
-	child0->parent = child1->parent = m_root;
+	for (auto it = m_refit_order.rbegin(); it != m_refit_order.rend(); ++it) {
+		refit_node(*it);
+		m_info[*it].refit = false;
+		if (m_build_config.rotations && !m_nodes[*it].is_leaf())
+			rotate(*it);
+	}
+}
+/**
+*
+*/
+void bounding_volume_hierarchy::refit()
+{
+	if (m_nodes.empty())
+		return;
+	// every node reachable from the root (released pairs are not)
+	m_refit_order.clear();
+	m_refit_order.push_back(0);
+	for (size_t i = 0; i < m_refit_order.size(); ++i) {
+		const node& nd = m_nodes[m_refit_order[i]];
+		if (nd.is_leaf())
+			continue;
+		m_refit_order.push_back(nd.first);
+		m_refit_order.push_back(nd.first + 1);
+	}
+	for (auto it = m_refit_order.rbegin(); it != m_refit_order.rend(); ++it) {
+		refit_node(*it);
+		if (m_build_config.rotations && !m_nodes[*it].is_leaf())
+			rotate(*it);
+	}
+}
+/**
+*
+* @param a
+* @param b
+*/
+void bounding_volume_hierarchy::swap_nodes(u32 a, u32 b)
+{
+	std::swap(m_nodes[a], m_nodes[b]);
+	std::swap(m_info[a].draw_bv, m_info[b].draw_bv);
+	// parents stay, relink what is below
+	for (u32 n : { a, b }) {
+		const node& nd = m_nodes[n];
+		if (nd.is_leaf())
+			set_leaf(n, nd.first, nd.count);
+		else
+			m_info[nd.first].parent = m_info[nd.first + 1].parent = n;
+	}
+}
+/**
+*
+* @brief Kensler rotations, the bounding volume of n does not change
+* @param n
+* @return
+*/
+bool bounding_volume_hierarchy::rotate(u32 n)
+{
+	if (m_nodes[n].is_leaf())
+		return false;
+	float best_gain = 0.f;
+	u32 child = invalid_index, grandchild = invalid_index, refit = invalid_index;
+	// swap child with a child of other
+	auto try_rotation = [&](u32 c, u32 other) {
+		const node& o = m_nodes[other];
+		if (o.is_leaf())
+			return;
+		const float area = o.bounding_volume.surface_area();
+		for (u32 k = 0; k < 2; ++k) {
+			// the sibling of the grandchild stays with c
+			const AABB& sibling = m_nodes[o.first + 1 - k].bounding_volume;
+			float gain = area - merge_aabb(m_nodes[c].bounding_volume, sibling).surface_area();
+			if (gain > best_gain) {
+				best_gain = gain;
+				child = c;
+				grandchild = o.first + k;
+				refit = other;
+			}
+		}
+	};
+	const u32 first = m_nodes[n].first;
+	try_rotation(first, first + 1);
+	try_rotation(first + 1, first);
+	if (child == invalid_index)
+		return false;
+	swap_nodes(child, grandchild);
+	refit_node(refit);
+	return true;
+}
+/**
+*
+* @param node_budget		nodes to look at
+* @param time_budget_ms
+* @return
+*/
+u32 bounding_volume_hierarchy::optimize(u32 node_budget, double time_budget_ms)
+{
+	using clock = std::chrono::steady_clock;
+	if (m_nodes.empty())
+		return 0;
+	const auto start = clock::now();
+	u32 rotations = 0;
+	for (u32 visited = 0; visited < node_budget; ++visited) {
+		if (m_optimize_cursor >= m_nodes.size())
+			m_optimize_cursor = 0;
+		const u32 n = m_optimize_cursor++;
+		// released pairs have no parent
+		const bool linked = n == 0 || m_info[n].parent != invalid_index;
+		if (linked && rotate(n))
+			rotations++;
+		// do not ask the clock every node
+		if (time_budget_ms > 0.0 && (visited & 63) == 63
+			&& std::chrono::duration<double, std::milli>(clock::now() - start).count() > time_budget_ms)
+			break;
+	}
+	return rotations;
+}
+/**
+*
+* @param dirty	objects that moved (objects not in the tree are ignored)
+*/
+void bounding_volume_hierarchy::refit(const std::vector<const Object*>& dirty)
+{
+	if (m_nodes.empty() || dirty.empty())
+		return;
+	for (const Object* obj : dirty) {
+		// flag up to the first ancestor already flagged
+		for (u32 n = find_leaf(*obj); n != invalid_index && !m_info[n].refit; n = m_info[n].parent)
+			m_info[n].refit = true;
+	}
+	refit_flagged();
+}
+/**
+*
+* @brief front to back, nodes entered after the best hit so far are skipped
+* @param r
+* @param t_max
+* @param narrow	optional, called for the objects whose aabb is hit
+* @param stack	emptied first
+* @return
+*/
+template<bool ANY, typename NARROW, typename STACK>
+bvh_ray_hit bounding_volume_hierarchy::raycast(const RayQuery& r, float t_max, const NARROW* narrow, STACK& stack) const
+{
+	bvh_ray_hit result;
+	if (m_nodes.empty())
+		return result;
+	float root_t = intersection_ray_aabb(r, m_nodes[0].bounding_volume);
+	if (root_t < 0.f || root_t > t_max)
+		return result;
 
-	recursion_counter = 0;
+	stack.clear();
+	stack.push({ 0, root_t });
+	while (!stack.empty()) {
+		const ray_entry e = stack.pop();
+		if (e.t > t_max)
+			continue;
+		const node& n = m_nodes[e.node];
+		if (n.is_leaf()) {
+			for (u32 i = n.first; i < n.first + n.count; ++i) {
+				Object* obj = m_primitives[i];
+				float t = intersection_ray_aabb(r, m_primitive_aabbs[i]);
+				if (t < 0.f || t > t_max)
+					continue;
+				u32 triangle = ~0u;
+				if (narrow) {
+					t = (*narrow)(*obj, t_max, triangle);
+					if (t < 0.f || t > t_max)
+						continue;
+				}
+				result = { obj, t, triangle };
+				if (ANY)
+					return result;
+				t_max = t;
+			}
+			continue;
+		}
+		float t0 = intersection_ray_aabb(r, m_nodes[n.first].bounding_volume);
+		float t1 = intersection_ray_aabb(r, m_nodes[n.first + 1].bounding_volume);
+		bool hit0 = t0 >= 0.f && t0 <= t_max, hit1 = t1 >= 0.f && t1 <= t_max;
+		// nearest child on top
+		if (hit0 && hit1) {
+			if (t0 <= t1) {
+				stack.push({ n.first + 1, t1 });
+				stack.push({ n.first, t0 });
+			}
+			else {
+				stack.push({ n.first, t0 });
+				stack.push({ n.first + 1, t1 });
+			}
+		}
+		else if (hit0)
+			stack.push({ n.first, t0 });
+		else if (hit1)
+			stack.push({ n.first + 1, t1 });
+	}
+	return result;
 }
 /**
 *
-* @param nodes
+* @param r
+* @param t_max
+* @param narrow
 * @return
 */
-std::tuple<BVH::node*, BVH::node*, AABB> find_candidates(const std::vector<BVH::node*> &nodes) {
-	float best_surface_area = FLT_MAX;	// smaller
-	std::tuple<BVH::node*, BVH::node*, AABB> best_pair = { nullptr, nullptr, AABB{} };
-	// find pairs O(n^2)
-	for (int i = 0; i < nodes.size() - 1; ++i) {
-		for (int j = i + 1; j < nodes.size(); ++j) {
-			const AABB& ab0 = nodes[i]->bounding_volume;
-			const AABB& ab1 = nodes[j]->bounding_volume;
-			AABB ab = AABB{ glm::min(ab0.min_point, ab1.min_point),
-				 glm::max(ab0.max_point, ab1.max_point) };
-
-			float surf_area = ab.surface_area();
-			if (surf_area < best_surface_area) {
-				best_surface_area = surf_area;
-				best_pair = { nodes[i], nodes[j], ab};
+bvh_ray_hit bounding_volume_hierarchy::raycast_closest(const Ray& r, float t_max, const bvh_ray_callback& narrow) const
+{
+	auto fn = [&narrow](Object& obj, float t, u32&) { return narrow(obj, t); };
+	traversal_stack<ray_entry> stack;
+	return raycast<false>(RayQuery(r), t_max, narrow ? &fn : nullptr, stack);
+}
+/**
+*
+* @param r
+* @param t_max
+* @param narrow
+* @return
+*/
+Object* bounding_volume_hierarchy::raycast_any(const Ray& r, float t_max, const bvh_ray_callback& narrow) const
+{
+	auto fn = [&narrow](Object& obj, float t, u32&) { return narrow(obj, t); };
+	traversal_stack<ray_entry> stack;
+	return raycast<true>(RayQuery(r), t_max, narrow ? &fn : nullptr, stack).object;
+}
+/**
+*
+* @brief sort the rays for coherence, then trace contiguous chunks of the sorted order on the worker pool
+* @param rays
+* @param count
+* @param hits		hits[i] is the closest hit of rays[i]
+* @param batch		scratch
+* @param t_max
+* @param narrow	optional, called from the worker threads
+*/
+void bounding_volume_hierarchy::raycast_batch(const Ray* rays, size_t count, bvh_ray_hit* hits, bvh_ray_batch& batch, float t_max, const bvh_batch_callback& narrow) const
+{
+	const size_t cMinChunk = 256;
+	batch.order.resize(count);
+	if (batch.sort && count > 1 && !m_nodes.empty()) {
+		// octant in the top bits, then origin inside the root box and direction
+		const AABB& root_bv = m_nodes[0].bounding_volume;
+		const vec3 extent = root_bv.max_point - root_bv.min_point;
+		const float max_extent = glm::max(extent.x, glm::max(extent.y, extent.z));
+		const float scale = max_extent > 0.f ? 1.f / max_extent : 0.f;
+		batch.keys.resize(count);
+		parallel_for(count, cMinChunk, [&](size_t begin, size_t end, u32) {
+			for (size_t i = begin; i < end; ++i) {
+				const vec3& d = rays[i].dir;
+				const u64 octant = (u64)(d.x < 0.f) << 2 | (u64)(d.y < 0.f) << 1 | (u64)(d.z < 0.f);
+				const vec3 dir = glm::normalize(d) * 0.5f + 0.5f;
+				batch.keys[i] = octant << 60 | morton_code((rays[i].start - root_bv.min_point) * scale, 30) << 30 | morton_code(dir, 30);
+				batch.order[i] = (u32)i;
+			}
+		});
+		radix_sort(batch.keys, batch.order, 63, batch.keys_tmp, batch.order_tmp, batch.histograms);
+	}
+	else {
+		for (size_t i = 0; i < count; ++i)
+			batch.order[i] = (u32)i;
+	}
+
+	parallel_for(count, cMinChunk, [&](size_t begin, size_t end, u32) {
+		// one stack per chunk, reused by all its rays
+		traversal_stack<ray_entry> stack;
+		for (size_t k = begin; k < end; ++k) {
+			const u32 i = batch.order[k];
+			const Ray& r = rays[i];
+			auto fn = [&narrow, &r](Object& obj, float t, u32& triangle) { return narrow(obj, r, t, triangle); };
+			hits[i] = raycast<false>(RayQuery(r), t_max, narrow ? &fn : nullptr, stack);
+		}
+	});
+}
+/**
+*
+* @brief nodes are tested once for every ray, children are visited in the direction of the first ray
+* @param packet
+* @param hits		one per lane, inactive lanes are not written
+* @param t_max
+* @param narrow	optional, called for the lanes hitting an object aabb
+*/
+template<u32 WIDTH>
+void bounding_volume_hierarchy::raycast_packet(const RayPacket<WIDTH>& packet, bvh_ray_hit* hits, float t_max, const bvh_packet_callback& narrow) const
+{
+	alignas(32) float best[WIDTH], t_enter[WIDTH];
+	for (u32 i = 0; i < WIDTH; ++i) {
+		// inactive lanes never hit
+		best[i] = packet.active >> i & 1 ? t_max : -1.f;
+		if (packet.active >> i & 1)
+			hits[i] = bvh_ray_hit{};
+	}
+	if (m_nodes.empty() || !packet.active)
+		return;
+	const u32 lead = glm::findLSB(packet.active);
+	const vec3 dir_sign{ packet.inv_dir[0][lead] < 0.f ? -1.f : 1.f, packet.inv_dir[1][lead] < 0.f ? -1.f : 1.f, packet.inv_dir[2][lead] < 0.f ? -1.f : 1.f };
+
+	traversal_stack<u32> stack;
+	stack.push(0);
+	while (!stack.empty()) {
+		const node& n = m_nodes[stack.pop()];
+		if (!intersection_ray_packet_aabb(packet, n.bounding_volume, best, t_enter))
+			continue;
+		if (!n.is_leaf()) {
+			// nearest child on top
+			const AABB& bv0 = m_nodes[n.first].bounding_volume;
+			const AABB& bv1 = m_nodes[n.first + 1].bounding_volume;
+			bool left_first = glm::dot(bv1.min_point + bv1.max_point - bv0.min_point - bv0.max_point, dir_sign) >= 0.f;
+			stack.push(left_first ? n.first + 1 : n.first);
+			stack.push(left_first ? n.first : n.first + 1);
+			continue;
+		}
+		for (u32 i = n.first; i < n.first + n.count; ++i) {
+			Object* obj = m_primitives[i];
+			for (u32 mask = intersection_ray_packet_aabb(packet, m_primitive_aabbs[i], best, t_enter); mask; mask &= mask - 1) {
+				const u32 lane = glm::findLSB(mask);
+				float t = t_enter[lane];
+				if (narrow) {
+					t = narrow(*obj, lane, best[lane]);
+					if (t < 0.f || t > best[lane])
+						continue;
+				}
+				hits[lane] = { obj, t };
+				best[lane] = t;
 			}
 		}
 	}
-	return best_pair;
+}
+template void bounding_volume_hierarchy::raycast_packet<4>(const RayPacket<4>& packet, bvh_ray_hit* hits, float t_max, const bvh_packet_callback& narrow) const;
+template void bounding_volume_hierarchy::raycast_packet<8>(const RayPacket<8>& packet, bvh_ray_hit* hits, float t_max, const bvh_packet_callback& narrow) const;
+/**
+*
+* @param ab
+* @param visitor	called once for every object whose cached aabb overlaps ab
+*/
+void bounding_volume_hierarchy::query_aabb(const AABB& ab, const bvh_object_callback& visitor) const
+{
+	if (m_nodes.empty())
+		return;
+	traversal_stack<u32> stack;
+	stack.push(0);
+	while (!stack.empty()) {
+		const node& n = m_nodes[stack.pop()];
+		if (!overlap_aabb(n.bounding_volume, ab))
+			continue;
+		if (!n.is_leaf()) {
+			stack.push(n.first + 1);
+			stack.push(n.first);
+			continue;
+		}
+		for (u32 i = n.first; i < n.first + n.count; ++i)
+			if (overlap_aabb(m_primitive_aabbs[i], ab))
+				visitor(*m_primitives[i]);
+	}
+}
+/**
+*
+* @brief best-first search, nodes and objects leave the queue in distance order. With exact, an object
+*	goes back to the queue with its exact distance, so it is only reported once nothing can be closer
+* @param point
+* @param k
+* @param max_distance2
+* @param exact		optional
+* @param heap		scratch
+* @param hits		k of them, only the first (returned) ones are written
+* @return objects found
+*/
+u32 bounding_volume_hierarchy::query_nearest(const vec3& point, u32 k, float max_distance2, const bvh_distance_callback& exact, std::vector<nearest_entry>& heap, bvh_nearest_hit* hits) const
+{
+	if (m_nodes.empty() || k == 0)
+		return 0;
+	auto closer = [](const nearest_entry& a, const nearest_entry& b) { return a.distance2 > b.distance2; };
+	auto push = [&heap, &closer, max_distance2](float distance2, u32 index, u32 kind) {
+		if (distance2 > max_distance2)
+			return;
+		heap.push_back({ distance2, index, kind });
+		std::push_heap(heap.begin(), heap.end(), closer);
+	};
+	heap.clear();
+	push(distance2_point_aabb(point, m_nodes[0].bounding_volume), 0, 0);
+	u32 found = 0;
+	while (!heap.empty() && found < k) {
+		std::pop_heap(heap.begin(), heap.end(), closer);
+		const nearest_entry e = heap.back();
+		heap.pop_back();
+		if (e.kind == 2) {
+			hits[found++] = { m_primitives[e.index], e.distance2 };
+			continue;
+		}
+		if (e.kind == 1) {
+			push(exact(*m_primitives[e.index], point, max_distance2), e.index, 2);
+			continue;
+		}
+		const node& n = m_nodes[e.index];
+		if (!n.is_leaf()) {
+			push(distance2_point_aabb(point, m_nodes[n.first].bounding_volume), n.first, 0);
+			push(distance2_point_aabb(point, m_nodes[n.first + 1].bounding_volume), n.first + 1, 0);
+			continue;
+		}
+		for (u32 i = n.first; i < n.first + n.count; ++i)
+			push(distance2_point_aabb(point, m_primitive_aabbs[i]), i, exact ? 1 : 2);
+	}
+	return found;
+}
+/**
+*
+* @param point
+* @param k
+* @param hits		cleared, closest first
+* @param max_distance
+* @param exact		optional, exact squared distance
+*/
+void bounding_volume_hierarchy::query_nearest(const vec3& point, u32 k, std::vector<bvh_nearest_hit>& hits, float max_distance, const bvh_distance_callback& exact) const
+{
+	std::vector<nearest_entry> heap;
+	hits.resize(glm::min((size_t)k, m_primitives.size() - m_free_primitives.size()));
+	hits.resize(query_nearest(point, (u32)hits.size(), max_distance * max_distance, exact, heap, hits.data()));
+}
+/**
+*
+* @brief no order is needed, a depth-first walk prunes the same nodes as a best-first one
+* @param point
+* @param radius
+* @param visitor	called once for every object within radius
+* @param exact		optional, exact squared distance of the objects whose aabb is within radius
+*/
+void bounding_volume_hierarchy::query_radius(const vec3& point, float radius, const bvh_nearest_callback& visitor, const bvh_distance_callback& exact) const
+{
+	if (m_nodes.empty())
+		return;
+	const float radius2 = radius * radius;
+	traversal_stack<u32> stack;
+	stack.push(0);
+	while (!stack.empty()) {
+		const node& n = m_nodes[stack.pop()];
+		if (distance2_point_aabb(point, n.bounding_volume) > radius2)
+			continue;
+		if (!n.is_leaf()) {
+			stack.push(n.first + 1);
+			stack.push(n.first);
+			continue;
+		}
+		for (u32 i = n.first; i < n.first + n.count; ++i) {
+			float distance2 = distance2_point_aabb(point, m_primitive_aabbs[i]);
+			if (distance2 > radius2)
+				continue;
+			if (exact) {
+				distance2 = exact(*m_primitives[i], point, radius2);
+				if (distance2 > radius2)
+					continue;
+			}
+			visitor(*m_primitives[i], distance2);
+		}
+	}
+}
+/**
+*
+* @param points
+* @param count
+* @param k
+* @param hits		count * k of them
+* @param max_distance
+* @param exact		optional, runs on worker threads
+*/
+void bounding_volume_hierarchy::query_nearest_batch(const vec3* points, size_t count, u32 k, bvh_nearest_hit* hits, float max_distance, const bvh_distance_callback& exact) const
+{
+	const size_t cMinChunk = 64;
+	const float max_distance2 = max_distance * max_distance;
+	parallel_for(count, cMinChunk, [&](size_t begin, size_t end, u32) {
+		// one heap per chunk, reused by all its points
+		std::vector<nearest_entry> heap;
+		for (size_t i = begin; i < end; ++i) {
+			bvh_nearest_hit* point_hits = hits + i * k;
+			const u32 found = query_nearest(points[i], k, max_distance2, exact, heap, point_hits);
+			for (u32 j = found; j < k; ++j)
+				point_hits[j] = bvh_nearest_hit{};
+		}
+	});
+}
+/**
+*
+* @brief plane masking, children ignore the planes their parent is fully in front of.
+*	Subtrees fully inside have no planes left and are reported without more tests
+* @param f
+* @param visitor	called once for every object whose aabb is not outside f
+* @param cache		optional, the plane that culls a node or object is stored for the next query
+*/
+void bounding_volume_hierarchy::query_frustum(const FrustumQuery& f, const bvh_object_callback& visitor, bvh_frustum_cache* cache) const
+{
+	if (m_nodes.empty())
+		return;
+	if (cache) {
+		cache->node_planes.resize(m_nodes.size(), cNoPlane);
+		cache->primitive_planes.resize(m_primitives.size(), cNoPlane);
+	}
+	auto cull = [&f, cache](const AABB& ab, u32& planes, u8* last_plane) {
+		return cache ? intersection_frustum_aabb(f, ab, planes, *last_plane, &cache->stats) : intersection_frustum_aabb(f, ab, planes);
+	};
+	traversal_stack<frustum_entry> stack;
+	stack.push({ 0, (1u << 6) - 1 });
+	while (!stack.empty()) {
+		frustum_entry e = stack.pop();
+		const node& n = m_nodes[e.node];
+		if (cull(n.bounding_volume, e.planes, cache ? &cache->node_planes[e.node] : nullptr) == OUTSIDE)
+			continue;
+		if (!n.is_leaf()) {
+			stack.push({ n.first + 1, e.planes });
+			stack.push({ n.first, e.planes });
+			continue;
+		}
+		for (u32 i = n.first; i < n.first + n.count; ++i) {
+			u32 planes = e.planes;
+			if (cull(m_primitive_aabbs[i], planes, cache ? &cache->primitive_planes[i] : nullptr) != OUTSIDE)
+				visitor(*m_primitives[i]);
+		}
+	}
+}
+/**
+*
+* @param f
+* @param visitor	called once for every object whose aabb is not outside f
+*/
+void bounding_volume_hierarchy::query_frustum(const Frustum& f, const bvh_object_callback& visitor) const
+{
+	query_frustum(FrustumQuery(f), visitor, nullptr);
+}
+/**
+*
+* @param f
+* @param visitor	called once for every object whose aabb is not outside f
+* @param cache		keep it between queries of the same camera
+*/
+void bounding_volume_hierarchy::query_frustum(const Frustum& f, const bvh_object_callback& visitor, bvh_frustum_cache& cache) const
+{
+	query_frustum(FrustumQuery(f), visitor, &cache);
+}
+/**
+*
+* @brief one step of the simultaneous descent, the larger volume of two overlapping nodes is opened
+* @param a		node of this tree
+* @param b		node of other
+* @param other	this for a self query
+* @param push	push(a, b) queues a pair of nodes
+* @param emit	emit(obj_a, obj_b) for every overlapping pair of objects
+*/
+template<typename PUSH, typename EMIT>
+void bounding_volume_hierarchy::overlapping_pairs(u32 a, u32 b, const bounding_volume_hierarchy& other, PUSH& push, EMIT& emit) const
+{
+	const node& na = m_nodes[a];
+	const node& nb = other.m_nodes[b];
+	if (&other == this && a == b) {
+		// pairs inside one subtree: each half alone, then one against the other
+		if (!na.is_leaf()) {
+			push(na.first, na.first + 1);
+			push(na.first + 1, na.first + 1);
+			push(na.first, na.first);
+			return;
+		}
+		for (u32 i = na.first; i < na.first + na.count; ++i)
+			for (u32 j = i + 1; j < na.first + na.count; ++j)
+				if (overlap_aabb(m_primitive_aabbs[i], m_primitive_aabbs[j]))
+					emit(*m_primitives[i], *m_primitives[j]);
+		return;
+	}
+	if (!overlap_aabb(na.bounding_volume, nb.bounding_volume))
+		return;
+	if (na.is_leaf() && nb.is_leaf()) {
+		for (u32 i = na.first; i < na.first + na.count; ++i)
+			for (u32 j = nb.first; j < nb.first + nb.count; ++j)
+				if (overlap_aabb(m_primitive_aabbs[i], other.m_primitive_aabbs[j]))
+					emit(*m_primitives[i], *other.m_primitives[j]);
+		return;
+	}
+	if (nb.is_leaf() || (!na.is_leaf() && na.bounding_volume.surface_area() >= nb.bounding_volume.surface_area())) {
+		push(na.first + 1, b);
+		push(na.first, b);
+	}
+	else {
+		push(a, nb.first + 1);
+		push(a, nb.first);
+	}
+}
+/**
+*
+* @param other
+* @param fn	fn(obj, other_obj)
+*/
+void bounding_volume_hierarchy::query_overlapping_pairs(const bounding_volume_hierarchy& other, const bvh_pair_callback& fn) const
+{
+	if (m_nodes.empty() || other.m_nodes.empty())
+		return;
+	traversal_stack<pair_entry> stack;
+	auto push = [&stack](u32 a, u32 b) { stack.push({ a, b }); };
+	auto emit = [&fn](Object& a, Object& b) { fn(a, b); };
+	stack.push({ 0, 0 });
+	while (!stack.empty()) {
+		const pair_entry e = stack.pop();
+		overlapping_pairs(e.a, e.b, other, push, emit);
+	}
+}
+/**
+*
+* @param fn	called once for every pair of objects of this tree whose aabbs overlap
+*/
+void bounding_volume_hierarchy::query_overlapping_pairs(const bvh_pair_callback& fn) const
+{
+	query_overlapping_pairs(*this, fn);
+}
+/**
+*
+* @brief the top levels are opened breadth-first until there is work for every worker,
+*	then every pending pair of nodes is a task with its own result list
+* @param pairs	found pairs are appended, same order every call
+* @param other	null for a self query
+*/
+void bounding_volume_hierarchy::query_overlapping_pairs_parallel(std::vector<bvh_object_pair>& pairs, const bounding_volume_hierarchy* other) const
+{
+	if (!other)
+		other = this;
+	if (m_nodes.empty() || other->m_nodes.empty())
+		return;
+	auto emit = [&pairs](Object& a, Object& b) { pairs.push_back({ &a, &b }); };
+	std::vector<pair_entry> frontier{ { 0, 0 } };
+	auto push_frontier = [&frontier](u32 a, u32 b) { frontier.push_back({ a, b }); };
+	const size_t task_count = 4 * (size_t)worker_count();
+	size_t head = 0;
+	while (head < frontier.size() && frontier.size() - head < task_count) {
+		const pair_entry e = frontier[head++];
+		overlapping_pairs(e.a, e.b, *other, push_frontier, emit);
+	}
+	const size_t count = frontier.size() - head;
+	std::vector<std::vector<bvh_object_pair>> found(count);
+	task_group group;
+	for (size_t t = 0; t < count; ++t) {
+		group.spawn([this, other, &frontier, &found, head, t]() {
+			traversal_stack<pair_entry> stack;
+			auto push = [&stack](u32 a, u32 b) { stack.push({ a, b }); };
+			auto emit = [&found, t](Object& a, Object& b) { found[t].push_back({ &a, &b }); };
+			stack.push(frontier[head + t]);
+			while (!stack.empty()) {
+				const pair_entry e = stack.pop();
+				overlapping_pairs(e.a, e.b, *other, push, emit);
+			}
+		});
+	}
+	group.wait();
+	for (const auto& f : found)
+		pairs.insert(pairs.end(), f.begin(), f.end());
 }
 /**
 *
@@ -723,53 +2051,228 @@ std::tuple<BVH::node*, BVH::node*, AABB> find_candidates(const std::vector<BVH::
 */
 void bounding_volume_hierarchy::build_bottom_up(const std::vector <Object*>& objects)
 {
-	assert(m_root == nullptr);	// tree should be cleared
+	assert(m_nodes.empty());	// tree should be cleared
+	if (objects.empty())
+		return;
 	/*
-		nodes = []
-		// compute bounding volumes for all
-		for obj : objects {
-			node = create_node(obj)
-			node.compute_bv()
-			nodes.add(node)
-		}
-		while(nodes.size > 1){
-			[node_a, node_b] = find_candidates(nodes)
-			node = create_node()
-			node.children = [node_a, node_b]
-			node.compute_bv()
-			nodes.erase([node_a, node_b])
-		}
-		return nodes[0]
+		Locally ordered clustering (PLOC), same goal than merging the pair with the
+		smallest combined area but only searching neighbours in morton order
+
+		clusters = sort_by_morton(objects)
+		while(clusters.size > 1){
+			// in parallel
+			for i : clusters
+				nearest[i] = j in [i - r, i + r] with smallest area(merge(i, j))
+			// in parallel, keeps the morton order
+			for i : clusters
+				if nearest[nearest[i]] == i and i < nearest[i]
+					clusters[i] = create_node(clusters[i], clusters[nearest[i]])
+				else if nearest[nearest[i]] == i
+					clusters.erase(i)
+		}
+		return clusters[0]
 	*/
-	std::vector<node*> nodes;
-	nodes.reserve(objects.size());
-	// compute bounding volumes for all and create new nodes
-	for (auto obj : objects) {
-		node* n = new node;
-		n->bounding_volume = obj->get_aabb();
-		n->objects.push_back(obj);
-		nodes.push_back(n);
-	}
-	while (nodes.size() > 1) {
-		auto best_pair = find_candidates(nodes);
-		node* child0 = std::get<0>(best_pair);
-		node* child1 = std::get<1>(best_pair);
-		node* n = new node;
-		//link
-		n->children = {child0, child1};
-		child0->parent = child1->parent = n;
-		//compute bv (already done in pair find
-		n->bounding_volume = std::get<2>(best_pair);
-		//erase (back swap) nodes before adding new
-		auto it = std::find(nodes.begin(), nodes.end(), child0);
-		assert(it != nodes.end());
-		nodes.erase(it);
-		it = std::find(nodes.begin(), nodes.end(), child1);
-		assert(it != nodes.end());
-		nodes.erase(it);
-		//add new node
-		nodes.push_back(n);
+	const size_t cMinChunk = 1 << 10;
+	const u32 count = (u32)objects.size();
+	const u32 radius = (u32)glm::max(1, m_build_config.search_radius);
+	// temporal tree, flattened at the end
+	std::vector<build_node> tmp(2 * (size_t)count - 1);
+	std::vector<u32> clusters;
+	{
+		std::vector<u64> codes;
+		morton_sort(objects, m_build_config.morton_bits > 30 ? 63 : 30, codes, clusters);
+	}
+	// leaves use the object index
+	for (u32 i = 0; i < count; ++i) {
+		tmp[i].bounding_volume = objects[i]->get_aabb();
+		tmp[i].object = objects[i];
+	}
+	u32 node_count = count;
+	std::vector<u32> nearest(count);
+	std::vector<u32> next(count);
+	std::vector<u32> merges, survivors;
+	while (clusters.size() > 1) {
+		const size_t size = clusters.size();
+		// nearest neighbour inside the search radius
+		parallel_for(size, cMinChunk, [&](size_t begin, size_t end, u32) {
+			for (size_t i = begin; i < end; ++i) {
+				const AABB& bv = tmp[clusters[i]].bounding_volume;
+				const size_t first = i > radius ? i - radius : 0;
+				const size_t last = glm::min(size - 1, i + radius);
+				float best = FLT_MAX;
+				for (size_t j = first; j <= last; ++j) {
+					if (j == i)
+						continue;
+					float area = merge_aabb(bv, tmp[clusters[j]].bounding_volume).surface_area();
+					if (area < best) {
+						best = area;
+						nearest[i] = (u32)j;
+					}
+				}
+			}
+		});
+		// count merges per chunk so new nodes get the same index with any thread count
+		const u32 chunks = parallel_chunks(size, cMinChunk);
+		u32 merge_total = 0, survivor_total = 0;
+		auto count_merges = [&]() {
+			merges.assign(chunks, 0);
+			survivors.assign(chunks, 0);
+			parallel_for(size, cMinChunk, [&](size_t begin, size_t end, u32 chunk) {
+				for (size_t i = begin; i < end; ++i) {
+					const bool mutual = nearest[nearest[i]] == i;
+					merges[chunk] += mutual && i < nearest[i];
+					survivors[chunk] += !mutual || i < nearest[i];
+				}
+			});
+			merge_total = survivor_total = 0;
+			for (u32 c = 0; c < chunks; ++c) {
+				u32 m = merges[c], k = survivors[c];
+				merges[c] = node_count + merge_total;
+				survivors[c] = survivor_total;
+				merge_total += m;
+				survivor_total += k;
+			}
+		};
+		count_merges();
+		// ties may leave no mutual pairs, merge the first two
+		if (merge_total == 0) {
+			nearest[0] = 1;
+			nearest[1] = 0;
+			count_merges();
+		}
+		// merge and compact
+		parallel_for(size, cMinChunk, [&](size_t begin, size_t end, u32 chunk) {
+			u32 n = merges[chunk];
+			u32 out = survivors[chunk];
+			for (size_t i = begin; i < end; ++i) {
+				const u32 j = nearest[i];
+				if (nearest[j] != i)
+					next[out++] = clusters[i];
+				else if (i < j) {
+					build_node& bn = tmp[n];
+					bn.children[0] = clusters[i];
+					bn.children[1] = clusters[j];
+					bn.bounding_volume = merge_aabb(tmp[clusters[i]].bounding_volume, tmp[clusters[j]].bounding_volume);
+					next[out++] = n++;
+				}
+			}
+		});
+		node_count += merge_total;
+		clusters.swap(next);
+		clusters.resize(survivor_total);
+		next.resize(size);
 	}
 	// link the last node to the root
-	m_root = nodes.back();
+	flatten(tmp, clusters[0]);
+	finish_build();
+}
+/**
+*
+* @param codes	sorted morton codes
+* @param n		node to build
+* @param begin
+* @param end
+* @param c		index for the children pair of n
+* @param depth	levels to build before deferring subtrees to tasks
+* @param tasks	deferred subtrees (null builds everything)
+* @param top	intermediate nodes built before the tasks (preorder)
+*/
+void bounding_volume_hierarchy::emit_linear(const u64* codes, u32 n, u32 begin, u32 end, u32 c, int depth, std::vector<linear_task>* tasks, std::vector<u32>* top)
+{
+	if (end - begin == 1) {
+		m_nodes[n].bounding_volume = m_primitives[begin]->get_aabb();
+		set_leaf(n, begin, 1);
+		return;
+	}
+	if (tasks && depth == 0) {
+		tasks->push_back({ n, begin, end, c });
+		return;
+	}
+	// split where the highest differing bit changes (binary search)
+	u32 split = (begin + end) / 2;	// same codes, split by count
+	const u64 first_code = codes[begin];
+	const u64 last_code = codes[end - 1];
+	if (first_code != last_code) {
+		const int common_prefix = count_leading_zeros(first_code ^ last_code);
+		u32 last_same = begin;
+		u32 step = end - 1 - begin;
+		do {
+			step = (step + 1) >> 1;
+			u32 candidate = last_same + step;
+			if (candidate < end - 1 && count_leading_zeros(first_code ^ codes[candidate]) > common_prefix)
+				last_same = candidate;
+		} while (step > 1);
+		split = last_same + 1;
+	}
+	m_nodes[n].first = c;
+	m_info[c].parent = m_info[c + 1].parent = n;
+	if (top)
+		top->push_back(n);
+	// a subtree of k leaves uses 2k - 1 nodes, so the right subtree starts after the left one
+	const u32 left_count = split - begin;
+	emit_linear(codes, c, begin, split, c + 2, depth - 1, tasks, top);
+	emit_linear(codes, c + 1, split, end, c + 2 * left_count, depth - 1, tasks, top);
+}
+/**
+*
+* @brief fit bounding volumes of the subtree, children always have bigger indices than parents
+* @param task
+*/
+void bounding_volume_hierarchy::fit_linear(const linear_task& task)
+{
+	const u32 descendants = 2 * (task.end - task.begin) - 2;
+	for (u32 i = task.c + descendants; i-- > task.c; ) {
+		node& n = m_nodes[i];
+		if (!n.is_leaf())
+			n.bounding_volume = merge_aabb(m_nodes[n.first].bounding_volume, m_nodes[n.first + 1].bounding_volume);
+	}
+	node& n = m_nodes[task.n];
+	if (!n.is_leaf())
+		n.bounding_volume = merge_aabb(m_nodes[n.first].bounding_volume, m_nodes[n.first + 1].bounding_volume);
+}
+/**
+*
+* @param objects
+*/
+void bounding_volume_hierarchy::build_linear(const std::vector <Object*>& objects)
+{
+	assert(m_nodes.empty());	// tree should be cleared
+	if (objects.empty())
+		return;
+	const size_t cMinChunk = 1 << 12;
+	const u32 count = (u32)objects.size();
+	const int bits = m_build_config.morton_bits > 30 ? 63 : 30;
+
+	// quantize and sort
+	std::vector<u64> codes;
+	std::vector<u32> order;
+	morton_sort(objects, bits, codes, order);
+	m_primitives.resize(count);
+	m_primitive_aabbs.resize(count);
+	m_primitive_leaf.resize(count);
+	for (u32 i = 0; i < count; ++i)
+		m_primitives[i] = objects[order[i]];
+
+	// emit top levels, then the subtrees in parallel
+	m_nodes.resize(2 * (size_t)count - 1);
+	m_info.resize(2 * (size_t)count - 1);
+	std::vector<linear_task> tasks;
+	std::vector<u32> top;
+	int depth = 0;
+	while ((1u << depth) < 4 * worker_count() && (count >> depth) > cMinChunk)
+		depth++;
+	emit_linear(codes.data(), 0, 0, count, 1, depth, &tasks, &top);
+	parallel_for(tasks.size(), 1, [&](size_t begin, size_t end, u32) {
+		for (size_t i = begin; i < end; ++i) {
+			const linear_task& t = tasks[i];
+			emit_linear(codes.data(), t.n, t.begin, t.end, t.c, -1, nullptr, nullptr);
+			fit_linear(t);
+		}
+	});
+	// bottom-up fit of the top levels
+	for (auto it = top.rbegin(); it != top.rend(); ++it) {
+		node& n = m_nodes[*it];
+		n.bounding_volume = merge_aabb(m_nodes[n.first].bounding_volume, m_nodes[n.first + 1].bounding_volume);
+	}
+	finish_build();
 }
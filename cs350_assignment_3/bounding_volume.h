@@ -32,46 +32,154 @@ Sphere compute_bv_sphere_pca(const mat4 &transform, const vec3* points, const si
 
 struct Object;
 
+// top-down partition strategy
+enum BVHSplit {
+	bvh_split_midpoint = 0,	// center of the longest axis
+	bvh_split_sah,			// binned surface area heuristic
+	bvh_split_count
+};
+// add_object sibling search
+enum BVHInsertion {
+	bvh_insertion_greedy = 0,			// descend to the child with the smaller merged area
+	bvh_insertion_branch_and_bound,		// cheapest sibling anywhere, bounded by the inherited cost
+	bvh_insertion_count
+};
+struct bvh_build_config {
+	BVHSplit split = bvh_split_midpoint;
+	BVHInsertion insertion = bvh_insertion_greedy;
+	int max_leaf_size = 1;			// builders collapse subtrees up to this size when the sah says it is cheaper
+	int bin_count = 16;				// sah bins per axis [2, 64]
+	float traversal_cost = 1.f;		// sah cost of visiting an intermediate node
+	float intersection_cost = 1.f;	// sah cost of testing one object in a leaf
+	int morton_bits = 30;			// linear build codes, 30 (10 per axis) or 63 (21 per axis)
+	int search_radius = 4;			// bottom-up build, neighbours checked on each side in morton order
+	int parallel_threshold = 4096;	// top-down build, bigger ranges are built as tasks (0 = serial)
+	// dynamic mode, inserted or refitted leaves get a fat aabb so small motions do not reinsert
+	bool fat_leaves = false;
+	float fat_margin = 0.1f;		// added on every side
+	float fat_prediction = 0.1f;	// seconds of velocity added on the moving direction
+	bool rotations = false;			// rotate on the way up after insertions, removals and refits
+};
+struct bvh_counters {
+	u64 moves = 0;			// move_object calls on objects in the tree
+	u64 reinsertions = 0;	// moves that left the fat box
+
+	inline float reinsertion_rate() const { return moves ? (float)reinsertions / (float)moves : 0.f; }
+};
+struct bvh_ray_hit {
+	Object* object = nullptr;	// null if nothing was hit
+	float t = -1.f;				// distance in ray direction units
+	u32 triangle = ~0u;			// set by the narrow phase of raycast_batch, ~0u if unknown
+};
+// narrow phase of an object whose aabb is hit before t_max, returns its hit distance (negative if missed)
+using bvh_ray_callback = std::function<float(Object&, float t_max)>;
+// same for a ray packet, lane is the index of the ray in the packet
+using bvh_packet_callback = std::function<float(Object&, u32 lane, float t_max)>;
+// same for raycast_batch, runs on worker threads and may report the triangle hit
+using bvh_batch_callback = std::function<float(Object&, const Ray&, float t_max, u32& triangle)>;
+// object reported by a query
+using bvh_object_callback = std::function<void(Object&)>;
+// two objects whose aabbs overlap, the first one from the queried tree
+using bvh_pair_callback = std::function<void(Object&, Object&)>;
+using bvh_object_pair = std::pair<Object*, Object*>;
+struct bvh_nearest_hit {
+	Object* object = nullptr;	// null if not found
+	float distance2 = -1.f;		// squared distance from the query point
+};
+// exact squared distance from point to obj (point-mesh...), never less than the squared distance to its aabb.
+// Anything above max_distance2 drops obj
+using bvh_distance_callback = std::function<float(Object&, const vec3& point, float max_distance2)>;
+// object reported by a radius query with its squared distance
+using bvh_nearest_callback = std::function<void(Object&, float distance2)>;
+// raycast_batch scratch, keep it between calls so batches up to the biggest size seen do not allocate
+struct bvh_ray_batch {
+	bool sort = true;		// trace rays grouped by direction octant and origin (morton order)
+	std::vector<u64> keys, keys_tmp;
+	std::vector<u32> order, order_tmp;
+	std::vector<std::array<u32, 256>> histograms;
+};
+// query_frustum temporal coherence, the plane that culled a node or object last time is tested first.
+// Keep one per camera between frames, entries left stale by tree changes only cost a wasted test
+struct bvh_frustum_cache {
+	std::vector<u8> node_planes;		// same indices as the nodes
+	std::vector<u8> primitive_planes;	// same indices as the primitive slots
+	frustum_cull_stats stats;			// not reset by the queries
+};
+
 class bounding_volume_hierarchy {
 public:
-	struct node;
-	using children_list = std::array<node*, 2>;	// may want to be more than binary?
+	static constexpr u32 invalid_index = ~0u;
 
+	// hot node data (32 bytes), every node lives in one contiguous array.
+	// children are allocated in pairs, so right child is always left child + 1
 	struct node {
-		mutable bool draw_bv = true;	// debug hack
-		std::vector <Object*> objects{};	// only read
 		AABB bounding_volume{};
-		node* parent = nullptr;	// needed to relink and rebuild up (TODO: do it without parent)
-		children_list children{nullptr};
-		~node() {	// same as destroy but not caring of setting children to NULL
-			// delete all subtree (post-order recursive)
-			delete children[0];	// calls delete recursively
-			delete children[1];
-		}
+		u32 first = invalid_index;	// intermediate: left child index, leaf: first primitive index
+		u32 count = 0;				// primitive count (0 for intermediate nodes)
+
+		inline bool is_leaf() const { return count != 0; }
 	};
+	static_assert(sizeof(node) == 32, "keep nodes in half a cache line");
+	using children_list = std::array<const node*, 2>;	// may want to be more than binary?
+
 private:
-	node* m_root;
+	// cold data, only touched when relinking or by the debug GUI
+	struct node_info {
+		u32 parent = invalid_index;	// needed to rebuild up
+		bool draw_bv = true;		// debug hack
+		bool refit = false;			// ancestor of a dirty leaf
+	};
+	// temporal node used by builders that do not create the tree in depth-first order
+	struct build_node {
+		AABB bounding_volume{};
+		u32 children[2] = { invalid_index, invalid_index };
+		Object* object = nullptr;	// only leaves
+	};
+
+	std::vector<node> m_nodes;			// m_nodes[0] is the root (if any)
+	std::vector<node_info> m_info;		// same indices as m_nodes
+	std::vector<Object*> m_primitives;	// leaves reference contiguous ranges of this array
+	std::vector<AABB> m_primitive_aabbs;	// object aabbs as of the last build, refit or update, queries never touch the objects
+	std::vector<u32> m_primitive_leaf;	// leaf referencing each primitive slot
+	std::vector<u32> m_slot_handles;	// handle of the object in each primitive slot
+	std::vector<u32> m_handle_slots;	// slot of each handle (the handles stored on the objects), invalid_index if free
+	std::vector<u32> m_free_handles;	// released handles, reused on insertion
+	std::vector<u32> m_free_pairs;		// released children pairs, reused on insertion
+	std::vector<u32> m_free_primitives;	// released primitive slots, reused on insertion
+	bvh_build_config m_build_config;
+	float m_build_quality = 0.f;			// area_ratio() right after the last build
+	bvh_counters m_counters;
+	std::vector<u32> m_refit_order;		// refit scratch, kept to avoid allocations
+	u32 m_optimize_cursor = 0;			// next node optimize() looks at
+	std::vector<std::pair<float, u32>> m_insert_heap;	// branch and bound scratch {inherited cost, node}
 
 	template<typename TRAVERSE_NODE_FN>
-	void traverse_preorder(node* n, TRAVERSE_NODE_FN fn) {
-		if (!n) return;
-		fn(*n);
-		traverse_preorder(n->children[0], fn);
-		traverse_preorder(n->children[1], fn);
+	void traverse_preorder(u32 n, TRAVERSE_NODE_FN fn) const {
+		const node& nd = m_nodes[n];
+		fn(nd);
+		if (nd.is_leaf()) return;
+		traverse_preorder(nd.first, fn);
+		traverse_preorder(nd.first + 1, fn);
 	}
 	template<typename TRAVERSE_NODE_FN>
-	void traverse_inorder(node* n, TRAVERSE_NODE_FN fn) {
-		if (!n) return;
-		traverse_inorder(n->children[0], fn);
-		fn(*n);
-		traverse_inorder(n->children[1], fn);
+	void traverse_inorder(u32 n, TRAVERSE_NODE_FN fn) const {
+		const node& nd = m_nodes[n];
+		if (nd.is_leaf()) {
+			fn(nd);
+			return;
+		}
+		traverse_inorder(nd.first, fn);
+		fn(nd);
+		traverse_inorder(nd.first + 1, fn);
 	}
 	template<typename TRAVERSE_NODE_FN>
-	void traverse_postorder(node* n, TRAVERSE_NODE_FN fn) {
-		if (!n) return;
-		traverse_postorder(n->children[0], fn);
-		traverse_postorder(n->children[1], fn);
-		fn(*n);
+	void traverse_postorder(u32 n, TRAVERSE_NODE_FN fn) const {
+		const node& nd = m_nodes[n];
+		if (!nd.is_leaf()) {
+			traverse_postorder(nd.first, fn);
+			traverse_postorder(nd.first + 1, fn);
+		}
+		fn(nd);
 	}
 	/*
 	* @brief find leaf node at some predicate
@@ -80,43 +188,185 @@ private:
 	* @return node leaf found or null
 	*/
 	template<typename PREDICATE>
-	node* find(node* n, PREDICATE fn) const {
+	const node* find(const node* n, PREDICATE fn) const {
 		if (!n) return nullptr;
 		children_list pref_children = fn(n);
 
 		// foreach children in best order
-		for (auto& c : pref_children)
-			if (node* found = find(c, fn))
+		for (auto c : pref_children)
+			if (const node* found = find(c, fn))
 				return found;
 		return n;	// null if hited intermediate node (no objects)
 	}
-	// return parent node to rebuild up
-	bool remove_object(const Object& obj, node* current);
-	std::pair<node*, node*> select_branch_by_position(const Object& obj, const node& current);
-	// return created node
-	node* build_top_down(std::vector  < Object* >& objects, node* n);
-	u64 recursion_counter = 0;
+	// node storage
+	u32 allocate_pair();
+	void release_pair(u32 first);
+	// a slot and a handle for obj (stored on it)
+	u32 allocate_primitive(Object* obj);
+	// releases the slot and the handle in it
+	void release_primitive(u32 idx);
+	// handle i for slot i, after a build
+	void reset_handles();
+	// recompute bounding volumes from n to the root
+	void rebuild_up(u32 n);
+	// link leaf n with primitives [first, first + count)
+	void set_leaf(u32 n, u32 first, u32 count);
+	// aabb of obj, fat in dynamic mode
+	AABB leaf_aabb(const Object& obj) const;
+	// recompute the bounding volume of n from its children or primitives
+	void refit_node(u32 n);
+	// swap the contents of two nodes, their subtrees go with them
+	void swap_nodes(u32 a, u32 b);
+	// swap a child of n with a grandchild if that lowers the surface area, true if rotated
+	bool rotate(u32 n);
+	// refit the nodes flagged in node_info (clears the flags)
+	void refit_flagged();
+	// copy a temporal tree into the node array (depth-first order)
+	void flatten(const std::vector<build_node>& tmp, u32 tmp_root);
+
+	// slot of obj through its handle, invalid_index if obj is not in this tree
+	u32 find_slot(const Object& obj) const;
+	// leaf of obj through its handle, invalid_index if obj is not in this tree
+	u32 find_leaf(const Object& obj) const;
+	// best node to pair with a new leaf of bounding volume bv
+	u32 find_sibling(const AABB& bv);
+	// unlink a leaf with one object, its sibling takes the parent place
+	void remove_leaf(u32 leaf);
+	// remove the object at slot from its leaf (the last object of the leaf takes the slot, its handle is kept)
+	void remove_primitive(u32 slot);
+	// after a build, turn small subtrees into leaves and drop their nodes
+	void collapse_leaves();
+	// end of every build: collapse_leaves, fat leaf boxes in dynamic mode, handles and the build quality
+	void finish_build();
+	// closest hit, or the first one found if ANY
+	// narrow(obj, t_max, triangle) may be null, the stack is reused between rays
+	template<bool ANY, typename NARROW, typename STACK>
+	bvh_ray_hit raycast(const RayQuery& r, float t_max, const NARROW* narrow, STACK& stack) const;
+	// cache may be null
+	void query_frustum(const FrustumQuery& f, const bvh_object_callback& visitor, bvh_frustum_cache* cache) const;
+	// processes the pair of nodes (a, b), b is a node of other
+	template<typename PUSH, typename EMIT>
+	void overlapping_pairs(u32 a, u32 b, const bounding_volume_hierarchy& other, PUSH& push, EMIT& emit) const;
+	// best-first queue entry of query_nearest, min-heap on distance2
+	struct nearest_entry {
+		float distance2;
+		u32 index;		// node or primitive slot
+		u32 kind;		// 0 node, 1 primitive waiting for its exact distance, 2 primitive
+	};
+	// the k closest objects in order, returns how many were found. The heap is reused between queries
+	u32 query_nearest(const vec3& point, u32 k, float max_distance2, const bvh_distance_callback& exact, std::vector<nearest_entry>& heap, bvh_nearest_hit* hits) const;
+	// builds node n from primitives [begin, end), children go to pair c
+	void build_top_down(u32 n, u32 begin, u32 end, u32 c, task_group* tasks);
+	// linear build: node n covers sorted primitives [begin, end) and its children go to pair c
+	struct linear_task { u32 n, begin, end, c; };
+	void emit_linear(const u64* codes, u32 n, u32 begin, u32 end, u32 c, int depth, std::vector<linear_task>* tasks, std::vector<u32>* top);
+	void fit_linear(const linear_task& task);
 public:
-	bounding_volume_hierarchy() 
-	: m_root(nullptr)
-	{}
+	bounding_volume_hierarchy() = default;
 	~bounding_volume_hierarchy() { destroy(); }
+	// the objects keep a handle into this tree
+	bounding_volume_hierarchy(const bounding_volume_hierarchy&) = delete;
+	bounding_volume_hierarchy& operator=(const bounding_volume_hierarchy&) = delete;
+	// builds take the handles of their objects, a tree they were in before can only be queried or destroyed
 	void build_top_down(const std::vector  <Object* >& objects);
 	void build_bottom_up(const std::vector <Object* >& objects);
-	bool add_object(Object& obj);
-	inline bool remove_object(const Object& obj) { return remove_object(obj, m_root); }
-	void destroy() { delete m_root; m_root = nullptr; }	// calls destroy on nodes recursively
-	const node* root() const { return m_root; }
+	// sort by morton code of the centroids and split at the highest differing bit
+	void build_linear(const std::vector <Object* >& objects);
+	// top-down build (current config) of the objects already in the tree, none is added or dropped
+	void rebuild();
+	// returns the handle of obj (also stored on it), invalid_index if already in the tree.
+	// obj must not be in another tree, an object is in one bvh at most
+	u32 add_object(Object& obj);
+	// goes straight to the leaf through the handle of obj
+	bool remove_object(Object& obj);
+	// refit the leaf of obj and its ancestors, topology is kept
+	bool update_object(Object& obj);
+	// reinsert obj only if its aabb left the leaf box, return true if reinserted
+	bool move_object(Object& obj);
+	// objects whose handle is still in this tree can go to another one
+	void destroy();
+	const node* root() const { return m_nodes.empty() ? nullptr : &m_nodes[0]; }
+	// true if obj is in this tree (its handle may be stale or from another tree)
+	inline bool contains(const Object& obj) const { return find_leaf(obj) != invalid_index; }
+	// used by the next build
+	inline bvh_build_config& build_config() { return m_build_config; }
+	inline const bvh_build_config& build_config() const { return m_build_config; }
+	// expected cost of a random query (surface area heuristic, relative to the root)
+	float sah_cost() const;
+	// intermediate node area over leaf area, does not change if objects only translate
+	float area_ratio() const;
+	// area_ratio() relative to the last build (1 if not built), rebuild when refits make it too big
+	float quality_ratio() const;
+	inline const bvh_counters& counters() const { return m_counters; }
+	inline void reset_counters() { m_counters = bvh_counters{}; }
+	// rotate nodes until the budgets run out (0 time = no time limit), returns the rotations done
+	u32 optimize(u32 node_budget, double time_budget_ms = 0.0);
+	// closest object hit by r up to t_max, narrow (optional) confirms the aabb hits and shrinks t_max
+	bvh_ray_hit raycast_closest(const Ray& r, float t_max = FLT_MAX, const bvh_ray_callback& narrow = nullptr) const;
+	// any object hit by r up to t_max (occlusion), null if none
+	Object* raycast_any(const Ray& r, float t_max = FLT_MAX, const bvh_ray_callback& narrow = nullptr) const;
+	// closest hit of every ray (hits[i] for rays[i]) on the worker pool, the tree and objects must not change meanwhile
+	void raycast_batch(const Ray* rays, size_t count, bvh_ray_hit* hits, bvh_ray_batch& batch, float t_max = FLT_MAX, const bvh_batch_callback& narrow = nullptr) const;
+	// closest hit of every active lane (4 or 8 rays), a node is visited if any ray still hits it
+	template<u32 WIDTH>
+	void raycast_packet(const RayPacket<WIDTH>& packet, bvh_ray_hit* hits, float t_max = FLT_MAX, const bvh_packet_callback& narrow = nullptr) const;
+	// every object whose aabb overlaps (or touches) ab
+	void query_aabb(const AABB& ab, const bvh_object_callback& visitor) const;
+	// the k closest objects to point up to max_distance, closest first (hits is cleared).
+	// Aabb distances unless exact is given, which is only called for the objects that may still get in
+	void query_nearest(const vec3& point, u32 k, std::vector<bvh_nearest_hit>& hits, float max_distance = FLT_MAX, const bvh_distance_callback& exact = nullptr) const;
+	// every object within radius of point (aabb distance, or exact if given), in no particular order
+	void query_radius(const vec3& point, float radius, const bvh_nearest_callback& visitor, const bvh_distance_callback& exact = nullptr) const;
+	// query_nearest of every point on the worker pool, hits[i * k, i * k + k) for points[i] (missing ones left null).
+	// The tree and objects must not change meanwhile
+	void query_nearest_batch(const vec3* points, size_t count, u32 k, bvh_nearest_hit* hits, float max_distance = FLT_MAX, const bvh_distance_callback& exact = nullptr) const;
+	// every object whose aabb is not outside f, subtrees fully inside f are reported without plane tests
+	void query_frustum(const Frustum& f, const bvh_object_callback& visitor) const;
+	// same objects, testing first the plane that culled each node and object in the last query
+	void query_frustum(const Frustum& f, const bvh_object_callback& visitor, bvh_frustum_cache& cache) const;
+	// every pair of objects of this tree whose aabbs overlap (or touch), each pair once
+	void query_overlapping_pairs(const bvh_pair_callback& fn) const;
+	// every object of this tree against every object of other (static vs dynamic sets)
+	void query_overlapping_pairs(const bounding_volume_hierarchy& other, const bvh_pair_callback& fn) const;
+	// same pairs on the worker pool, other is null for a self query
+	void query_overlapping_pairs_parallel(std::vector<bvh_object_pair>& pairs, const bounding_volume_hierarchy* other = nullptr) const;
+	// recompute every bounding volume bottom-up, topology is kept
+	void refit();
+	// recompute the leaves of the moved objects and their ancestors only
+	void refit(const std::vector<const Object*>& dirty);
+
+	// node accessors
+	inline u32 index(const node& n) const { return (u32)(&n - m_nodes.data()); }
+	inline children_list children(const node& n) const {
+		if (n.is_leaf()) return { nullptr, nullptr };
+		return { &m_nodes[n.first], &m_nodes[n.first + 1] };
+	}
+	inline const node* parent(const node& n) const {
+		u32 p = m_info[index(n)].parent;
+		return p == invalid_index ? nullptr : &m_nodes[p];
+	}
+	inline Object* object(const node& leaf, u32 i = 0) const {
+		assert(i < leaf.count);
+		return m_primitives[leaf.first + i];
+	}
+	// cached aabb of an object of a leaf
+	inline const AABB& object_aabb(const node& leaf, u32 i = 0) const {
+		assert(i < leaf.count);
+		return m_primitive_aabbs[leaf.first + i];
+	}
+	inline bool& draw_bv(const node& n) { return m_info[index(n)].draw_bv; }
+	// allocated nodes (released pairs included)
+	inline size_t node_capacity() const { return m_nodes.size(); }
 
 	template<typename TRAVERSE_NODE_FN>
-	inline void traverse_preorder(TRAVERSE_NODE_FN fn) { traverse_preorder(m_root, fn); }
+	inline void traverse_preorder(TRAVERSE_NODE_FN fn) const { if (!m_nodes.empty()) traverse_preorder(0, fn); }
 	template<typename TRAVERSE_NODE_FN>
-	inline void traverse_inorder(TRAVERSE_NODE_FN fn) { traverse_inorder(m_root, fn); }
+	inline void traverse_inorder(TRAVERSE_NODE_FN fn) const { if (!m_nodes.empty()) traverse_inorder(0, fn); }
 	template<typename TRAVERSE_NODE_FN>
-	inline void traverse_postorder(TRAVERSE_NODE_FN fn) { traverse_postorder(m_root, fn); }
+	inline void traverse_postorder(TRAVERSE_NODE_FN fn) const { if (!m_nodes.empty()) traverse_postorder(0, fn); }
 
 	template<typename PREDICATE>
-	inline node* find(PREDICATE fn) const { return find(m_root, fn); }
+	inline const node* find(PREDICATE fn) const { return find(root(), fn); }
 
 };
 
@@ -29,6 +29,21 @@ struct Camera
 		world_pos /= world_pos.w;
 		return world_pos;
 	}
+	// world space planes facing inwards, planes[2 * a] is the +a face of the ndc cube and planes[2 * a + 1] the -a face
+	inline Frustum get_frustum() const {
+		const mat4 vp = get_proj() * get_view();
+		const vec4 w_row{ vp[0][3], vp[1][3], vp[2][3], vp[3][3] };
+		std::array<Plane, 6> planes;
+		for (int i = 0; i < 6; ++i) {
+			const vec4 row{ vp[0][i / 2], vp[1][i / 2], vp[2][i / 2], vp[3][i / 2] };
+			// -w <= row <= w in clip space
+			const vec4 eq = i % 2 ? w_row + row : w_row - row;
+			const float len = glm::length(vec3{ eq });
+			planes[i].normal = vec3{ eq } / len;
+			planes[i].dot_result = -eq.w / len;
+		}
+		return Frustum(planes);
+	}
 };
 
 #endif // CAMERA_H
@@ -107,15 +107,27 @@ void Demo::update()
 				//o.set_vel(rand_acc);
 				
 				//o.update_physics(dt);
-
-				// update bvh
-				objects_bvh.remove_object(o);
-				objects_bvh.add_object(o);
 			}
 			TIMER_E(move_time);
 		}
 		for (auto& o : objects)
 			o.update_physics(dt);
+		// update bvh, same topology until it gets too bad
+		if (move_objects && objects_bvh.root() && objects_bvh.build_config().fat_leaves) {
+			// dynamic mode, reinsert only objects out of their fat box
+			TIMER_S(refit_time);
+			for (auto& o : objects)
+				objects_bvh.move_object(o);
+			TIMER_E(refit_time);
+		}
+		else if (move_objects && objects_bvh.root()) {
+			TIMER_S(refit_time);
+			objects_bvh.refit();
+			TIMER_E(refit_time);
+			// same objects, the ones taken out or added after the build stay as they are
+			if (objects_bvh.quality_ratio() > rebuild_quality_ratio)
+				objects_bvh.rebuild();
+		}
 
 	}
 
@@ -149,65 +161,26 @@ void Demo::update()
 			if (!keyboard.pressed(GLFW_KEY_LEFT_SHIFT))
 				selected.clear();
 
-			// traverse bvh
-			auto ray_check = [&](BVH::node* n) -> BVH::children_list {
-				BVH::children_list best_order{ nullptr };
-				std::array<float, best_order.size()> best_rays{ FLT_MAX };
-				std::array<int, best_order.size()> indices{ -1 };
-				int rays_hit = 0;
-				for (int i = 0; i < n->children.size(); ++i) {
-					indices[i] = i;
-					BVH::node* c = n->children[i];
-					if (c) {
-						float t = intersection_ray_aabb(mouse_ray, c->bounding_volume);
-						best_rays[i] = t;
-						if (t >= 0) {	// if hit
-							rays_hit++;
-						}
-					}
-				}
-				// sort by closest hit
-				std::sort(indices.begin(), indices.begin() + rays_hit, [&](int l, int r) -> bool {
-					return best_rays[l] < best_rays[r];
-				});
-				// order children
-				for (int i = 0; i < best_order.size(); ++i)
-					if(best_rays[indices[i]] >= 0.f)
-						best_order[i] = n->children[indices[i]];
-
-				return best_order;
-			};
+			// traverse bvh, the mesh test (if enabled) only runs on objects whose aabb is hit
 			TIMER_S(tree_find_time);
-			BVH::node* hit_node = objects_bvh.find(ray_check);
-			// is leaf
-			if (hit_node && hit_node->objects.empty() == false) {
+			bvh_ray_callback mesh_check = [&](Object& obj, float) {
+				const auto& positions = obj.get_mesh_data()->positions;
+				const auto& indices = obj.get_mesh_data()->indices;
+				return intersection_ray_mesh(mouse_ray, obj.get_model(), positions.data(), indices.data(), (tri_idx)indices.size());
+			};
+			const bvh_ray_hit hit = objects_bvh.raycast_closest(mouse_ray, FLT_MAX, ray_mesh_check ? mesh_check : nullptr);
+			if (hit.object) {
 				if (ray_mesh_check) {
-					Object& obj = *hit_node->objects[0];
-					// mesh check
-					const auto& positions = obj.get_mesh_data()->positions;
-					const auto& indices = obj.get_mesh_data()->indices;
-					const mat4& model = obj.get_model();
-					float ray_t = intersection_ray_mesh(mouse_ray, model, positions.data(), indices.data(), (tri_idx)indices.size());
-					if (ray_t >= 0.f) {
-						// push object
-						float force = 500;
-						if (mouse.pressed(1))
-							force *= -1;
-						ray_add_force(obj, mouse_ray, ray_t, force);
-						//assert(hit_node->objects.empty() == false);
-
-						// add to selected list (avoid duplicated)
-						auto it = std::find(selected.begin(), selected.end(), &obj);
-						if (it == selected.end())
-							selected.push_back(const_cast<Object*>(&obj));
-					}
-				}
-				else {
-					// add to selected list (avoid duplicated)
-					auto it = std::find(selected.begin(), selected.end(), hit_node->objects[0]);
-					if (it == selected.end())
-						selected.push_back(const_cast<Object*>(hit_node->objects[0]));
+					// push object
+					float force = 500;
+					if (mouse.pressed(1))
+						force *= -1;
+					ray_add_force(*hit.object, mouse_ray, hit.t, force);
 				}
+				// add to selected list (avoid duplicated)
+				auto it = std::find(selected.begin(), selected.end(), hit.object);
+				if (it == selected.end())
+					selected.push_back(hit.object);
 				TIMER_E(tree_find_time);
 			}
 			else {
@@ -329,8 +302,12 @@ void Demo::update()
 		}
 		// BOUNDING VOLUME HIERARCHY
 		if (ImGui::CollapsingHeader("BV HIERARCHY")) {
-			if (ImGui::Button("Clear"))
+			if (ImGui::Button("Clear")) {
 				objects_bvh.destroy();
+				objects_out_of_bvh.clear();
+				for (Object& o : objects)
+					objects_out_of_bvh.push_back(&o);
+			}
 			if (ImGui::Button("Bottom-up")) {
 				TIMER_S(bottom_up_time);
 				// destroy tree
@@ -341,6 +318,7 @@ void Demo::update()
 				for (Object& o : objects)
 					objs.push_back(&o);
 				objects_bvh.build_bottom_up(objs);
+				objects_out_of_bvh.clear();
 				TIMER_E(bottom_up_time);
 			}
 			ImGui::Text("Bottom Up Time = %f", bottom_up_time);
@@ -354,22 +332,78 @@ void Demo::update()
 				for (Object& o : objects)
 					objs.push_back(&o);
 				objects_bvh.build_top_down(objs);
+				objects_out_of_bvh.clear();
 				TIMER_E(top_down_time);
 			}
 			ImGui::Text("Top Down Time = %f", top_down_time);
+			if (ImGui::Button("Linear")) {
+				TIMER_S(linear_time);
+				// destroy tree
+				objects_bvh.destroy();
+				// allocate pointers
+				std::vector<Object*> objs;
+				objs.reserve(objects.size());
+				for (Object& o : objects)
+					objs.push_back(&o);
+				objects_bvh.build_linear(objs);
+				objects_out_of_bvh.clear();
+				TIMER_E(linear_time);
+			}
+			ImGui::Text("Linear Time = %f", linear_time);
+			const char* split_names[bvh_split_count] = { "Midpoint", "SAH" };
+			bvh_build_config& config = objects_bvh.build_config();
+			ImGui::Combo("Split", (int*)&config.split, split_names, bvh_split_count);
+			if (config.split == bvh_split_sah) {
+				ImGui::DragInt("Bins", &config.bin_count, 1, 2, 64);
+				ImGui::DragFloat("Traversal Cost", &config.traversal_cost, 0.1f, 0.f, 100.f);
+				ImGui::DragFloat("Intersection Cost", &config.intersection_cost, 0.1f, 0.f, 100.f);
+			}
+			ImGui::DragInt("Search Radius", &config.search_radius, 1, 1, 256);
+			ImGui::DragInt("Parallel Threshold", &config.parallel_threshold, 64.f, 0, 1 << 20);
+			bool morton_63 = config.morton_bits > 30;
+			if (ImGui::Checkbox("63-bit Morton Codes", &morton_63))
+				config.morton_bits = morton_63 ? 63 : 30;
+			ImGui::Text("SAH Cost = %f", objects_bvh.sah_cost());
+			ImGui::Text("Refit Time = %f", refit_time);
+			ImGui::Text("Quality Ratio = %f", objects_bvh.quality_ratio());
+			ImGui::DragFloat("Rebuild Above", &rebuild_quality_ratio, 0.01f, 1.f, 10.f);
+			ImGui::DragInt("Max Leaf Size", &config.max_leaf_size, 1, 1, 64);
+			const char* insertion_names[bvh_insertion_count] = { "Greedy", "Branch and Bound" };
+			ImGui::Combo("Insertion", (int*)&config.insertion, insertion_names, bvh_insertion_count);
+			ImGui::Checkbox("Rotations", &config.rotations);
+			ImGui::DragInt("Optimize Budget", &optimize_budget, 16.f, 1, 1 << 20);
+			if (ImGui::Button("Optimize"))
+				objects_bvh.optimize((u32)optimize_budget);
+			ImGui::Checkbox("Fat Leaves", &config.fat_leaves);
+			if (config.fat_leaves) {
+				ImGui::DragFloat("Fat Margin", &config.fat_margin, 0.01f, 0.f, 10.f);
+				ImGui::DragFloat("Fat Prediction", &config.fat_prediction, 0.01f, 0.f, 2.f);
+				const bvh_counters& counters = objects_bvh.counters();
+				ImGui::Text("Reinsertions = %llu / %llu (%f)", counters.reinsertions, counters.moves, counters.reinsertion_rate());
+				if (ImGui::Button("Reset Counters"))
+					objects_bvh.reset_counters();
+			}
+			ImGui::Checkbox("Frustum Culling", &frustum_culling);
+			ImGui::Text("Visible = %d / %d", (int)visible.size(), (int)objects.size());
+			ImGui::Text("Plane Tests = %llu (%llu cached rejections)", frustum_cache.stats.plane_tests, frustum_cache.stats.cached_rejections);
 			// add selected to BVH
 			if (!selected.empty()) {
 				if (ImGui::Button("Add to BVH")) {
-					for(auto o : selected)
-						objects_bvh.add_object(*o);
+					for (auto o : selected) {
+						if (!objects_bvh.contains(*o)) {
+							objects_bvh.add_object(*o);
+							erase_out_of_bvh(o);
+						}
+					}
 				}
 				if (ImGui::Button("Remove from BVH")) {
-					for(auto o : selected)
-						objects_bvh.remove_object(*o);
+					for (auto o : selected)
+						if (objects_bvh.remove_object(*o))
+							objects_out_of_bvh.push_back(o);
 				}
 			}
 			auto set_draw_node = [&](const BVH::node& n) {
-				n.draw_bv = draw_hierarchy;
+				objects_bvh.draw_bv(n) = draw_hierarchy;
 			};
 			if (ImGui::Checkbox("Draw BVH", &draw_hierarchy)) {
 				objects_bvh.traverse_preorder(set_draw_node);
@@ -384,18 +418,20 @@ void Demo::update()
 					Color c;
 					if (&n == objects_bvh.root())
 						c = Color{ 0x4444ffff };
-					else if (n.objects.empty())
+					else if (!n.is_leaf())
 						c = Color{ 0xff0000ff };
 					else
 						c = Color{ 0x00ff00ff };
 					ImGui::PushStyleColor(ImGuiCol_Text, (u32)c);
 					std::string obj_name;
-					if (n.objects.size() == 1)
-						obj_name = n.objects[0]->get_name();
+					if (n.count == 1)
+						obj_name = objects_bvh.object(n)->get_name();
+					else if (n.count > 1)
+						obj_name = std::to_string(n.count) + " objects";
 					if (ImGui::TreeNode(std::to_string(node_number).c_str(), "Node %d %s", node_number, obj_name.c_str())){
 						ImGui::Text("AABB MIN = %10.3f,%10.3f,%10.3f", n.bounding_volume.min_point.x, n.bounding_volume.min_point.y, n.bounding_volume.min_point.z);
 						ImGui::Text("AABB MAX = %10.3f,%10.3f,%10.3f", n.bounding_volume.max_point.x, n.bounding_volume.max_point.y, n.bounding_volume.max_point.z);
-						ImGui::Checkbox("Draw", &n.draw_bv);
+						ImGui::Checkbox("Draw", &objects_bvh.draw_bv(n));
 						ImGui::TreePop();
 					}
 					ImGui::PopStyleColor();
@@ -546,10 +582,8 @@ void Demo::update()
 					ImGui::Checkbox("Draw Bounding Volume", &o.draw_bv);
 
 					// Update BVH
-					if (update_bvh) {
-						objects_bvh.remove_object(o);
-						objects_bvh.add_object(o);
-					}
+					if (update_bvh)
+						objects_bvh.update_object(o);
 
 					ImGui::TreePop();
 				}
@@ -591,8 +625,21 @@ void Demo::render()
 	int uniform_mvp = glGetUniformLocation(graphics.shader_program[sh_color], "MVP");
 	
 	pop_gl_errors("Setup Render");
-	
-	for (Object & o : objects) {
+
+	// only what the camera sees of the tree, objects out of it (created after the build or removed from it)
+	// are always drawn
+	visible.clear();
+	frustum_cache.stats = frustum_cull_stats{};
+	if (frustum_culling && objects_bvh.root()) {
+		objects_bvh.query_frustum(camera.get_frustum(), [this](Object& o) { visible.push_back(&o); }, frustum_cache);
+		visible.insert(visible.end(), objects_out_of_bvh.begin(), objects_out_of_bvh.end());
+	}
+	else {
+		for (Object& o : objects)
+			visible.push_back(&o);
+	}
+	for (Object* visible_obj : visible) {
+		Object& o = *visible_obj;
 		if (o.get_mesh_buffers() == nullptr && o.get_mesh_data() == nullptr)
 			continue;
 		mat4 mvp = vp * o.get_model();
@@ -639,12 +686,12 @@ void Demo::render()
 	}
 
 	auto draw_bvh_node = [&, vp](const bounding_volume_hierarchy::node& n){
-		if (n.draw_bv) {
+		if (objects_bvh.draw_bv(n)) {
 			// pick color
 			Color c;
 			if (&n == objects_bvh.root())
 				c = Color{ 0x0000ffff };
-			else if (n.objects.empty())
+			else if (!n.is_leaf())
 				c = Color{ 0xff0000ff };
 			else
 				c = Color{ 0x00ff00ff };
@@ -697,6 +744,7 @@ void Demo::add_object()
 	o.set_mesh_buffers(&mesh_buffer[mesh_cube]);
 
 	objects.emplace_back(std::move(o));
+	objects_out_of_bvh.push_back(&objects.back());
 
 }
 
@@ -717,6 +765,7 @@ void Demo::add_random_object(int MIN, int MAX)
 	o.set_mesh_buffers(&mesh_buffer[rand_mesh_type]);
 
 	objects.emplace_back(std::move(o));
+	objects_out_of_bvh.push_back(&objects.back());
 }
 
 MeshType Demo::get_type(const MeshData* md) const {
@@ -732,7 +781,8 @@ void Demo::remove_object(Object& obj)
 	if (it != selected.end())
 		selected.erase(it);
 	// delete from bvh
-	objects_bvh.remove_object(obj);
+	if (!objects_bvh.remove_object(obj))
+		erase_out_of_bvh(&obj);
 	// delete from scene
 	auto obj_it = std::find(objects.begin(), objects.end(), obj);
 	objects.erase(obj_it);
@@ -740,13 +790,14 @@ void Demo::remove_object(Object& obj)
 void Demo::remove_last_object()
 {
 	// get obj to delete
-	const Object& to_delete = objects.back();
+	Object& to_delete = objects.back();
 	// delete from selected
 	auto it = std::find(selected.begin(), selected.end(), &to_delete);
 	if (it != selected.end())
 		selected.erase(it);
 	// delete from bvh
-	objects_bvh.remove_object(to_delete);
+	if (!objects_bvh.remove_object(to_delete))
+		erase_out_of_bvh(&to_delete);
 	// delete from scene
 	objects.pop_back();
 }
@@ -758,13 +809,23 @@ void Demo::remove_selected_object(int select_idx)
 	// delete from selected
 	selected.erase(selected.begin() + select_idx);
 	// delete from bvh
-	objects_bvh.remove_object(*obj_to_delete);
+	if (!objects_bvh.remove_object(*obj_to_delete))
+		erase_out_of_bvh(obj_to_delete);
 	// delete from scene (find pointer)
 	auto it = std::find_if(objects.begin(), objects.end(), [obj_to_delete](const Object& obj) -> bool { return obj_to_delete == &obj; });
 	if (it != objects.end())
 		objects.erase(it);
 }
 
+void Demo::erase_out_of_bvh(Object* obj)
+{
+	auto it = std::find(objects_out_of_bvh.begin(), objects_out_of_bvh.end(), obj);
+	if (it == objects_out_of_bvh.end())
+		return;
+	*it = objects_out_of_bvh.back();
+	objects_out_of_bvh.pop_back();
+}
+
 void Demo::ray_add_force(Object& obj, const Ray& ray, float t, float force) {
 	// get contact point
 	vec3 p = ray.start + ray.dir * t;
@@ -47,6 +47,7 @@ struct Demo
 	void remove_object(Object& obj);
 	void remove_last_object();
 	void remove_selected_object(int select_idx);
+	void erase_out_of_bvh(Object* obj);	// obj went into the bvh or out of the scene
 
 	void ray_add_force(Object& obj, const Ray& ray, float t, float force = 1.f);
 
@@ -57,8 +58,12 @@ private:
 	double move_time = 0.0;
 	TimeInterval timer;
 	bounding_volume_hierarchy objects_bvh;
+	std::vector<Object*> objects_out_of_bvh;	// not in objects_bvh (always drawn), kept by every add/remove
 	bool draw_hierarchy = true;
 	bool ray_mesh_check = true;
+	bool frustum_culling = true;
+	std::vector<Object*> visible;	// last render, kept to avoid allocations
+	bvh_frustum_cache frustum_cache;	// plane that culled each node last frame
 
 	ImGuizmo::OPERATION guizmo_operation = ImGuizmo::OPERATION::TRANSLATE;
 
@@ -72,6 +77,11 @@ private:
 	double raycast_collision_time = 0.0;
 	double bottom_up_time = 0.0;
 	double top_down_time = 0.0;
+	double linear_time = 0.0;
+	double refit_time = 0.0;
+	// rebuild the moving bvh when refits make it this much worse than the last build
+	float rebuild_quality_ratio = 1.5f;
+	int optimize_budget = 1024;	// nodes looked at by every optimize click
 
 	// object picking / selection
 	std::vector<Object*> selected;
@@ -84,6 +84,16 @@ vec3 project_point_plane(const vec3& p, const Plane& pl) {
 }
 /**
 *
+* @param p
+* @param ab
+* @return squared distance to the closest point of ab, 0 if inside
+*/
+float distance2_point_aabb(const vec3& p, const AABB& ab) {
+	vec3 d = glm::max(glm::max(ab.min_point - p, p - ab.max_point), vec3{ 0.f });
+	return glm::dot(d, d);
+}
+/**
+*
 * @param point_a
 * @param point_b
 * @param p
@@ -260,6 +270,69 @@ float intersection_ray_aabb(const Ray& r, const AABB& ab) {
 }
 /**
 *
+* @brief slab test of the three axes at once
+* @param r
+* @param ab
+* @param t_enter	max(entry, 0)
+* @param t_exit
+* @return true if hit
+*/
+bool intersection_ray_aabb(const RayQuery& r, const AABB& ab, float& t_enter, float& t_exit) {
+	// min and max without reading past the aabb, w lanes get zero distances
+	const __m128 lo = _mm_loadu_ps(&ab.min_point.x);	// min.x min.y min.z max.x
+	__m128 hi = _mm_loadu_ps(&ab.min_point.z);			// min.z max.x max.y max.z
+	hi = _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(0, 3, 2, 1));
+	const __m128 t0 = _mm_mul_ps(_mm_sub_ps(lo, r.origin), r.inv_dir);
+	const __m128 t1 = _mm_mul_ps(_mm_sub_ps(hi, r.origin), r.inv_dir);
+	// w of the entry is 0 (clamps behind the start), w of the exit is ignored
+	__m128 t_near = _mm_min_ps(t0, t1);
+	__m128 t_far = _mm_max_ps(_mm_max_ps(t0, t1), _mm_setr_ps(-FLT_MAX, -FLT_MAX, -FLT_MAX, FLT_MAX));
+	t_near = _mm_max_ps(t_near, _mm_shuffle_ps(t_near, t_near, _MM_SHUFFLE(2, 3, 0, 1)));
+	t_near = _mm_max_ps(t_near, _mm_shuffle_ps(t_near, t_near, _MM_SHUFFLE(1, 0, 3, 2)));
+	t_far = _mm_min_ps(t_far, _mm_shuffle_ps(t_far, t_far, _MM_SHUFFLE(2, 3, 0, 1)));
+	t_far = _mm_min_ps(t_far, _mm_shuffle_ps(t_far, t_far, _MM_SHUFFLE(1, 0, 3, 2)));
+	t_enter = _mm_cvtss_f32(t_near);
+	t_exit = _mm_cvtss_f32(t_far);
+	return t_enter <= t_exit;
+}
+/**
+*
+* @param r
+* @param ab
+* @return same as with a Ray
+*/
+float intersection_ray_aabb(const RayQuery& r, const AABB& ab) {
+	float t_enter, t_exit;
+	return intersection_ray_aabb(r, ab, t_enter, t_exit) ? t_enter : -1.f;
+}
+/**
+*
+* @brief slab test of WIDTH rays against one box
+* @param p
+* @param ab
+* @param t_max		WIDTH aligned floats, farther hits are misses (negative disables a lane)
+* @param t_enter	WIDTH aligned floats, entry distances (0 if the start is inside)
+* @return lanes hit
+*/
+template<u32 WIDTH>
+u32 intersection_ray_packet_aabb(const RayPacket<WIDTH>& p, const AABB& ab, const float* t_max, float* t_enter) {
+	using S = simd<WIDTH>;
+	auto t_near = S::set(0.f);
+	auto t_far = S::load(t_max);
+	for (int a = 0; a < 3; ++a) {
+		const auto origin = S::load(p.origin[a]), inv_dir = S::load(p.inv_dir[a]);
+		const auto t0 = S::mul(S::sub(S::set(ab.min_point[a]), origin), inv_dir);
+		const auto t1 = S::mul(S::sub(S::set(ab.max_point[a]), origin), inv_dir);
+		t_near = S::max(t_near, S::min(t0, t1));
+		t_far = S::min(t_far, S::max(t0, t1));
+	}
+	S::store(t_enter, t_near);
+	return S::mask(S::le(t_near, t_far)) & p.active;
+}
+template u32 intersection_ray_packet_aabb<4>(const RayPacket<4>& p, const AABB& ab, const float* t_max, float* t_enter);
+template u32 intersection_ray_packet_aabb<8>(const RayPacket<8>& p, const AABB& ab, const float* t_max, float* t_enter);
+/**
+*
 * @param r
 * @param ab
 * @param m
@@ -279,9 +352,10 @@ float intersection_ray_obb(const Ray& r, const AABB& ab, const mat4 &m) {
 * @param p_count
 * @param indices
 * @param i_count
+* @param triangle	closest triangle hit (optional)
 * @return
 */
-float intersection_ray_mesh(const Ray& r, const mat4& model_mtx, const vec3* points, const tri_idx* indices, tri_idx i_count) {
+float intersection_ray_mesh(const Ray& r, const mat4& model_mtx, const vec3* points, const tri_idx* indices, tri_idx i_count, u32* triangle) {
 	float closest_t = FLT_MAX;
 	// brutefoce traverse every triangle
 	for (tri_idx i = 0; i < i_count; i += 3) {
@@ -294,6 +368,8 @@ float intersection_ray_mesh(const Ray& r, const mat4& model_mtx, const vec3* poi
 		float t = intersection_ray_triangle(r, tri);
 		if (t >= 0.f && closest_t > t) {
 			closest_t = t;
+			if (triangle)
+				*triangle = i / 3;
 		}
 	}
 	if (closest_t == FLT_MAX)
@@ -344,26 +420,25 @@ intersection_type intersection_plane_sphere(const Plane& pl, const Sphere& sph)
 }
 /**
 *
+* @brief only the corners farthest along (p-vertex) and against (n-vertex) the normal decide,
+*	their distances are the same the 8 corners would give
 * @param pl
 * @param ab
 * @return
 */
 intersection_type intersection_plane_aabb(const Plane& pl, const AABB& ab) {
-	const vec3& MAX = ab.max_point;
-	const vec3& MIN = ab.min_point;
-	vec3 p[8] = {	MAX, {MAX.x, MIN.y, MAX.z}, {MAX.x, MIN.y, MIN.z}, {MAX.x, MAX.y, MIN.z},
-					MIN, {MIN.x, MAX.y, MIN.z}, {MIN.x, MAX.y, MAX.z}, {MIN.x, MIN.y, MAX.z} };
-	//check foreach point, but first set the intersection_type with the first point
-	intersection_type prev_result = intersection_point_plane(p[0], pl, cEpsilon);
-	if (prev_result == intersection_type::OVERLAPS)
-		return prev_result;
-	for (int i = 1; i < 8; ++i) {
-		intersection_type result = intersection_point_plane(p[i], pl, cEpsilon);
-		if (result != prev_result)
-			return intersection_type::OVERLAPS;
-		prev_result = result;
+	const vec3 pl_p = pl.get_point();
+	vec3 p_vertex, n_vertex;
+	for (int a = 0; a < 3; ++a) {
+		p_vertex[a] = pl.normal[a] >= 0.f ? ab.max_point[a] : ab.min_point[a];
+		n_vertex[a] = pl.normal[a] >= 0.f ? ab.min_point[a] : ab.max_point[a];
 	}
-	return prev_result;
+	// every corner outside or every corner inside
+	if (glm::dot(p_vertex - pl_p, pl.normal) <= -cEpsilon)
+		return intersection_type::OUTSIDE;
+	if (glm::dot(n_vertex - pl_p, pl.normal) >= cEpsilon)
+		return intersection_type::INSIDE;
+	return intersection_type::OVERLAPS;
 }
 /**
 *
@@ -503,6 +578,120 @@ intersection_type intersection_frustum_aabb(const Frustum& f, const AABB& ab) {
 /**
 *
 * @param f
+* @param ab
+* @return same as with a Frustum
+*/
+intersection_type intersection_frustum_aabb(const FrustumQuery& f, const AABB& ab) {
+	u32 planes = (1u << 6) - 1;
+	return intersection_frustum_aabb(f, ab, planes);
+}
+/**
+*
+* @brief p/n-vertex test of the six planes at once. The distance terms of the farthest (nearest)
+*	corner are the max (min) of the two faces on each axis, same distances as the 8 corners
+* @param f
+* @param ab
+* @param planes	bit i for plane i, the planes ab is fully in front of are cleared (if OUTSIDE, the planes ab is behind)
+* @return OUTSIDE if behind one of the planes, INSIDE if no plane is left, OVERLAPS otherwise
+*/
+intersection_type intersection_frustum_aabb(const FrustumQuery& f, const AABB& ab, u32& planes) {
+	if (!planes)
+		return INSIDE;
+	using S = simd<8>;
+	auto d_far = S::set(0.f), d_near = S::set(0.f);
+	for (int a = 0; a < 3; ++a) {
+		const auto normal = S::load(f.normal[a]), point = S::load(f.point[a]);
+		const auto t0 = S::mul(S::sub(S::set(ab.min_point[a]), point), normal);
+		const auto t1 = S::mul(S::sub(S::set(ab.max_point[a]), point), normal);
+		d_far = S::add(d_far, S::max(t0, t1));
+		d_near = S::add(d_near, S::min(t0, t1));
+	}
+	if (const u32 behind = S::mask(S::le(d_far, S::set(-cEpsilon))) & planes) {
+		planes = behind;
+		return OUTSIDE;
+	}
+	planes &= ~S::mask(S::le(S::set(cEpsilon), d_near));
+	return planes ? OVERLAPS : INSIDE;
+}
+/**
+*
+* @brief the other planes are only tested if the cached one does not cull ab
+* @param f
+* @param ab
+* @param last_plane	plane tested first, set to the one that culls ab (cNoPlane if none)
+* @param stats		optional
+* @return same as without the cache
+*/
+intersection_type intersection_frustum_aabb(const Frustum& f, const AABB& ab, u8& last_plane, frustum_cull_stats* stats) {
+	const int first = last_plane < cNoPlane ? last_plane : 0;
+	int result_flag = 0;
+	for (int k = 0; k < 6; ++k) {
+		const int i = (first + k) % 6;
+		intersection_type result = intersection_plane_aabb(f.planes[i], ab);
+		if (stats)
+			stats->plane_tests++;
+		if (result == OUTSIDE) {
+			if (stats && k == 0)
+				stats->cached_rejections++;
+			last_plane = (u8)i;
+			return OUTSIDE;
+		}
+		result_flag |= (int)result;
+	}
+	last_plane = cNoPlane;
+	return result_flag == INSIDE ? INSIDE : OVERLAPS;
+}
+/**
+*
+* @brief scalar test of the cached plane, then the six planes at once if it does not cull ab.
+*	Boxes that were not culled last time go straight to the six planes
+* @param f
+* @param ab
+* @param planes		as without the cache
+* @param last_plane	plane tested first, set to the one that culls ab (cNoPlane if none)
+* @param stats		optional
+* @return same as without the cache
+*/
+intersection_type intersection_frustum_aabb(const FrustumQuery& f, const AABB& ab, u32& planes, u8& last_plane, frustum_cull_stats* stats) {
+	if (!planes)
+		return INSIDE;
+	if (last_plane < cNoPlane && planes >> last_plane & 1) {
+		// same distance as the lane of the plane
+		float d = 0.f;
+		for (int a = 0; a < 3; ++a) {
+			const float t0 = (ab.min_point[a] - f.point[a][last_plane]) * f.normal[a][last_plane];
+			const float t1 = (ab.max_point[a] - f.point[a][last_plane]) * f.normal[a][last_plane];
+			d += glm::max(t0, t1);
+		}
+		if (stats)
+			stats->plane_tests++;
+		if (d <= -cEpsilon) {
+			if (stats)
+				stats->cached_rejections++;
+			planes = 1u << last_plane;
+			return OUTSIDE;
+		}
+	}
+	if (stats)
+		stats->plane_tests += glm::bitCount(planes);
+	intersection_type result = intersection_frustum_aabb(f, ab, planes);
+	last_plane = result == OUTSIDE ? (u8)glm::findLSB(planes) : cNoPlane;
+	return result;
+}
+/**
+*
+* @param f
+* @param boxes
+* @param count
+* @param results	results[i] for boxes[i]
+*/
+void intersection_frustum_aabb(const FrustumQuery& f, const AABB* boxes, size_t count, intersection_type* results) {
+	for (size_t i = 0; i < count; ++i)
+		results[i] = intersection_frustum_aabb(f, boxes[i]);
+}
+/**
+*
+* @param f
 * @param sph
 * @return
 */
@@ -524,6 +713,34 @@ intersection_type intersection_frustum_sphere(const Frustum& f, const Sphere& sp
 }
 /**
 *
+* @brief the other planes are only tested if the cached one does not cull sph
+* @param f
+* @param sph
+* @param last_plane	plane tested first, set to the one that culls sph (cNoPlane if none)
+* @param stats		optional
+* @return same as without the cache
+*/
+intersection_type intersection_frustum_sphere(const Frustum& f, const Sphere& sph, u8& last_plane, frustum_cull_stats* stats) {
+	const int first = last_plane < cNoPlane ? last_plane : 0;
+	int result_flag = 0;
+	for (int k = 0; k < 6; ++k) {
+		const int i = (first + k) % 6;
+		intersection_type result = intersection_plane_sphere(f.planes[i], sph);
+		if (stats)
+			stats->plane_tests++;
+		if (result == OUTSIDE) {
+			if (stats && k == 0)
+				stats->cached_rejections++;
+			last_plane = (u8)i;
+			return OUTSIDE;
+		}
+		result_flag |= (int)result;
+	}
+	last_plane = cNoPlane;
+	return result_flag == INSIDE ? INSIDE : OVERLAPS;
+}
+/**
+*
 * @param s0
 * @param s1
 * @return
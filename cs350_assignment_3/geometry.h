@@ -12,26 +12,44 @@
 
 
 enum intersection_type { INSIDE = 1, OUTSIDE = 2, OVERLAPS = 4, COPLANAR = 8 };
+// frustum culling with a cached plane, reset every frame to get the tests per frame
+struct frustum_cull_stats {
+	u64 plane_tests = 0;		// one box or sphere against one plane (a SIMD test counts its planes)
+	u64 cached_rejections = 0;	// culled by the cached plane alone
+};
+constexpr u8 cNoPlane = 6;	// last_plane of a box or sphere that was not culled
 
 intersection_type intersection_point_aabb(const vec3& p, const AABB& ab);
 intersection_type intersection_point_obb(const vec3& p, const AABB& ab, const mat4& m);
 intersection_type intersection_point_sphere(const vec3& p, const Sphere& sph);
 intersection_type intersection_point_plane(const vec3& p, const Plane& pl, float epsilon = FLT_EPSILON);
 vec3 project_point_plane(const vec3& p, const Plane& pl);
+float distance2_point_aabb(const vec3& p, const AABB& ab);	// squared, 0 if p is inside
 bool get_barycentric_coordinates(const vec3& point_a, const vec3& point_b, const vec3& p, vec2* barycentric_coord);	// line coordinates
 bool get_barycentric_coordinates(const Triangle& tri, const vec3& p, vec3* barycentric_coord);						// triangle coordinates
 float intersection_ray_plane(const Ray& r, const Plane& pl);
 float intersection_ray_triangle(const Ray& r, const Triangle& tri);
 float intersection_ray_sphere(const Ray& r, const Sphere& sph);
 float intersection_ray_aabb(const Ray& r, const AABB& ab);
+float intersection_ray_aabb(const RayQuery& r, const AABB& ab);	// same result, no branches
+bool intersection_ray_aabb(const RayQuery& r, const AABB& ab, float& t_enter, float& t_exit);	// t_enter is 0 if the start is inside
+template<u32 WIDTH>	// mask of the lanes hitting ab before their t_max, t_enter as the RayQuery version
+u32 intersection_ray_packet_aabb(const RayPacket<WIDTH>& p, const AABB& ab, const float* t_max, float* t_enter);
 float intersection_ray_obb(const Ray& r, const AABB& ab, const mat4 &m);
-float intersection_ray_mesh(const Ray& r, const mat4& model_mtx, const vec3* points, const tri_idx* indices, tri_idx i_count);
+float intersection_ray_mesh(const Ray& r, const mat4& model_mtx, const vec3* points, const tri_idx* indices, tri_idx i_count, u32* triangle = nullptr);	// triangle hit (first index / 3)
 intersection_type intersection_plane_triangle(const Plane& pl, const Triangle& tri, float epsilon = FLT_EPSILON);
 intersection_type intersection_plane_sphere(const Plane& pl, const Sphere& sph);
 intersection_type intersection_plane_aabb(const Plane& pl, const AABB& ab);
 intersection_type intersection_frustum_triangle(const Frustum& f, const Triangle& tri);
 intersection_type intersection_frustum_aabb(const Frustum& f, const AABB& ab);
+intersection_type intersection_frustum_aabb(const FrustumQuery& f, const AABB& ab);	// same result, six planes at once
+intersection_type intersection_frustum_aabb(const FrustumQuery& f, const AABB& ab, u32& planes);	// only the planes in the mask, clears the ones ab is fully inside
+// temporal coherence, last_plane is tested first and set to the plane that culls or cNoPlane (same results)
+intersection_type intersection_frustum_aabb(const Frustum& f, const AABB& ab, u8& last_plane, frustum_cull_stats* stats = nullptr);
+intersection_type intersection_frustum_aabb(const FrustumQuery& f, const AABB& ab, u32& planes, u8& last_plane, frustum_cull_stats* stats = nullptr);
+void intersection_frustum_aabb(const FrustumQuery& f, const AABB* boxes, size_t count, intersection_type* results);
 intersection_type intersection_frustum_sphere(const Frustum& f, const Sphere& sph);
+intersection_type intersection_frustum_sphere(const Frustum& f, const Sphere& sph, u8& last_plane, frustum_cull_stats* stats = nullptr);
 bool intersection_sphere_sphere(const Sphere& s0, const Sphere& s1);
 bool intersection_aabb_aabb(const AABB& ab0, const AABB& ab1);
 
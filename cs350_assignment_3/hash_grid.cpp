@@ -0,0 +1,504 @@
+/**
+* @file hash_grid.cpp
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Implement hierarchical spatial hash grid
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#include "pch.h"
+
+namespace {
+	/**
+	*
+	* @param ab0
+	* @param ab1
+	* @return true if they overlap or touch
+	*/
+	inline bool overlap_aabb(const AABB& ab0, const AABB& ab1)
+	{
+		return glm::all(glm::lessThanEqual(ab0.min_point, ab1.max_point)) && glm::all(glm::lessThanEqual(ab1.min_point, ab0.max_point));
+	}
+}
+
+/**
+*
+* @param ab
+* @return
+*/
+float hash_grid::extent(const AABB& ab) const
+{
+	const vec3 size = ab.max_point - ab.min_point;
+	return glm::max(size.x, glm::max(m_config.columns ? 0.f : size.y, size.z));
+}
+/**
+*
+* @brief smallest level whose cells are not smaller than ab, min corner cell
+* @param ab
+* @param e
+*/
+void hash_grid::place(const AABB& ab, entry& e) const
+{
+	const u32 last = (u32)glm::clamp(m_config.level_count, 1, max_levels) - 1;
+	const float size = extent(ab);
+	u32 level = 0;
+	while (level < last && cell_size(level) < size)
+		level++;
+	e.level = level;
+	e.cell = cell_of(ab.min_point, cell_size(level));
+}
+/**
+*
+* @param level	m_level_count not counting ab yet if it is new to the level
+* @param ab
+*/
+void hash_grid::grow_level(u32 level, const AABB& ab)
+{
+	AABB& b = m_level_bounds[level];
+	if (m_level_count[level] == 0)
+		b = ab;
+	b = AABB{ glm::min(b.min_point, ab.min_point), glm::max(b.max_point, ab.max_point) };
+	m_level_extent[level] = glm::max(m_level_extent[level], extent(ab));
+}
+/**
+*
+* @param level
+* @param cell
+* @return
+*/
+u32 hash_grid::bucket(u32 level, const ivec3& cell) const
+{
+	u32 h = (u32)cell.x * 73856093u ^ (u32)cell.y * 19349663u ^ (u32)cell.z * 83492791u ^ level * 2654435761u;
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	return h & ((u32)m_buckets.size() - 1);
+}
+/**
+*
+* @param handle	pushed at the front of its bucket
+*/
+void hash_grid::link(u32 handle)
+{
+	entry& e = m_entries[handle];
+	u32& head = m_buckets[bucket(e.level, e.cell)];
+	e.prev = invalid_index;
+	e.next = head;
+	if (head != invalid_index)
+		m_entries[head].prev = handle;
+	head = handle;
+}
+/**
+*
+* @param handle
+*/
+void hash_grid::unlink(u32 handle)
+{
+	entry& e = m_entries[handle];
+	if (e.prev != invalid_index)
+		m_entries[e.prev].next = e.next;
+	else
+		m_buckets[bucket(e.level, e.cell)] = e.next;
+	if (e.next != invalid_index)
+		m_entries[e.next].prev = e.prev;
+}
+/**
+*
+* @brief twice the buckets, every object is linked again
+*/
+void hash_grid::grow()
+{
+	m_buckets.assign(glm::max((size_t)64, 2 * m_buckets.size()), invalid_index);
+	for (u32 h = 0; h < (u32)m_objects.size(); ++h)
+		if (m_objects[h])
+			link(h);
+}
+/**
+*
+* @param level
+* @param lo
+* @param hi
+* @param fn
+*/
+template<typename FN>
+void hash_grid::visit_cells(u32 level, const ivec3& lo, const ivec3& hi, FN& fn) const
+{
+	ivec3 c;
+	for (c.z = lo.z; c.z <= hi.z; ++c.z) {
+		for (c.y = lo.y; c.y <= hi.y; ++c.y) {
+			for (c.x = lo.x; c.x <= hi.x; ++c.x) {
+				// other cells may share the bucket
+				for (u32 h = m_buckets[bucket(level, c)]; h != invalid_index; h = m_entries[h].next) {
+					const entry& e = m_entries[h];
+					if (e.level == level && e.cell == c)
+						fn(h);
+				}
+			}
+		}
+	}
+}
+/**
+*
+* @param level
+* @param fn
+*/
+template<typename FN>
+void hash_grid::visit_level(u32 level, FN& fn) const
+{
+	for (u32 h = 0; h < (u32)m_objects.size(); ++h)
+		if (m_objects[h] && m_entries[h].level == level)
+			fn(h);
+}
+/**
+*
+* @brief min corners of the objects of a level overlapping ab are in [ab.min - level extent, ab.max],
+*	and every min corner is inside the level bounds. The cell count is computed in 64 bits, huge boxes scan
+* @param level
+* @param ab
+* @param fn
+*/
+template<typename FN>
+void hash_grid::visit_range(u32 level, const AABB& ab, FN& fn) const
+{
+	const AABB& bounds = m_level_bounds[level];
+	const vec3 min = glm::max(ab.min_point - m_level_extent[level], bounds.min_point);
+	const vec3 max = glm::min(ab.max_point, bounds.max_point);
+	if (glm::any(glm::greaterThan(min, max)))
+		return;
+	const float s = cell_size(level);
+	const ivec3 lo = cell_of(min, s);
+	const ivec3 hi = cell_of(max, s);
+	u64 cells = 1;
+	for (int k = 0; k < 3; ++k)
+		cells *= (u64)((long long)hi[k] - (long long)lo[k] + 1);
+	if (cells > (u64)m_objects.size()) {
+		visit_level(level, fn);
+		return;
+	}
+	visit_cells(level, lo, hi, fn);
+}
+/**
+*
+* @param ab
+* @param emit
+*/
+template<typename EMIT>
+void hash_grid::query(const AABB& ab, EMIT& emit) const
+{
+	auto test = [this, &ab, &emit](u32 h) {
+		if (overlap_aabb(m_entries[h].aabb, ab))
+			emit(h);
+	};
+	for (u32 l = 0; l < (u32)max_levels; ++l)
+		if (m_level_count[l])
+			visit_range(l, ab, test);
+}
+/**
+*
+* @brief objects of lower levels find a when they query, objects of its level are split by handle
+* @param a
+* @param emit
+*/
+template<typename EMIT>
+void hash_grid::pairs(u32 a, EMIT& emit) const
+{
+	const entry& ea = m_entries[a];
+	for (u32 l = ea.level; l < (u32)max_levels; ++l) {
+		if (!m_level_count[l])
+			continue;
+		auto test = [this, &ea, &emit, a, l](u32 h) {
+			if ((l == ea.level && h <= a) || !overlap_aabb(m_entries[h].aabb, ea.aabb))
+				return;
+			emit(h);
+		};
+		visit_range(l, ea.aabb, test);
+	}
+}
+/**
+*
+* @brief one 3D-DDA walk per level inside the level bounds, an object reaches at most `reach` cells past the cell
+*	of its min corner. A level stops when the next cell starts after the closest hit so far
+* @param r
+* @param t_max
+* @param narrow	optional
+* @return
+*/
+template<bool ANY>
+bvh_ray_hit hash_grid::raycast(const Ray& r, float t_max, const bvh_ray_callback& narrow) const
+{
+	bvh_ray_hit result;
+	if (empty())
+		return result;
+	const RayQuery q(r);
+	float t_enter, t_exit;
+	if (!intersection_ray_aabb(q, m_bounds, t_enter, t_exit) || t_enter > t_max)
+		return result;
+	bool done = false;
+	auto test = [this, &q, &narrow, &result, &t_max, &done](u32 h) {
+		float t = intersection_ray_aabb(q, m_entries[h].aabb);
+		if (done || t < 0.f || t > t_max)
+			return;
+		if (narrow) {
+			t = narrow(*m_objects[h], t_max);
+			if (t < 0.f || t > t_max)
+				return;
+		}
+		result = { m_objects[h], t, ~0u };
+		t_max = t;
+		done = ANY;
+	};
+	for (u32 l = 0; l < (u32)max_levels && !done; ++l) {
+		if (!m_level_count[l] || !intersection_ray_aabb(q, m_level_bounds[l], t_enter, t_exit) || t_enter > t_max)
+			continue;
+		const float s = cell_size(l);
+		// a window of more cells than objects (huge objects in the level) costs more than a scan at every step
+		const float reach = glm::ceil(m_level_extent[l] / s);
+		if ((reach + 1.f) * (reach + 1.f) * (m_config.columns ? 1.f : reach + 1.f) > (float)m_objects.size()) {
+			visit_level(l, test);
+			continue;
+		}
+		const vec3 p = r.start + r.dir * t_enter;
+		ivec3 cell = cell_of(p, s);
+		ivec3 step{ 0 };
+		vec3 t_next{ FLT_MAX }, t_delta{ FLT_MAX };
+		for (int k = 0; k < 3; ++k) {
+			if (k == 1 && m_config.columns)
+				continue;
+			if (r.dir[k] > 0.f) {
+				step[k] = 1;
+				t_next[k] = t_enter + ((float)(cell[k] + 1) * s - p[k]) / r.dir[k];
+				t_delta[k] = s / r.dir[k];
+			}
+			else if (r.dir[k] < 0.f) {
+				step[k] = -1;
+				t_next[k] = t_enter + ((float)cell[k] * s - p[k]) / r.dir[k];
+				t_delta[k] = -s / r.dir[k];
+			}
+		}
+		while (true) {
+			ivec3 lo = cell - (int)reach;
+			if (m_config.columns)
+				lo.y = 0;
+			visit_cells(l, lo, cell, test);
+			if (done)
+				break;
+			const int k = t_next.x <= t_next.y && t_next.x <= t_next.z ? 0 : (t_next.y <= t_next.z ? 1 : 2);
+			if (t_next[k] > glm::min(t_exit, t_max))
+				break;
+			cell[k] += step[k];
+			t_next[k] += t_delta[k];
+		}
+	}
+	return result;
+}
+
+/**
+*
+* @param objects
+*/
+void hash_grid::build(const std::vector<Object*>& objects)
+{
+	destroy();
+	while (m_buckets.size() < objects.size())
+		grow();
+	for (Object* obj : objects)
+		add_object(*obj);
+}
+/**
+*
+* @param obj
+* @return
+*/
+u32 hash_grid::add_object(Object& obj)
+{
+	const u32 proxy = obj.get_grid_proxy();
+	if (proxy < m_objects.size() && m_objects[proxy] == &obj)
+		return invalid_index;
+	// load factor up to 1
+	if (m_count + 1 > m_buckets.size())
+		grow();
+	u32 handle;
+	if (!m_free_handles.empty()) {
+		handle = m_free_handles.back();
+		m_free_handles.pop_back();
+		m_objects[handle] = &obj;
+	}
+	else {
+		handle = (u32)m_objects.size();
+		m_objects.push_back(&obj);
+		m_entries.emplace_back();
+	}
+	obj.set_grid_proxy(handle);
+
+	entry& e = m_entries[handle];
+	e.aabb = obj.get_aabb();
+	place(e.aabb, e);
+	link(handle);
+	m_count++;
+	grow_level(e.level, e.aabb);
+	m_level_count[e.level]++;
+	m_bounds = AABB{ glm::min(m_bounds.min_point, e.aabb.min_point), glm::max(m_bounds.max_point, e.aabb.max_point) };
+	return handle;
+}
+/**
+*
+* @param obj
+* @return
+*/
+bool hash_grid::remove_object(Object& obj)
+{
+	const u32 handle = obj.get_grid_proxy();
+	if (handle >= m_objects.size() || m_objects[handle] != &obj)
+		return false;
+	unlink(handle);
+	const u32 level = m_entries[handle].level;
+	if (--m_level_count[level] == 0)
+		m_level_extent[level] = 0.f;
+	m_count--;
+	m_objects[handle] = nullptr;
+	m_free_handles.push_back(handle);
+	obj.set_grid_proxy(invalid_index);
+	return true;
+}
+/**
+*
+* @param obj
+* @return
+*/
+bool hash_grid::move_object(Object& obj)
+{
+	const u32 handle = obj.get_grid_proxy();
+	if (handle >= m_objects.size() || m_objects[handle] != &obj)
+		return false;
+	entry& e = m_entries[handle];
+	e.aabb = obj.get_aabb();
+	m_bounds = AABB{ glm::min(m_bounds.min_point, e.aabb.min_point), glm::max(m_bounds.max_point, e.aabb.max_point) };
+	entry placed;
+	place(e.aabb, placed);
+	const bool relinked = placed.level != e.level || placed.cell != e.cell;
+	if (relinked) {
+		unlink(handle);
+		if (--m_level_count[e.level] == 0)
+			m_level_extent[e.level] = 0.f;
+		e.level = placed.level;
+		e.cell = placed.cell;
+		link(handle);
+		grow_level(e.level, e.aabb);
+		m_level_count[e.level]++;
+	}
+	else
+		grow_level(e.level, e.aabb);
+	return relinked;
+}
+/**
+*
+*/
+void hash_grid::destroy()
+{
+	for (Object* obj : m_objects)
+		if (obj)
+			obj->set_grid_proxy(invalid_index);
+	m_entries.clear();
+	m_objects.clear();
+	m_free_handles.clear();
+	std::fill(m_buckets.begin(), m_buckets.end(), invalid_index);
+	m_count = 0;
+	for (int l = 0; l < max_levels; ++l) {
+		m_level_count[l] = 0;
+		m_level_extent[l] = 0.f;
+	}
+	m_bounds = AABB{ vec3{ FLT_MAX }, vec3{ -FLT_MAX } };
+}
+
+/**
+*
+* @param ab
+* @param visitor	called once for every object whose cached aabb overlaps ab
+*/
+void hash_grid::query_aabb(const AABB& ab, const bvh_object_callback& visitor) const
+{
+	auto emit = [this, &visitor](u32 h) { visitor(*m_objects[h]); };
+	query(ab, emit);
+}
+/**
+*
+* @param r
+* @param t_max
+* @param narrow
+* @return
+*/
+bvh_ray_hit hash_grid::raycast_closest(const Ray& r, float t_max, const bvh_ray_callback& narrow) const
+{
+	return raycast<false>(r, t_max, narrow);
+}
+/**
+*
+* @param r
+* @param t_max
+* @param narrow
+* @return
+*/
+Object* hash_grid::raycast_any(const Ray& r, float t_max, const bvh_ray_callback& narrow) const
+{
+	return raycast<true>(r, t_max, narrow).object;
+}
+/**
+*
+* @param fn	called once for every pair of objects whose aabbs overlap
+*/
+void hash_grid::query_overlapping_pairs(const bvh_pair_callback& fn) const
+{
+	for (u32 a = 0; a < (u32)m_objects.size(); ++a) {
+		if (!m_objects[a])
+			continue;
+		auto emit = [this, &fn, a](u32 b) { fn(*m_objects[a], *m_objects[b]); };
+		pairs(a, emit);
+	}
+}
+/**
+*
+* @param other
+* @param fn	fn(obj, other_obj)
+*/
+void hash_grid::query_overlapping_pairs(const hash_grid& other, const bvh_pair_callback& fn) const
+{
+	if (other.empty())
+		return;
+	for (u32 a = 0; a < (u32)m_objects.size(); ++a) {
+		if (!m_objects[a])
+			continue;
+		auto emit = [this, &other, &fn, a](u32 b) { fn(*m_objects[a], *other.m_objects[b]); };
+		other.query(m_entries[a].aabb, emit);
+	}
+}
+/**
+*
+* @brief contiguous ranges of handles on the workers, each with its own result list
+* @param pairs	found pairs are appended, same order every call
+* @param other	null for a self query
+*/
+void hash_grid::query_overlapping_pairs_parallel(std::vector<bvh_object_pair>& pairs, const hash_grid* other) const
+{
+	if (empty() || (other && other->empty()))
+		return;
+	const size_t min_chunk = 1024;
+	std::vector<std::vector<bvh_object_pair>> found(parallel_chunks(m_objects.size(), min_chunk));
+	parallel_for(m_objects.size(), min_chunk, [this, other, &found](size_t begin, size_t end, u32 chunk) {
+		std::vector<bvh_object_pair>& result = found[chunk];
+		for (u32 a = (u32)begin; a < (u32)end; ++a) {
+			Object* obj = m_objects[a];
+			if (!obj)
+				continue;
+			if (!other) {
+				auto emit = [this, &result, obj](u32 b) { result.push_back({ obj, m_objects[b] }); };
+				this->pairs(a, emit);
+			}
+			else {
+				auto emit = [other, &result, obj](u32 b) { result.push_back({ obj, other->m_objects[b] }); };
+				other->query(m_entries[a].aabb, emit);
+			}
+		}
+	});
+	for (const auto& f : found)
+		pairs.insert(pairs.end(), f.begin(), f.end());
+}
@@ -0,0 +1,118 @@
+/**
+* @file hash_grid.h
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Declare hierarchical spatial hash grid
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#ifndef HASH_GRID_H
+#define HASH_GRID_H
+
+struct hash_grid_config {
+	float cell_size = 1.f;	// cells of level 0, every level doubles it
+	int level_count = 8;	// [1, 32], objects bigger than the last level go to it anyway
+	bool columns = false;	// cells span the whole y axis (2D grid on xz), for objects spread over a flat area
+};
+
+// uniform grids of growing cell size sharing one hash table, every object lives in one cell of the level
+// whose cells are as big as its aabb (the cell of its min corner), so it only reaches into the next cells.
+// Insert, move and remove are O(1), good for many objects of similar density spread over a big area
+class hash_grid {
+public:
+	static constexpr u32 invalid_index = ~0u;
+	static constexpr int max_levels = 32;
+
+private:
+	// by handle (the handles of the objects)
+	struct entry {
+		AABB aabb{};
+		ivec3 cell{ 0 };
+		u32 level = 0;
+		u32 next = invalid_index;	// bucket list, handles
+		u32 prev = invalid_index;
+	};
+	std::vector<entry> m_entries;
+	std::vector<Object*> m_objects;		// null for released handles
+	std::vector<u32> m_free_handles;
+	std::vector<u32> m_buckets;			// first handle of each bucket, size is a power of two
+	u32 m_count = 0;
+	hash_grid_config m_config;
+	u32 m_level_count[max_levels] = {};		// objects in each level, empty levels are skipped
+	float m_level_extent[max_levels] = {};	// biggest aabb size in each level (only grows until the level empties)
+	AABB m_bounds{ vec3{ FLT_MAX }, vec3{ -FLT_MAX } };	// contains every aabb inserted (only grows)
+	AABB m_level_bounds[max_levels];		// contains the aabbs of each level (only grows until the level empties), limits the ranges and ray walks
+
+	inline float cell_size(u32 level) const { return m_config.cell_size * (float)(1u << level); }
+	// cell of p, y is always 0 with columns. Clamped to +-2^30 so the conversion is always defined
+	inline ivec3 cell_of(const vec3& p, float s) const {
+		const float limit = (float)(1 << 30);
+		ivec3 c = ivec3(glm::clamp(glm::floor(p / s), vec3{ -limit }, vec3{ limit }));
+		if (m_config.columns)
+			c.y = 0;
+		return c;
+	}
+	// biggest side of ab, y does not count with columns
+	float extent(const AABB& ab) const;
+	// level and cell of ab
+	void place(const AABB& ab, entry& e) const;
+	// extent and bounds of level grow to contain ab, a level that was empty starts from ab
+	void grow_level(u32 level, const AABB& ab);
+	u32 bucket(u32 level, const ivec3& cell) const;
+	void link(u32 handle);
+	void unlink(u32 handle);
+	void grow();
+	// fn(handle) for the objects of level stored in cells [lo, hi]
+	template<typename FN>
+	void visit_cells(u32 level, const ivec3& lo, const ivec3& hi, FN& fn) const;
+	// fn(handle) for every object of level, in handle order
+	template<typename FN>
+	void visit_level(u32 level, FN& fn) const;
+	// fn(handle) for the objects of level whose min corner may be in a cell overlapping ab (ab.min lowered by
+	// the level extent), cells limited to the level bounds. Ranges with more cells than objects scan the level instead
+	template<typename FN>
+	void visit_range(u32 level, const AABB& ab, FN& fn) const;
+	// emit(handle) for every object whose aabb overlaps ab
+	template<typename EMIT>
+	void query(const AABB& ab, EMIT& emit) const;
+	// emit(other) for the objects overlapping handle a at its level (higher handles only) and above, each pair once
+	template<typename EMIT>
+	void pairs(u32 a, EMIT& emit) const;
+	// closest hit, or the first one found if ANY
+	template<bool ANY>
+	bvh_ray_hit raycast(const Ray& r, float t_max, const bvh_ray_callback& narrow) const;
+
+public:
+	hash_grid() = default;
+	~hash_grid() { destroy(); }
+	void build(const std::vector<Object*>& objects);
+	// returns the handle of obj (also stored on it), invalid_index if already in it
+	u32 add_object(Object& obj);
+	bool remove_object(Object& obj);
+	// re-read the aabb of obj, return true if it changed cell
+	bool move_object(Object& obj);
+	void destroy();
+	// applied by the next build, objects added before keep their cells
+	inline hash_grid_config& config() { return m_config; }
+	inline const hash_grid_config& config() const { return m_config; }
+
+	// every object whose aabb overlaps (or touches) ab
+	void query_aabb(const AABB& ab, const bvh_object_callback& visitor) const;
+	// closest object hit by r up to t_max, walking the cells of every level in ray order (3D-DDA).
+	// narrow (optional) confirms the aabb hits, it may see an object more than once
+	bvh_ray_hit raycast_closest(const Ray& r, float t_max = FLT_MAX, const bvh_ray_callback& narrow = nullptr) const;
+	Object* raycast_any(const Ray& r, float t_max = FLT_MAX, const bvh_ray_callback& narrow = nullptr) const;
+	// every pair of objects whose aabbs overlap (or touch), each pair once
+	void query_overlapping_pairs(const bvh_pair_callback& fn) const;
+	// every object of this against every object of other, the first object of each pair from this
+	void query_overlapping_pairs(const hash_grid& other, const bvh_pair_callback& fn) const;
+	// same pairs on the worker pool, other is null for a self query
+	void query_overlapping_pairs_parallel(std::vector<bvh_object_pair>& pairs, const hash_grid* other = nullptr) const;
+
+	inline bool empty() const { return m_count == 0; }
+	inline size_t object_count() const { return m_count; }
+	inline size_t bucket_count() const { return m_buckets.size(); }
+	inline u32 level_object_count(u32 level) const { return m_level_count[level]; }
+};
+
+#endif	// HASH_GRID_H
@@ -0,0 +1,428 @@
+/**
+* @file loose_octree.cpp
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Implement loose octree
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#include "pch.h"
+
+namespace {
+	// a depth-first walk keeps at most 7 siblings per level plus the children of the last node
+	constexpr u32 cStackSize = 8 * loose_octree::max_depth_limit + 8;
+
+	struct ray_entry {
+		u32 node;
+		float t;	// entry distance of the loose cell
+	};
+	struct frustum_entry {
+		u32 node;
+		u32 planes;	// planes the parent is not fully inside
+	};
+
+	/**
+	*
+	* @param ab0
+	* @param ab1
+	* @return true if they overlap or touch
+	*/
+	inline bool overlap_aabb(const AABB& ab0, const AABB& ab1)
+	{
+		return glm::all(glm::lessThanEqual(ab0.min_point, ab1.max_point)) && glm::all(glm::lessThanEqual(ab1.min_point, ab0.max_point));
+	}
+	/**
+	*
+	* @param outer
+	* @param inner
+	* @return true if inner is inside outer (touching counts)
+	*/
+	inline bool contains_aabb(const AABB& outer, const AABB& inner)
+	{
+		return glm::all(glm::lessThanEqual(outer.min_point, inner.min_point)) && glm::all(glm::lessThanEqual(inner.max_point, outer.max_point));
+	}
+}
+
+/**
+*
+* @param center
+* @param half
+*/
+void loose_octree::make_root(const vec3& center, float half)
+{
+	assert(m_count == 0);
+	m_nodes.assign(1, node{});
+	m_nodes[0].center = center;
+	m_nodes[0].half = half;
+	m_free_blocks.clear();
+	m_looseness = glm::max(m_config.looseness, 1.f);
+	m_max_depth = glm::clamp(m_config.max_depth, 0, max_depth_limit);
+}
+/**
+*
+* @param parent
+* @return first child
+*/
+u32 loose_octree::allocate_children(u32 parent)
+{
+	u32 block;
+	if (!m_free_blocks.empty()) {
+		block = m_free_blocks.back();
+		m_free_blocks.pop_back();
+	}
+	else {
+		block = (u32)m_nodes.size();
+		m_nodes.resize(m_nodes.size() + 8);
+	}
+	const node& p = m_nodes[parent];
+	const float half = p.half * 0.5f;
+	for (u32 i = 0; i < 8; ++i) {
+		node& c = m_nodes[block + i];
+		c = node{};
+		c.center = p.center + vec3{ i & 1 ? half : -half, i & 2 ? half : -half, i & 4 ? half : -half };
+		c.half = half;
+		c.parent = parent;
+	}
+	m_nodes[parent].children = block;
+	return block;
+}
+/**
+*
+* @param n
+*/
+void loose_octree::release_children(u32 n)
+{
+	const u32 block = m_nodes[n].children;
+	if (block == invalid_index)
+		return;
+	for (u32 i = 0; i < 8; ++i)
+		release_children(block + i);
+	m_free_blocks.push_back(block);
+	m_nodes[n].children = invalid_index;
+}
+/**
+*
+* @param handle
+* @param n
+*/
+void loose_octree::link(u32 handle, u32 n)
+{
+	entry& e = m_entries[handle];
+	node& nd = m_nodes[n];
+	e.node = n;
+	e.prev = invalid_index;
+	e.next = nd.first;
+	if (nd.first != invalid_index)
+		m_entries[nd.first].prev = handle;
+	nd.first = handle;
+	nd.count++;
+	for (u32 a = n; a != invalid_index; a = m_nodes[a].parent)
+		m_nodes[a].total++;
+}
+/**
+*
+* @param handle
+*/
+void loose_octree::unlink(u32 handle)
+{
+	entry& e = m_entries[handle];
+	node& nd = m_nodes[e.node];
+	if (e.prev != invalid_index)
+		m_entries[e.prev].next = e.next;
+	else
+		nd.first = e.next;
+	if (e.next != invalid_index)
+		m_entries[e.next].prev = e.prev;
+	nd.count--;
+	// highest ancestor left without objects
+	u32 empty = invalid_index;
+	for (u32 a = e.node; a != invalid_index; a = m_nodes[a].parent)
+		if (--m_nodes[a].total == 0)
+			empty = a;
+	if (empty != invalid_index)
+		release_children(empty);
+	e.node = invalid_index;
+}
+/**
+*
+* @param ab
+* @return
+*/
+u32 loose_octree::find_node(const AABB& ab)
+{
+	const vec3 c = (ab.min_point + ab.max_point) * 0.5f;
+	u32 n = 0;
+	for (int depth = 0; depth < m_max_depth; ++depth) {
+		const node& nd = m_nodes[n];
+		const u32 i = (c.x >= nd.center.x ? 1u : 0u) | (c.y >= nd.center.y ? 2u : 0u) | (c.z >= nd.center.z ? 4u : 0u);
+		const float half = nd.half * 0.5f;
+		const vec3 center = nd.center + vec3{ i & 1 ? half : -half, i & 2 ? half : -half, i & 4 ? half : -half };
+		const vec3 loose{ half * m_looseness };
+		if (!contains_aabb(AABB{ center - loose, center + loose }, ab))
+			break;
+		const u32 children = nd.children != invalid_index ? nd.children : allocate_children(n);
+		n = children + i;
+	}
+	return n;
+}
+/**
+*
+* @brief the root is never culled, it also keeps the objects outside its loose cell
+* @param ab
+* @param emit
+*/
+template<typename EMIT>
+void loose_octree::query(const AABB& ab, EMIT& emit) const
+{
+	if (m_nodes.empty())
+		return;
+	u32 stack[cStackSize];
+	u32 size = 0;
+	stack[size++] = 0;
+	while (size) {
+		const node& nd = m_nodes[stack[--size]];
+		for (u32 h = nd.first; h != invalid_index; h = m_entries[h].next)
+			if (overlap_aabb(m_entries[h].aabb, ab))
+				emit(h);
+		if (nd.children == invalid_index)
+			continue;
+		// culled before being pushed
+		for (u32 c = nd.children; c < nd.children + 8; ++c)
+			if (m_nodes[c].total != 0 && overlap_aabb(loose_bounds(m_nodes[c]), ab))
+				stack[size++] = c;
+	}
+}
+/**
+*
+* @brief children are visited nearest loose cell first, cells starting after the closest hit are skipped
+* @param r
+* @param t_max
+* @param narrow	optional
+* @return
+*/
+template<bool ANY>
+bvh_ray_hit loose_octree::raycast(const Ray& r, float t_max, const bvh_ray_callback& narrow) const
+{
+	bvh_ray_hit result;
+	if (m_nodes.empty())
+		return result;
+	const RayQuery q(r);
+	ray_entry stack[cStackSize];
+	u32 size = 0;
+	stack[size++] = { 0, 0.f };
+	while (size) {
+		const ray_entry top = stack[--size];
+		const node& nd = m_nodes[top.node];
+		if (top.t > t_max || nd.total == 0)
+			continue;
+		for (u32 h = nd.first; h != invalid_index; h = m_entries[h].next) {
+			float t = intersection_ray_aabb(q, m_entries[h].aabb);
+			if (t < 0.f || t > t_max)
+				continue;
+			if (narrow) {
+				t = narrow(*m_objects[h], t_max);
+				if (t < 0.f || t > t_max)
+					continue;
+			}
+			result = { m_objects[h], t, ~0u };
+			if (ANY)
+				return result;
+			t_max = t;
+		}
+		if (nd.children == invalid_index)
+			continue;
+		// farthest pushed first, insertion sort of up to 8
+		ray_entry hits[8];
+		u32 hit_count = 0;
+		for (u32 i = 0; i < 8; ++i) {
+			const u32 c = nd.children + i;
+			if (m_nodes[c].total == 0)
+				continue;
+			const float t = intersection_ray_aabb(q, loose_bounds(m_nodes[c]));
+			if (t < 0.f || t > t_max)
+				continue;
+			u32 j = hit_count++;
+			for (; j > 0 && hits[j - 1].t < t; --j)
+				hits[j] = hits[j - 1];
+			hits[j] = { c, t };
+		}
+		for (u32 i = 0; i < hit_count; ++i)
+			stack[size++] = hits[i];
+	}
+	return result;
+}
+
+/**
+*
+* @param objects
+*/
+void loose_octree::build(const std::vector<Object*>& objects)
+{
+	destroy();
+	if (objects.empty())
+		return;
+	AABB bounds = objects[0]->get_aabb();
+	for (const Object* obj : objects) {
+		bounds.min_point = glm::min(bounds.min_point, obj->get_aabb().min_point);
+		bounds.max_point = glm::max(bounds.max_point, obj->get_aabb().max_point);
+	}
+	const vec3 half = (bounds.max_point - bounds.min_point) * 0.5f;
+	make_root(bounds.min_point + half, glm::max(glm::max(half.x, half.y), glm::max(half.z, FLT_EPSILON)));
+	for (Object* obj : objects)
+		add_object(*obj);
+}
+/**
+*
+* @param obj
+* @return
+*/
+u32 loose_octree::add_object(Object& obj)
+{
+	const u32 proxy = obj.get_octree_proxy();
+	if (proxy < m_objects.size() && m_objects[proxy] == &obj)
+		return invalid_index;
+	if (m_nodes.empty())
+		make_root(m_config.center, m_config.half_size);
+	u32 handle;
+	if (!m_free_handles.empty()) {
+		handle = m_free_handles.back();
+		m_free_handles.pop_back();
+		m_objects[handle] = &obj;
+	}
+	else {
+		handle = (u32)m_objects.size();
+		m_objects.push_back(&obj);
+		m_entries.emplace_back();
+	}
+	obj.set_octree_proxy(handle);
+	m_entries[handle].aabb = obj.get_aabb();
+	link(handle, find_node(m_entries[handle].aabb));
+	m_count++;
+	return handle;
+}
+/**
+*
+* @param obj
+* @return
+*/
+bool loose_octree::remove_object(Object& obj)
+{
+	const u32 handle = obj.get_octree_proxy();
+	if (handle >= m_objects.size() || m_objects[handle] != &obj)
+		return false;
+	unlink(handle);
+	m_objects[handle] = nullptr;
+	m_free_handles.push_back(handle);
+	m_count--;
+	obj.set_octree_proxy(invalid_index);
+	return true;
+}
+/**
+*
+* @param obj
+* @return
+*/
+bool loose_octree::move_object(Object& obj)
+{
+	const u32 handle = obj.get_octree_proxy();
+	if (handle >= m_objects.size() || m_objects[handle] != &obj)
+		return false;
+	entry& e = m_entries[handle];
+	e.aabb = obj.get_aabb();
+	if (contains_aabb(loose_bounds(m_nodes[e.node]), e.aabb))
+		return false;
+	unlink(handle);
+	link(handle, find_node(e.aabb));
+	return true;
+}
+/**
+*
+*/
+void loose_octree::destroy()
+{
+	for (Object* obj : m_objects)
+		if (obj)
+			obj->set_octree_proxy(invalid_index);
+	m_nodes.clear();
+	m_free_blocks.clear();
+	m_entries.clear();
+	m_objects.clear();
+	m_free_handles.clear();
+	m_count = 0;
+}
+/**
+*
+* @param obj
+* @return
+*/
+const loose_octree::node* loose_octree::find(const Object& obj) const
+{
+	const u32 handle = obj.get_octree_proxy();
+	if (handle >= m_objects.size() || m_objects[handle] != &obj)
+		return nullptr;
+	return &m_nodes[m_entries[handle].node];
+}
+
+/**
+*
+* @param ab
+* @param visitor	called once for every object whose cached aabb overlaps ab
+*/
+void loose_octree::query_aabb(const AABB& ab, const bvh_object_callback& visitor) const
+{
+	auto emit = [this, &visitor](u32 h) { visitor(*m_objects[h]); };
+	query(ab, emit);
+}
+/**
+*
+* @brief plane masking as in the bvh, the loose cells are the bounding volumes
+* @param f
+* @param visitor	called once for every object whose aabb is not outside f
+*/
+void loose_octree::query_frustum(const Frustum& f, const bvh_object_callback& visitor) const
+{
+	if (m_nodes.empty())
+		return;
+	const FrustumQuery query(f);
+	frustum_entry stack[cStackSize];
+	u32 size = 0;
+	stack[size++] = { 0, (1u << 6) - 1 };
+	while (size) {
+		frustum_entry top = stack[--size];
+		const node& nd = m_nodes[top.node];
+		if (nd.total == 0)
+			continue;
+		if (top.node != 0 && intersection_frustum_aabb(query, loose_bounds(nd), top.planes) == OUTSIDE)
+			continue;
+		for (u32 h = nd.first; h != invalid_index; h = m_entries[h].next) {
+			u32 planes = top.planes;
+			if (!planes || intersection_frustum_aabb(query, m_entries[h].aabb, planes) != OUTSIDE)
+				visitor(*m_objects[h]);
+		}
+		if (nd.children != invalid_index)
+			for (u32 i = 0; i < 8; ++i)
+				stack[size++] = { nd.children + i, top.planes };
+	}
+}
+/**
+*
+* @param r
+* @param t_max
+* @param narrow
+* @return
+*/
+bvh_ray_hit loose_octree::raycast_closest(const Ray& r, float t_max, const bvh_ray_callback& narrow) const
+{
+	return raycast<false>(r, t_max, narrow);
+}
+/**
+*
+* @param r
+* @param t_max
+* @param narrow
+* @return
+*/
+Object* loose_octree::raycast_any(const Ray& r, float t_max, const bvh_ray_callback& narrow) const
+{
+	return raycast<true>(r, t_max, narrow).object;
+}
@@ -0,0 +1,111 @@
+/**
+* @file loose_octree.h
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Declare loose octree
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#ifndef LOOSE_OCTREE_H
+#define LOOSE_OCTREE_H
+
+struct loose_octree_config {
+	float looseness = 2.f;		// loose cell size over cell size (>= 1), objects up to (looseness - 1) cells fit any child
+	int max_depth = 8;			// [0, 16], levels below the root
+	// root cell when objects are added without a build, build fits it to the objects
+	vec3 center{ 0.f };
+	float half_size = 1024.f;
+};
+
+// octree whose cells are looseness times bigger than their octant, so every object fits the cell of its center
+// at the depth of its size. The shape only depends on the root cell, moves inside the loose cell cost O(1)
+// and the rest O(max depth)
+class loose_octree {
+public:
+	static constexpr u32 invalid_index = ~0u;
+	static constexpr int max_depth_limit = 16;
+
+	// child i of a node is on the positive side of axis k if bit k of i is set
+	struct node {
+		vec3 center{ 0.f };
+		float half = 0.f;				// of the octant, the loose cell is center +- half * looseness
+		u32 children = invalid_index;	// first of 8 consecutive nodes
+		u32 parent = invalid_index;
+		u32 first = invalid_index;		// handle of the first object of the node
+		u32 count = 0;					// objects in the node
+		u32 total = 0;					// objects in the node and its subtree, empty subtrees are released
+	};
+
+private:
+	// by handle (the handles of the objects)
+	struct entry {
+		AABB aabb{};
+		u32 node = invalid_index;
+		u32 next = invalid_index;	// objects of the node
+		u32 prev = invalid_index;
+	};
+	std::vector<node> m_nodes;			// pool, m_nodes[0] is the root (if any)
+	std::vector<u32> m_free_blocks;		// released blocks of 8 children, reused first
+	std::vector<entry> m_entries;
+	std::vector<Object*> m_objects;		// null for released handles
+	std::vector<u32> m_free_handles;
+	u32 m_count = 0;
+	loose_octree_config m_config;
+	float m_looseness = 2.f;			// config of the current root
+	int m_max_depth = 8;
+
+	// new root cell, the tree must be empty
+	void make_root(const vec3& center, float half);
+	u32 allocate_children(u32 parent);
+	// releases every block below n
+	void release_children(u32 n);
+	void link(u32 handle, u32 n);
+	// unlinks handle and releases the subtrees left empty
+	void unlink(u32 handle);
+	// deepest cell on the path of the center of ab whose loose cell contains ab
+	u32 find_node(const AABB& ab);
+	// emit(handle) for the objects whose aabb overlaps ab
+	template<typename EMIT>
+	void query(const AABB& ab, EMIT& emit) const;
+	// closest hit, or the first one found if ANY
+	template<bool ANY>
+	bvh_ray_hit raycast(const Ray& r, float t_max, const bvh_ray_callback& narrow) const;
+
+public:
+	loose_octree() = default;
+	~loose_octree() { destroy(); }
+	// root cell fitted to the objects
+	void build(const std::vector<Object*>& objects);
+	// returns the handle of obj (also stored on it), invalid_index if already in it
+	u32 add_object(Object& obj);
+	bool remove_object(Object& obj);
+	// O(1) if the aabb of obj is still inside its loose cell, return true if it was reinserted
+	bool move_object(Object& obj);
+	void destroy();
+	// applied to the root of the next build or first insertion
+	inline loose_octree_config& config() { return m_config; }
+	inline const loose_octree_config& config() const { return m_config; }
+
+	// every object whose aabb overlaps (or touches) ab
+	void query_aabb(const AABB& ab, const bvh_object_callback& visitor) const;
+	// every object whose aabb is not outside f, cells fully inside f are reported without plane tests
+	void query_frustum(const Frustum& f, const bvh_object_callback& visitor) const;
+	// closest object hit by r up to t_max, narrow (optional) confirms the aabb hits and shrinks t_max
+	bvh_ray_hit raycast_closest(const Ray& r, float t_max = FLT_MAX, const bvh_ray_callback& narrow = nullptr) const;
+	// any object hit by r up to t_max (occlusion), null if none
+	Object* raycast_any(const Ray& r, float t_max = FLT_MAX, const bvh_ray_callback& narrow = nullptr) const;
+
+	inline bool empty() const { return m_count == 0; }
+	inline size_t object_count() const { return m_count; }
+	// allocated nodes (released blocks included)
+	inline size_t node_capacity() const { return m_nodes.size(); }
+	inline const node* root() const { return m_nodes.empty() ? nullptr : &m_nodes[0]; }
+	inline AABB loose_bounds(const node& n) const {
+		const vec3 half{ n.half * m_looseness };
+		return AABB{ n.center - half, n.center + half };
+	}
+	// node of obj, null if obj is not in this tree
+	const node* find(const Object& obj) const;
+};
+
+#endif	// LOOSE_OCTREE_H
@@ -9,6 +9,8 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
+class bounding_volume_hierarchy;
+
 struct Object
 {
 private:
@@ -29,6 +31,13 @@ private:
 	AABB   obb = AABB{ {},{} };		// aabb at model space, apply transformation
 	mutable AABB   aabb;	// computed from obb
 	mutable bool is_aabb_updated = false;
+	// spatial partitioning
+	u32 bvh_proxy = ~0u;	// handle in the bounding volume hierarchy containing the object
+	const bounding_volume_hierarchy* bvh_owner = nullptr;	// tree bvh_proxy belongs to, an object is in one at most
+	u32 pair_proxy = ~0u;	// stable id in the pair manager tracking the object
+	u32 sap_proxy = ~0u;	// handle in the sweep and prune containing the object
+	u32 grid_proxy = ~0u;	// handle in the hash grid containing the object
+	u32 octree_proxy = ~0u;	// handle in the loose octree containing the object
 
 public:
 	bool operator == (const Object& rhs) const {
@@ -48,6 +57,12 @@ public:
 	inline const MeshData* get_mesh_data() const { return mesh_data; }
 	inline const MeshBuffers* get_mesh_buffers() const { return mesh_buffers; }
 	inline Color get_color() const { return color; }
+	inline u32 get_bvh_proxy() const { return bvh_proxy; }
+	inline const bounding_volume_hierarchy* get_bvh_owner() const { return bvh_owner; }
+	inline u32 get_pair_proxy() const { return pair_proxy; }
+	inline u32 get_sap_proxy() const { return sap_proxy; }
+	inline u32 get_grid_proxy() const { return grid_proxy; }
+	inline u32 get_octree_proxy() const { return octree_proxy; }
 	// get model space obb (aabb) be carefull! remember that need to be multiplied
 	inline const AABB& get_obb() const		{ return obb; }
 	const AABB& get_aabb() const;	// compute aabb if needed
@@ -64,7 +79,12 @@ public:
 	void set_mesh_data(const MeshData* md);
 	void set_mesh_buffers(const MeshBuffers* mb);
 	void set_color(Color c);
-	void set_aabb(const AABB& ab) { aabb = ab; }	// DEBUG: used for assigning value from file, unhack as soon as posible
+	inline void set_bvh_proxy(const bounding_volume_hierarchy* owner, u32 proxy) { bvh_owner = owner; bvh_proxy = proxy; }	// only the bvh should call this
+	inline void set_pair_proxy(u32 proxy) { pair_proxy = proxy; }	// only the pair manager should call this
+	inline void set_sap_proxy(u32 proxy) { sap_proxy = proxy; }	// only the sweep and prune should call this
+	inline void set_grid_proxy(u32 proxy) { grid_proxy = proxy; }	// only the hash grid should call this
+	inline void set_octree_proxy(u32 proxy) { octree_proxy = proxy; }	// only the loose octree should call this
+	void set_aabb(const AABB& ab) { aabb = ab; is_aabb_updated = true; }	// DEBUG: used for assigning value from file, unhack as soon as posible
 
 	void update_physics(float delta);
 };
@@ -0,0 +1,304 @@
+/**
+* @file pair_manager.cpp
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Implement persistent overlapping pairs with begin/end events
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#include "pch.h"
+
+namespace {
+	/**
+	*
+	* @param a
+	* @param b
+	* @return key of the pair, same for (a, b) and (b, a)
+	*/
+	inline u64 pair_key(u32 a, u32 b)
+	{
+		return a < b ? ((u64)a << 32 | b) : ((u64)b << 32 | a);
+	}
+	inline u32 key_low(u64 key) { return (u32)(key >> 32); }
+	inline u32 key_high(u64 key) { return (u32)key; }
+	/**
+	*
+	* @brief fibonacci hashing, consecutive ids spread over the table
+	* @param key
+	* @return
+	*/
+	inline size_t hash_key(u64 key)
+	{
+		return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+	}
+}
+
+/**
+*
+* @param key
+* @return
+*/
+size_t bvh_pair_manager::probe(u64 key) const
+{
+	assert(!m_keys.empty());
+	const size_t mask = m_keys.size() - 1;
+	size_t slot = hash_key(key) & mask;
+	while (m_keys[slot] != empty_key && m_keys[slot] != key)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+/**
+*
+* @param key
+* @param inserted	false if key was already in the set
+* @return
+*/
+size_t bvh_pair_manager::insert(u64 key, bool& inserted)
+{
+	// load factor up to 1/2
+	if ((m_pair_count + 1) * 2 > m_keys.size())
+		grow();
+	const size_t slot = probe(key);
+	inserted = m_keys[slot] == empty_key;
+	if (inserted) {
+		m_keys[slot] = key;
+		m_pair_count++;
+	}
+	return slot;
+}
+/**
+*
+* @brief entries after the freed slot move back if it is on their probe sequence
+* @param slot
+*/
+void bvh_pair_manager::erase_slot(size_t slot)
+{
+	const size_t mask = m_keys.size() - 1;
+	size_t next = slot;
+	while (true) {
+		next = (next + 1) & mask;
+		if (m_keys[next] == empty_key)
+			break;
+		const size_t home = hash_key(m_keys[next]) & mask;
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			m_keys[slot] = m_keys[next];
+			m_stamps[slot] = m_stamps[next];
+			slot = next;
+		}
+	}
+	m_keys[slot] = empty_key;
+	m_pair_count--;
+}
+/**
+*
+* @param key	must be in the set
+*/
+void bvh_pair_manager::erase_pair(u64 key)
+{
+	erase_slot(probe(key));
+	for (u32 id : { key_low(key), key_high(key) }) {
+		std::vector<u32>& partners = m_partners[id];
+		const u32 other = id == key_low(key) ? key_high(key) : key_low(key);
+		auto it = std::find(partners.begin(), partners.end(), other);
+		assert(it != partners.end());
+		*it = partners.back();
+		partners.pop_back();
+	}
+}
+/**
+*
+*/
+void bvh_pair_manager::grow()
+{
+	std::vector<u64> keys(glm::max((size_t)64, 2 * m_keys.size()), empty_key);
+	std::vector<u32> stamps(keys.size(), 0);
+	keys.swap(m_keys);
+	stamps.swap(m_stamps);
+	for (size_t i = 0; i < keys.size(); ++i) {
+		if (keys[i] == empty_key)
+			continue;
+		const size_t slot = probe(keys[i]);
+		m_keys[slot] = keys[i];
+		m_stamps[slot] = stamps[i];
+	}
+}
+
+/**
+*
+* @param obj	must not be tracked already
+*/
+void bvh_pair_manager::add_object(Object& obj)
+{
+	assert(obj.get_pair_proxy() == invalid_id);
+	u32 id;
+	if (!m_free_ids.empty()) {
+		id = m_free_ids.back();
+		m_free_ids.pop_back();
+		m_objects[id] = &obj;
+	}
+	else {
+		id = (u32)m_objects.size();
+		m_objects.push_back(&obj);
+		m_moved_frame.push_back(0);
+		m_partners.emplace_back();
+	}
+	obj.set_pair_proxy(id);
+	mark_moved(obj);
+}
+/**
+*
+* @param obj
+*/
+void bvh_pair_manager::remove_object(Object& obj)
+{
+	const u32 id = obj.get_pair_proxy();
+	if (id >= m_objects.size() || m_objects[id] != &obj)
+		return;
+	while (!m_partners[id].empty()) {
+		const u64 key = pair_key(id, m_partners[id].back());
+		m_removed.push_back({ m_objects[key_low(key)], m_objects[key_high(key)] });
+		erase_pair(key);
+	}
+	m_objects[id] = nullptr;
+	m_free_ids.push_back(id);
+	obj.set_pair_proxy(invalid_id);
+}
+/**
+*
+* @param obj	tracked object, marking it twice in a frame is fine
+*/
+void bvh_pair_manager::mark_moved(Object& obj)
+{
+	const u32 id = obj.get_pair_proxy();
+	assert(id < m_objects.size() && m_objects[id] == &obj);
+	if (moved(id))
+		return;
+	m_moved_frame[id] = m_frame;
+	m_moved.push_back(id);
+}
+/**
+*
+* @param a
+* @param b
+*/
+void bvh_pair_manager::found_pair(u32 a, u32 b)
+{
+	bool inserted;
+	const size_t slot = insert(pair_key(a, b), inserted);
+	m_stamps[slot] = m_frame;
+	if (!inserted)
+		return;
+	m_partners[a].push_back(b);
+	m_partners[b].push_back(a);
+	m_begin.push_back(a < b ? bvh_object_pair{ m_objects[a], m_objects[b] } : bvh_object_pair{ m_objects[b], m_objects[a] });
+}
+/**
+*
+* @brief pairs found by the queries begin if new, pairs of a moved object that were not found end.
+*	Few moved objects query the bvh one by one (a pair of two moved objects is handled by the query of the
+*	lower id), many moved objects share one pair query of the whole tree
+* @param bvh	contains the tracked objects, with their current aabbs
+*/
+void bvh_pair_manager::update(const bounding_volume_hierarchy& bvh)
+{
+	m_begin.clear();
+	m_end.assign(m_removed.begin(), m_removed.end());
+	m_removed.clear();
+
+	auto tracked = [this](const Object& obj) {
+		const u32 id = obj.get_pair_proxy();
+		return id < m_objects.size() && m_objects[id] == &obj;
+	};
+	if (m_moved.size() * full_query_ratio > object_count()) {
+		// pairs of two objects that did not move are already in the set
+		const bvh_pair_callback found = [this, &tracked](Object& a, Object& b) {
+			if (!tracked(a) || !tracked(b))
+				return;
+			const u32 ia = a.get_pair_proxy(), ib = b.get_pair_proxy();
+			if (ia != ib && (moved(ia) || moved(ib)))
+				found_pair(ia, ib);
+		};
+		bvh.query_overlapping_pairs(found);
+	}
+	else {
+		u32 id = invalid_id;
+		// small enough to be stored inside the std::function
+		const bvh_object_callback found = [this, &id, &tracked](Object& other) {
+			if (!tracked(other))
+				return;
+			const u32 other_id = other.get_pair_proxy();
+			if (other_id != id && (!moved(other_id) || other_id > id))
+				found_pair(id, other_id);
+		};
+		for (u32 moved_id : m_moved) {
+			id = moved_id;
+			if (m_objects[id])
+				bvh.query_aabb(m_objects[id]->get_aabb(), found);
+		}
+	}
+
+	// pairs of the moved objects not found again, a pair of two moved objects is checked by the lower id
+	for (u32 moved_id : m_moved) {
+		if (!m_objects[moved_id])
+			continue;
+		for (u32 other_id : m_partners[moved_id]) {
+			if (moved(other_id) && other_id < moved_id)
+				continue;
+			const u64 key = pair_key(moved_id, other_id);
+			if (m_stamps[probe(key)] != m_frame)
+				m_ended.push_back(key);
+		}
+	}
+	for (u64 key : m_ended) {
+		m_end.push_back({ m_objects[key_low(key)], m_objects[key_high(key)] });
+		erase_pair(key);
+	}
+	m_ended.clear();
+	m_moved.clear();
+	m_frame++;
+}
+/**
+*
+* @param count
+*/
+void bvh_pair_manager::reserve(size_t count)
+{
+	while (2 * count > m_keys.size())
+		grow();
+}
+/**
+*
+* @brief forget every object and pair, no events are reported
+*/
+void bvh_pair_manager::clear()
+{
+	for (Object* obj : m_objects)
+		if (obj)
+			obj->set_pair_proxy(invalid_id);
+	m_objects.clear();
+	m_free_ids.clear();
+	m_moved_frame.clear();
+	m_partners.clear();
+	m_moved.clear();
+	std::fill(m_keys.begin(), m_keys.end(), empty_key);
+	m_pair_count = 0;
+	m_begin.clear();
+	m_end.clear();
+	m_removed.clear();
+}
+/**
+*
+* @param a
+* @param b
+* @return true if the pair was overlapping in the last update
+*/
+bool bvh_pair_manager::overlapping(const Object& a, const Object& b) const
+{
+	const u32 ia = a.get_pair_proxy(), ib = b.get_pair_proxy();
+	if (m_keys.empty() || ia == ib || ia >= m_objects.size() || ib >= m_objects.size())
+		return false;
+	if (m_objects[ia] != &a || m_objects[ib] != &b)
+		return false;
+	const u64 key = pair_key(ia, ib);
+	return m_keys[probe(key)] == key;
+}
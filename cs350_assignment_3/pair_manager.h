@@ -0,0 +1,75 @@
+/**
+* @file pair_manager.h
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Declare persistent overlapping pairs with begin/end events
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#ifndef PAIR_MANAGER_H
+#define PAIR_MANAGER_H
+
+// overlapping pairs of the tracked objects of a bvh, kept between frames.
+// Only the objects marked as moved are queried again, pairs of two objects that did not move stay as they were
+class bvh_pair_manager {
+public:
+	static constexpr u32 invalid_id = ~0u;
+
+private:
+	static constexpr u64 empty_key = ~0ull;
+	// update queries the whole tree once when more than 1 / full_query_ratio of the objects moved (about where
+	// one tree query gets cheaper than an aabb query per moved object)
+	static constexpr size_t full_query_ratio = 8;
+
+	std::vector<Object*> m_objects;		// by id, null for released ids
+	std::vector<u32> m_free_ids;		// released ids, reused by add_object
+	std::vector<u32> m_moved_frame;		// by id, frame of the last mark_moved
+	std::vector<u32> m_moved;			// ids marked since the last update
+	// open addressing (linear probing) set of pairs, key = lower id << 32 | higher id
+	std::vector<u64> m_keys;			// empty_key for free slots, size is a power of two
+	std::vector<u32> m_stamps;			// same indices as m_keys, frame the pair was last found
+	std::vector<std::vector<u32>> m_partners;	// by id, the other id of each of its pairs (unordered)
+	size_t m_pair_count = 0;
+	u32 m_frame = 1;
+	// events and scratch, cleared but never shrunk
+	std::vector<bvh_object_pair> m_begin;
+	std::vector<bvh_object_pair> m_end;
+	std::vector<bvh_object_pair> m_removed;	// pairs of objects removed since the last update
+	std::vector<u64> m_ended;
+
+	inline bool moved(u32 id) const { return m_moved_frame[id] == m_frame; }
+	// slot of key, or of the free slot ending its probe sequence
+	size_t probe(u64 key) const;
+	// adds key if missing, returns its slot
+	size_t insert(u64 key, bool& inserted);
+	// backward shift deletion, no tombstones
+	void erase_slot(size_t slot);
+	// removes the pair from the set and from the partner lists of both ids
+	void erase_pair(u64 key);
+	// a and b overlap this frame, the pair begins if new
+	void found_pair(u32 a, u32 b);
+	void grow();
+
+public:
+	// starts tracking obj, its pairs begin on the next update
+	void add_object(Object& obj);
+	// stops tracking obj, its pairs end on the next update (the pointer is only an identifier by then).
+	// Linear in the pairs of obj
+	void remove_object(Object& obj);
+	// the aabb of obj changed, call it after moving obj in the bvh
+	void mark_moved(Object& obj);
+	// query the moved objects in bvh and fill the event lists, only the pairs of the moved objects are visited
+	void update(const bounding_volume_hierarchy& bvh);
+	// room for count pairs without growing the set
+	void reserve(size_t count);
+	void clear();
+
+	// pairs that started or stopped overlapping in the last update, lower id first
+	inline const std::vector<bvh_object_pair>& begin_events() const { return m_begin; }
+	inline const std::vector<bvh_object_pair>& end_events() const { return m_end; }
+	bool overlapping(const Object& a, const Object& b) const;
+	inline size_t pair_count() const { return m_pair_count; }
+	inline size_t object_count() const { return m_objects.size() - m_free_ids.size(); }
+};
+
+#endif	// PAIR_MANAGER_H
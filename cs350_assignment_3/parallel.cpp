@@ -0,0 +1,247 @@
+/**
+* @file parallel.cpp
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Implement simple data parallel helpers
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#include "pch.h"
+
+// one deque per worker, the caller of wait() works as worker 0
+class work_stealing_pool {
+public:
+	struct task {
+		std::function<void()> fn;
+		task_group* group;
+	};
+
+	explicit work_stealing_pool(u32 workers);
+	~work_stealing_pool();
+
+	inline u32 size() const { return (u32)m_queues.size(); }
+	void push(task t);
+	// pop from the back of the own queue or steal from the front of the others
+	bool run_one();
+
+private:
+	struct queue {
+		std::mutex mutex;
+		std::deque<task> tasks;
+	};
+	void worker_main(u32 worker);
+	u32 current_worker() const;
+
+	std::vector<std::unique_ptr<queue>> m_queues;
+	std::vector<std::thread> m_threads;
+	std::atomic<u32> m_queued{ 0 };
+	std::atomic<bool> m_quit{ false };
+	std::mutex m_sleep_mutex;
+	std::condition_variable m_wake;
+};
+
+namespace {
+	u32 g_worker_count = 0;	// 0 = hardware concurrency
+	std::unique_ptr<work_stealing_pool> g_pool;
+	thread_local const work_stealing_pool* t_pool = nullptr;	// pool of this worker thread
+	thread_local u32 t_worker = 0;
+
+	/**
+	*
+	* @return pool sized to worker_count(), created on first use
+	*/
+	work_stealing_pool& pool()
+	{
+		if (!g_pool || g_pool->size() != worker_count())
+			g_pool = std::make_unique<work_stealing_pool>(worker_count());
+		return *g_pool;
+	}
+}
+
+/**
+*
+* @param workers	including the calling thread
+*/
+work_stealing_pool::work_stealing_pool(u32 workers)
+{
+	m_queues.resize(workers);
+	for (auto& q : m_queues)
+		q = std::make_unique<queue>();
+	for (u32 i = 1; i < workers; ++i)
+		m_threads.emplace_back(&work_stealing_pool::worker_main, this, i);
+}
+/**
+*
+*/
+work_stealing_pool::~work_stealing_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleep_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (auto& t : m_threads)
+		t.join();
+}
+/**
+*
+* @return queue index of the calling thread, other threads use 0
+*/
+u32 work_stealing_pool::current_worker() const
+{
+	return t_pool == this ? t_worker : 0;
+}
+/**
+*
+* @param t
+*/
+void work_stealing_pool::push(task t)
+{
+	queue& q = *m_queues[current_worker()];
+	{
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.tasks.push_back(std::move(t));
+	}
+	{
+		// locked so sleeping workers can not miss it
+		std::lock_guard<std::mutex> lock(m_sleep_mutex);
+		m_queued++;
+	}
+	m_wake.notify_one();
+}
+/**
+*
+* @return false if there was nothing to run
+*/
+bool work_stealing_pool::run_one()
+{
+	const u32 me = current_worker();
+	task t;
+	bool found = false;
+	// own queue, newest first (depth first, cache friendly)
+	{
+		queue& q = *m_queues[me];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty()) {
+			t = std::move(q.tasks.back());
+			q.tasks.pop_back();
+			found = true;
+		}
+	}
+	// steal the oldest (biggest) task of another worker
+	for (u32 i = 1; !found && i < size(); ++i) {
+		queue& q = *m_queues[(me + i) % size()];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty()) {
+			t = std::move(q.tasks.front());
+			q.tasks.pop_front();
+			found = true;
+		}
+	}
+	if (!found)
+		return false;
+	m_queued--;
+	t.fn();
+	t.group->m_pending--;
+	return true;
+}
+/**
+*
+* @param worker
+*/
+void work_stealing_pool::worker_main(u32 worker)
+{
+	t_pool = this;
+	t_worker = worker;
+	while (true) {
+		if (run_one())
+			continue;
+		std::unique_lock<std::mutex> lock(m_sleep_mutex);
+		m_wake.wait(lock, [this]() { return m_quit || m_queued > 0; });
+		if (m_quit)
+			return;
+	}
+}
+
+/**
+*
+* @param task
+*/
+void task_group::spawn(std::function<void()> task)
+{
+	m_pending++;
+	pool().push({ std::move(task), this });
+}
+/**
+*
+*/
+void task_group::wait()
+{
+	if (m_pending == 0)
+		return;
+	work_stealing_pool& p = pool();
+	while (m_pending > 0) {
+		// help, tasks of other groups are fine too
+		if (!p.run_one())
+			std::this_thread::yield();
+	}
+}
+
+/**
+*
+* @return
+*/
+u32 worker_count()
+{
+	if (g_worker_count)
+		return g_worker_count;
+	return glm::max(1u, std::thread::hardware_concurrency());
+}
+/**
+*
+* @param count
+*/
+void set_worker_count(u32 count)
+{
+	g_worker_count = count;
+}
+/**
+*
+* @param count
+* @param min_chunk
+* @return
+*/
+u32 parallel_chunks(size_t count, size_t min_chunk)
+{
+	min_chunk = glm::max(min_chunk, (size_t)1);
+	size_t chunks = (count + min_chunk - 1) / min_chunk;
+	return (u32)glm::clamp(chunks, (size_t)1, (size_t)worker_count());
+}
+/**
+*
+* @param count
+* @param min_chunk
+* @param fn
+*/
+void parallel_for(size_t count, size_t min_chunk, const std::function<void(size_t, size_t, u32)>& fn)
+{
+	if (count == 0)
+		return;
+	const u32 chunks = parallel_chunks(count, min_chunk);
+	// balanced, no chunk is empty
+	auto run = [&fn, count, chunks](u32 chunk) {
+		size_t begin = count * chunk / chunks;
+		size_t end = count * (chunk + 1) / chunks;
+		fn(begin, end, chunk);
+	};
+	if (chunks == 1) {
+		run(0);
+		return;
+	}
+	// last chunk in this thread
+	task_group group;
+	for (u32 i = 0; i + 1 < chunks; ++i)
+		group.spawn([&run, i]() { run(i); });
+	run(chunks - 1);
+	group.wait();
+}
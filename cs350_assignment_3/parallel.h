@@ -0,0 +1,40 @@
+/**
+* @file parallel.h
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Declare simple data parallel helpers
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// threads used by parallel algorithms (hardware concurrency by default)
+u32 worker_count();
+// 0 restores hardware concurrency, do not call while tasks are running
+void set_worker_count(u32 count);
+
+// counts the unfinished tasks spawned through it
+// tasks go to the deque of the spawning worker, idle workers steal from the other end
+class task_group {
+public:
+	task_group() = default;
+	task_group(const task_group&) = delete;
+	task_group& operator=(const task_group&) = delete;
+	~task_group() { wait(); }
+
+	// task may spawn more tasks in this group
+	void spawn(std::function<void()> task);
+	// runs queued tasks until every task of the group is done
+	void wait();
+private:
+	friend class work_stealing_pool;
+	std::atomic<u32> m_pending{ 0 };
+};
+
+// chunks parallel_for will use for this range (same split every call)
+u32 parallel_chunks(size_t count, size_t min_chunk);
+// fn(begin, end, chunk) for contiguous chunks of [0, count), blocks until all done
+void parallel_for(size_t count, size_t min_chunk, const std::function<void(size_t, size_t, u32)>& fn);
+
+#endif	// PARALLEL_H
@@ -17,13 +17,26 @@
 #include <iomanip>
 #include <array>
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
 #include <set>
 #include <vector>
 #include <string>
 #include <bitset>
 #include <stack>
+#include <tuple>
+#include <algorithm>
 #include <memory>	// smart pointers
+#include <functional>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+
+// SIMD
+#include <immintrin.h>
 
 // glm
 #include <glm/glm.hpp>
@@ -48,6 +61,7 @@
 #define NOT_NAMED_UNIONS 0
 
 #include "types.h"
+#include "simd.h"
 #include "singleton.h"
 #include "shapes.h"
 #include "color.h"
@@ -58,7 +72,13 @@
 #include "camera.h"
 #include "frame_rate_controller.h"
 #include "object.h"
+#include "parallel.h"
 #include "bounding_volume.h"
+#include "wide_bvh.h"
+#include "pair_manager.h"
+#include "sweep_and_prune.h"
+#include "hash_grid.h"
+#include "loose_octree.h"
 
 #include "demo.h"
 
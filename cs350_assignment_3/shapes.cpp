@@ -46,6 +46,37 @@ Ray::Ray(const vec3& _start, const vec3& _dir)
 {
 	assert(!glm::epsilonEqual(glm::length2(_dir), 0.f, FLT_EPSILON));
 }
+RayQuery::RayQuery(const Ray& r)
+	: ray(r)
+{
+	alignas(16) float inv[4] = { 0.f, 0.f, 0.f, 0.f };
+	for (int i = 0; i < 3; ++i) {
+		sign[i] = r.dir[i] < 0.f;
+		inv[i] = r.dir[i] != 0.f ? 1.f / r.dir[i] : FLT_MAX;
+	}
+	origin = _mm_setr_ps(r.start.x, r.start.y, r.start.z, 0.f);
+	inv_dir = _mm_load_ps(inv);
+}
+/**
+*
+* @param rays
+* @param count	up to WIDTH, the other lanes are inactive
+*/
+template<u32 WIDTH>
+RayPacket<WIDTH>::RayPacket(const Ray* rays, u32 count)
+	: active((1u << count) - 1)
+{
+	assert(count <= WIDTH);
+	for (u32 i = 0; i < WIDTH; ++i) {
+		for (int a = 0; a < 3; ++a) {
+			float dir = i < count ? rays[i].dir[a] : 0.f;
+			origin[a][i] = i < count ? rays[i].start[a] : 0.f;
+			inv_dir[a][i] = dir != 0.f ? 1.f / dir : FLT_MAX;
+		}
+	}
+}
+template struct RayPacket<4>;
+template struct RayPacket<8>;
 Sphere::Sphere(const vec3& _center, float _radius)
 	: center(_center), radius(_radius)
 {
@@ -81,6 +112,16 @@ Frustum::Frustum(const mat4& view_proj_mtx)
 	planes[5] = Plane({ plane_midpoints[5], ndc[7], ndc[6] });	// -Z
 	
 }
+FrustumQuery::FrustumQuery(const Frustum& f)
+	: frustum(f)
+{
+	for (int a = 0; a < 3; ++a) {
+		for (int i = 0; i < 8; ++i) {
+			normal[a][i] = i < 6 ? f.planes[i].normal[a] : 0.f;
+			point[a][i] = i < 6 ? f.planes[i].get_point()[a] : 0.f;
+		}
+	}
+}
 /**
 *
 * @return
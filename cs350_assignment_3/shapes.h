@@ -55,6 +55,26 @@ struct Ray
 	Ray() = default;
 	Ray(const vec3& _start, const vec3& _dir);
 };
+// ray with what the slab test needs computed once, for testing many boxes
+struct RayQuery
+{
+	__m128 origin;		// start, w = 0
+	__m128 inv_dir;		// 1 / dir, +-FLT_MAX for zero components (no infinities), w = 0
+	u32 sign[3];		// 1 if dir is negative on that axis (max is the near plane)
+	Ray ray;
+
+	explicit RayQuery(const Ray& r);
+};
+// up to WIDTH rays as structure of arrays, lane i is ray i
+template<u32 WIDTH>
+struct RayPacket
+{
+	alignas(32) float origin[3][WIDTH];
+	alignas(32) float inv_dir[3][WIDTH];	// same values as RayQuery
+	u32 active;								// lanes holding a ray
+
+	RayPacket(const Ray* rays, u32 count);
+};
 // {center, radius)
 struct Sphere
 {
@@ -69,7 +89,7 @@ struct AABB
 {
 	vec3 min_point, max_point;
 
-	inline float surface_area() const { return 2.f * glm::compAdd(max_point - min_point); }
+	inline float surface_area() const { vec3 d = max_point - min_point; return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x); }
 	inline vec3 center() const { return (max_point - min_point) / 2.f + min_point; }
 };
 struct Frustum
@@ -82,6 +102,15 @@ struct Frustum
 
 	std::vector<vec3> get_points() const;
 };
+// frustum planes as structure of arrays, for testing many boxes against the six planes at once
+struct FrustumQuery
+{
+	alignas(32) float normal[3][8];		// lane i is planes[i], lanes 6 and 7 are zero
+	alignas(32) float point[3][8];		// planes[i].get_point()
+	Frustum frustum;
+
+	explicit FrustumQuery(const Frustum& f);
+};
 
 
 #endif
@@ -0,0 +1,65 @@
+/**
+* @file simd.h
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Define 4 and 8 wide float registers
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#ifndef SIMD_H
+#define SIMD_H
+
+// WIDTH floats in one register (two SSE halves for 8 without AVX)
+template<u32 WIDTH> struct simd;
+template<> struct simd<4> {
+	using type = __m128;
+	static inline type load(const float* p) { return _mm_load_ps(p); }
+	static inline type loadu(const float* p) { return _mm_loadu_ps(p); }
+	static inline type set(float f) { return _mm_set1_ps(f); }
+	static inline type sub(type a, type b) { return _mm_sub_ps(a, b); }
+	static inline type mul(type a, type b) { return _mm_mul_ps(a, b); }
+	static inline type add(type a, type b) { return _mm_add_ps(a, b); }
+	static inline type min(type a, type b) { return _mm_min_ps(a, b); }
+	static inline type max(type a, type b) { return _mm_max_ps(a, b); }
+	static inline type le(type a, type b) { return _mm_cmple_ps(a, b); }
+	static inline type both(type a, type b) { return _mm_and_ps(a, b); }
+	static inline u32 mask(type a) { return (u32)_mm_movemask_ps(a); }
+	static inline void store(float* p, type a) { _mm_store_ps(p, a); }
+};
+#ifdef __AVX__
+template<> struct simd<8> {
+	using type = __m256;
+	static inline type load(const float* p) { return _mm256_load_ps(p); }
+	static inline type loadu(const float* p) { return _mm256_loadu_ps(p); }
+	static inline type set(float f) { return _mm256_set1_ps(f); }
+	static inline type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+	static inline type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+	static inline type add(type a, type b) { return _mm256_add_ps(a, b); }
+	static inline type min(type a, type b) { return _mm256_min_ps(a, b); }
+	static inline type max(type a, type b) { return _mm256_max_ps(a, b); }
+	static inline type le(type a, type b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static inline type both(type a, type b) { return _mm256_and_ps(a, b); }
+	static inline u32 mask(type a) { return (u32)_mm256_movemask_ps(a); }
+	static inline void store(float* p, type a) { _mm256_store_ps(p, a); }
+};
+#else
+// no AVX, two SSE halves
+template<> struct simd<8> {
+	struct type { __m128 lo, hi; };
+	using half = simd<4>;
+	static inline type load(const float* p) { return { half::load(p), half::load(p + 4) }; }
+	static inline type loadu(const float* p) { return { half::loadu(p), half::loadu(p + 4) }; }
+	static inline type set(float f) { return { half::set(f), half::set(f) }; }
+	static inline type sub(type a, type b) { return { half::sub(a.lo, b.lo), half::sub(a.hi, b.hi) }; }
+	static inline type mul(type a, type b) { return { half::mul(a.lo, b.lo), half::mul(a.hi, b.hi) }; }
+	static inline type add(type a, type b) { return { half::add(a.lo, b.lo), half::add(a.hi, b.hi) }; }
+	static inline type min(type a, type b) { return { half::min(a.lo, b.lo), half::min(a.hi, b.hi) }; }
+	static inline type max(type a, type b) { return { half::max(a.lo, b.lo), half::max(a.hi, b.hi) }; }
+	static inline type le(type a, type b) { return { half::le(a.lo, b.lo), half::le(a.hi, b.hi) }; }
+	static inline type both(type a, type b) { return { half::both(a.lo, b.lo), half::both(a.hi, b.hi) }; }
+	static inline u32 mask(type a) { return half::mask(a.lo) | half::mask(a.hi) << 4; }
+	static inline void store(float* p, type a) { half::store(p, a.lo); half::store(p + 4, a.hi); }
+};
+#endif
+
+#endif	// SIMD_H
@@ -0,0 +1,330 @@
+/**
+* @file sweep_and_prune.cpp
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Implement sweep and prune broadphase
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#include "pch.h"
+
+/**
+*
+* @param e
+* @param handle
+* @param ab
+*/
+void sweep_and_prune::set_entry(u32 e, u32 handle, const AABB& ab)
+{
+	for (int k = 0; k < 3; ++k) {
+		m_min[k][e] = ab.min_point[k];
+		m_max[k][e] = ab.max_point[k];
+	}
+	m_handles[e] = handle;
+	m_rank[handle] = e;
+}
+/**
+*
+* @param e
+*/
+void sweep_and_prune::set_padding(u32 e)
+{
+	for (int k = 0; k < 3; ++k) {
+		m_min[k][e] = FLT_MAX;
+		m_max[k][e] = -FLT_MAX;
+	}
+	m_handles[e] = invalid_index;
+}
+/**
+*
+* @param from
+* @param to
+*/
+void sweep_and_prune::move_entry(u32 from, u32 to)
+{
+	for (int k = 0; k < 3; ++k) {
+		m_min[k][to] = m_min[k][from];
+		m_max[k][to] = m_max[k][from];
+	}
+	m_handles[to] = m_handles[from];
+	m_rank[m_handles[to]] = to;
+}
+/**
+*
+* @brief the entries between the old and the new place shift by one
+* @param e
+* @return
+*/
+bool sweep_and_prune::sift(u32 e)
+{
+	const std::vector<float>& order = m_min[m_axis];
+	const float key = order[e];
+	u32 to = e;
+	while (to > 0 && order[to - 1] > key)
+		to--;
+	if (to == e)
+		while (to + 1 < m_count && order[to + 1] < key)
+			to++;
+	if (to == e)
+		return false;
+	const u32 handle = m_handles[e];
+	const AABB ab = entry_aabb(e);
+	if (to < e)
+		for (u32 i = e; i > to; --i)
+			move_entry(i - 1, i);
+	else
+		for (u32 i = e; i < to; ++i)
+			move_entry(i + 1, i);
+	set_entry(to, handle, ab);
+	return true;
+}
+/**
+*
+* @brief 8 entries per step, sorted mins make the in-range lanes a prefix. Lanes past the last entry
+*	are masked out, the padding only keeps the loads valid (its min passes an unbounded ab)
+* @param begin
+* @param ab
+* @param emit
+*/
+template<typename EMIT>
+void sweep_and_prune::sweep(u32 begin, const AABB& ab, EMIT& emit) const
+{
+	using S = simd<8>;
+	const S::type limit = S::set(ab.max_point[m_axis]);
+	S::type lo[3], hi[3];
+	for (int k = 0; k < 3; ++k) {
+		lo[k] = S::set(ab.min_point[k]);
+		hi[k] = S::set(ab.max_point[k]);
+	}
+	for (u32 e = begin; e < m_count; e += 8) {
+		const u32 valid = m_count - e >= 8 ? 0xFFu : (1u << (m_count - e)) - 1u;
+		const S::type in_range = S::le(S::loadu(&m_min[m_axis][e]), limit);
+		S::type hit = in_range;
+		for (int k = 0; k < 3; ++k)
+			hit = S::both(hit, S::both(S::le(S::loadu(&m_min[k][e]), hi[k]), S::le(lo[k], S::loadu(&m_max[k][e]))));
+		for (u32 mask = S::mask(hit) & valid; mask; mask &= mask - 1)
+			emit(e + (u32)glm::findLSB(mask));
+		if ((S::mask(in_range) & valid) != 0xFFu)
+			return;
+	}
+}
+/**
+*
+* @param ab
+* @return
+*/
+u32 sweep_and_prune::lower_bound(const AABB& ab) const
+{
+	const float* order = m_min[m_axis].data();
+	return (u32)(std::lower_bound(order, order + m_count, ab.min_point[m_axis] - m_max_extent) - order);
+}
+
+/**
+*
+* @param objects
+*/
+void sweep_and_prune::build(const std::vector<Object*>& objects)
+{
+	destroy();
+	if (objects.empty())
+		return;
+	// axis with the largest variance of the centers
+	vec3 sum{ 0.f }, sum2{ 0.f };
+	for (const Object* obj : objects) {
+		const vec3 c = (obj->get_aabb().min_point + obj->get_aabb().max_point) * 0.5f;
+		sum += c;
+		sum2 += c * c;
+	}
+	const vec3 variance = sum2 / (float)objects.size() - (sum * sum) / ((float)objects.size() * (float)objects.size());
+	m_axis = variance.x >= variance.y && variance.x >= variance.z ? 0 : (variance.y >= variance.z ? 1 : 2);
+
+	m_count = (u32)objects.size();
+	std::vector<u32> order(m_count);
+	for (u32 i = 0; i < m_count; ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [this, &objects](u32 a, u32 b) {
+		return objects[a]->get_aabb().min_point[m_axis] < objects[b]->get_aabb().min_point[m_axis];
+	});
+	for (int k = 0; k < 3; ++k) {
+		m_min[k].assign(m_count + padding, FLT_MAX);
+		m_max[k].assign(m_count + padding, -FLT_MAX);
+	}
+	m_handles.assign(m_count + padding, invalid_index);
+	m_objects.assign(objects.begin(), objects.end());
+	m_rank.resize(m_count);
+	for (u32 e = 0; e < m_count; ++e) {
+		Object* obj = objects[order[e]];
+		assert(obj->get_sap_proxy() == invalid_index);
+		const AABB& ab = obj->get_aabb();
+		set_entry(e, order[e], ab);
+		obj->set_sap_proxy(order[e]);
+		m_max_extent = glm::max(m_max_extent, ab.max_point[m_axis] - ab.min_point[m_axis]);
+	}
+}
+/**
+*
+* @param obj
+* @return
+*/
+u32 sweep_and_prune::add_object(Object& obj)
+{
+	const u32 proxy = obj.get_sap_proxy();
+	if (proxy < m_objects.size() && m_objects[proxy] == &obj)
+		return invalid_index;
+	u32 handle;
+	if (!m_free_handles.empty()) {
+		handle = m_free_handles.back();
+		m_free_handles.pop_back();
+		m_objects[handle] = &obj;
+	}
+	else {
+		handle = (u32)m_objects.size();
+		m_objects.push_back(&obj);
+		m_rank.push_back(invalid_index);
+	}
+	obj.set_sap_proxy(handle);
+
+	const u32 e = m_count++;
+	for (int k = 0; k < 3; ++k) {
+		m_min[k].resize(m_count + padding, FLT_MAX);
+		m_max[k].resize(m_count + padding, -FLT_MAX);
+	}
+	m_handles.resize(m_count + padding, invalid_index);
+	const AABB& ab = obj.get_aabb();
+	set_entry(e, handle, ab);
+	m_max_extent = glm::max(m_max_extent, ab.max_point[m_axis] - ab.min_point[m_axis]);
+	sift(e);
+	return handle;
+}
+/**
+*
+* @param obj
+* @return
+*/
+bool sweep_and_prune::remove_object(Object& obj)
+{
+	const u32 handle = obj.get_sap_proxy();
+	if (handle >= m_objects.size() || m_objects[handle] != &obj)
+		return false;
+	for (u32 e = m_rank[handle]; e + 1 < m_count; ++e)
+		move_entry(e + 1, e);
+	m_count--;
+	set_padding(m_count);
+	for (int k = 0; k < 3; ++k) {
+		m_min[k].resize(m_count + padding);
+		m_max[k].resize(m_count + padding);
+	}
+	m_handles.resize(m_count + padding);
+	m_objects[handle] = nullptr;
+	m_rank[handle] = invalid_index;
+	m_free_handles.push_back(handle);
+	obj.set_sap_proxy(invalid_index);
+	return true;
+}
+/**
+*
+* @param obj
+* @return
+*/
+bool sweep_and_prune::move_object(Object& obj)
+{
+	const u32 handle = obj.get_sap_proxy();
+	if (handle >= m_objects.size() || m_objects[handle] != &obj)
+		return false;
+	const AABB& ab = obj.get_aabb();
+	const u32 e = m_rank[handle];
+	set_entry(e, handle, ab);
+	m_max_extent = glm::max(m_max_extent, ab.max_point[m_axis] - ab.min_point[m_axis]);
+	return sift(e);
+}
+/**
+*
+*/
+void sweep_and_prune::destroy()
+{
+	for (Object* obj : m_objects)
+		if (obj)
+			obj->set_sap_proxy(invalid_index);
+	for (int k = 0; k < 3; ++k) {
+		m_min[k].clear();
+		m_max[k].clear();
+	}
+	m_handles.clear();
+	m_objects.clear();
+	m_rank.clear();
+	m_free_handles.clear();
+	m_count = 0;
+	m_max_extent = 0.f;
+}
+
+/**
+*
+* @param ab
+* @param visitor	called once for every object whose cached aabb overlaps ab
+*/
+void sweep_and_prune::query_aabb(const AABB& ab, const bvh_object_callback& visitor) const
+{
+	if (empty())
+		return;
+	auto emit = [this, &visitor](u32 e) { visitor(*m_objects[m_handles[e]]); };
+	sweep(lower_bound(ab), ab, emit);
+}
+/**
+*
+* @brief every entry sweeps forward until the mins pass its max, so each pair is found once
+* @param fn	called once for every pair of objects whose aabbs overlap
+*/
+void sweep_and_prune::query_overlapping_pairs(const bvh_pair_callback& fn) const
+{
+	for (u32 i = 0; i < m_count; ++i) {
+		Object& obj = *m_objects[m_handles[i]];
+		auto emit = [this, &fn, &obj](u32 e) { fn(obj, *m_objects[m_handles[e]]); };
+		sweep(i + 1, entry_aabb(i), emit);
+	}
+}
+/**
+*
+* @param other	may sweep along another axis
+* @param fn	fn(obj, other_obj)
+*/
+void sweep_and_prune::query_overlapping_pairs(const sweep_and_prune& other, const bvh_pair_callback& fn) const
+{
+	if (other.empty())
+		return;
+	for (u32 i = 0; i < m_count; ++i) {
+		Object& obj = *m_objects[m_handles[i]];
+		const AABB ab = entry_aabb(i);
+		auto emit = [&other, &fn, &obj](u32 e) { fn(obj, *other.m_objects[other.m_handles[e]]); };
+		other.sweep(other.lower_bound(ab), ab, emit);
+	}
+}
+/**
+*
+* @brief contiguous ranges of entries are swept by the workers, each with its own result list
+* @param pairs	found pairs are appended, same order every call
+* @param other	null for a self query
+*/
+void sweep_and_prune::query_overlapping_pairs_parallel(std::vector<bvh_object_pair>& pairs, const sweep_and_prune* other) const
+{
+	if (empty() || (other && other->empty()))
+		return;
+	const size_t min_chunk = 1024;
+	std::vector<std::vector<bvh_object_pair>> found(parallel_chunks(m_count, min_chunk));
+	parallel_for(m_count, min_chunk, [this, other, &found](size_t begin, size_t end, u32 chunk) {
+		std::vector<bvh_object_pair>& result = found[chunk];
+		for (u32 i = (u32)begin; i < (u32)end; ++i) {
+			Object* obj = m_objects[m_handles[i]];
+			const AABB ab = entry_aabb(i);
+			if (!other) {
+				auto emit = [this, &result, obj](u32 e) { result.push_back({ obj, m_objects[m_handles[e]] }); };
+				sweep(i + 1, ab, emit);
+			}
+			else {
+				auto emit = [other, &result, obj](u32 e) { result.push_back({ obj, other->m_objects[other->m_handles[e]] }); };
+				other->sweep(other->lower_bound(ab), ab, emit);
+			}
+		}
+	});
+	for (const auto& f : found)
+		pairs.insert(pairs.end(), f.begin(), f.end());
+}
@@ -0,0 +1,79 @@
+/**
+* @file sweep_and_prune.h
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Declare sweep and prune broadphase
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#ifndef SWEEP_AND_PRUNE_H
+#define SWEEP_AND_PRUNE_H
+
+// objects sorted by aabb min on one axis (sort and sweep). Moves restore the order with insertion sort steps,
+// cheap when objects move little between frames, so it suits scenes where most objects move
+class sweep_and_prune {
+public:
+	static constexpr u32 invalid_index = ~0u;
+	static constexpr u32 padding = 8;	// one simd<8> load past the last entry is always valid
+
+private:
+	// entries in sweep order, structure of arrays so a sweep tests 8 candidates at once.
+	// padding entries have min = FLT_MAX and max = -FLT_MAX, sweeps mask them out anyway
+	std::vector<float> m_min[3];
+	std::vector<float> m_max[3];
+	std::vector<u32> m_handles;			// handle of each entry
+	// by handle (the handles of the objects)
+	std::vector<Object*> m_objects;		// null for released handles
+	std::vector<u32> m_rank;			// entry of each handle
+	std::vector<u32> m_free_handles;
+	u32 m_count = 0;					// entries without padding
+	int m_axis = 0;						// sweep axis, entries are sorted by m_min[m_axis]
+	float m_max_extent = 0.f;			// upper bound of the entry sizes on the sweep axis (only grows until the next build)
+
+	// write ab into entry e
+	void set_entry(u32 e, u32 handle, const AABB& ab);
+	void set_padding(u32 e);
+	void move_entry(u32 from, u32 to);
+	inline AABB entry_aabb(u32 e) const {
+		return AABB{ vec3{ m_min[0][e], m_min[1][e], m_min[2][e] }, vec3{ m_max[0][e], m_max[1][e], m_max[2][e] } };
+	}
+	// insertion sort step of entry e, returns true if it changed place
+	bool sift(u32 e);
+	// emit(e) for entries from begin on whose box overlaps ab, stops at the first min past ab or the last entry
+	template<typename EMIT>
+	void sweep(u32 begin, const AABB& ab, EMIT& emit) const;
+	// first entry that may overlap ab
+	u32 lower_bound(const AABB& ab) const;
+
+public:
+	sweep_and_prune() = default;
+	~sweep_and_prune() { destroy(); }
+	// sweeps along the axis with the largest spread of the centers
+	void build(const std::vector<Object*>& objects);
+	// returns the handle of obj (also stored on it), invalid_index if already in it
+	u32 add_object(Object& obj);
+	// linear in the entries after obj
+	bool remove_object(Object& obj);
+	// re-read the aabb of obj and put it back in order, return true if it changed place
+	bool move_object(Object& obj);
+	void destroy();
+
+	// every object whose aabb overlaps (or touches) ab
+	void query_aabb(const AABB& ab, const bvh_object_callback& visitor) const;
+	// every pair of objects whose aabbs overlap (or touch), each pair once
+	void query_overlapping_pairs(const bvh_pair_callback& fn) const;
+	// every object of this against every object of other, the first object of each pair from this
+	void query_overlapping_pairs(const sweep_and_prune& other, const bvh_pair_callback& fn) const;
+	// same pairs on the worker pool, other is null for a self query
+	void query_overlapping_pairs_parallel(std::vector<bvh_object_pair>& pairs, const sweep_and_prune* other = nullptr) const;
+
+	inline bool empty() const { return m_count == 0; }
+	inline size_t object_count() const { return m_count; }
+	inline int axis() const { return m_axis; }
+	// cached aabb of a handle
+	inline AABB object_aabb(u32 handle) const { return entry_aabb(m_rank[handle]); }
+};
+
+using SAP = sweep_and_prune;
+
+#endif	// SWEEP_AND_PRUNE_H
@@ -205,10 +205,10 @@ namespace {
 		// build BOTTOM UP
 		bvh.build_bottom_up(objects_ptr);
 		// check containment
-		auto is_contained = [](const BVH::node& n) {
+		auto is_contained = [&bvh](const BVH::node& n) {
 			// if bv added but surface area same as parent, contained
 			float surf_area = n.bounding_volume.surface_area();
-			for (auto c : n.children) {
+			for (auto c : bvh.children(n)) {
 				if (c) {
 					const AABB& ab0 = n.bounding_volume;
 					const AABB& ab1 = c->bounding_volume;
@@ -235,10 +235,10 @@ namespace {
 		// build TOP DOWN
 		bvh.build_top_down(objects_ptr);
 		// check containment
-		auto is_contained = [](const BVH::node& n) {
+		auto is_contained = [&bvh](const BVH::node& n) {
 			// if bv added but surface area same as parent, contained
 			float surf_area = n.bounding_volume.surface_area();
-			for (auto c : n.children) {
+			for (auto c : bvh.children(n)) {
 				if (c) {
 					const AABB& ab0 = n.bounding_volume;
 					const AABB& ab1 = c->bounding_volume;
@@ -261,10 +261,10 @@ namespace {
 		for (auto &o : objects)
 			bvh.add_object(o);
 		// check containment
-		auto is_contained = [](const BVH::node& n) {
+		auto is_contained = [&bvh](const BVH::node& n) {
 			// if bv added but surface area same as parent, contained
 			float surf_area = n.bounding_volume.surface_area();
-			for (auto c : n.children) {
+			for (auto c : bvh.children(n)) {
 				if (c) {
 					const AABB& ab0 = n.bounding_volume;
 					const AABB& ab1 = c->bounding_volume;
@@ -280,4 +280,1643 @@ namespace {
 	}
 
 #endif
-}
\ No newline at end of file
+
+	/**
+	*
+	* @param bvh
+	* @return objects referenced by the leaves
+	*/
+	std::vector<const Object*> collect_objects(const BVH& bvh)
+	{
+		std::vector<const Object*> result;
+		bvh.traverse_preorder([&](const BVH::node& n) {
+			for (u32 i = 0; i < n.count; ++i)
+				result.push_back(bvh.object(n, i));
+		});
+		return result;
+	}
+	/**
+	*
+	* @param bvh
+	*/
+	void expect_valid_tree(const BVH& bvh)
+	{
+		bvh.traverse_preorder([&bvh](const BVH::node& n) {
+			if (n.is_leaf()) {
+				for (u32 i = 0; i < n.count; ++i) {
+					const AABB& ab = bvh.object(n, i)->get_aabb();
+					// cache used by the queries
+					EXPECT_TRUE(bvh.object_aabb(n, i).min_point == ab.min_point && bvh.object_aabb(n, i).max_point == ab.max_point);
+					EXPECT_TRUE(glm::all(glm::lessThanEqual(n.bounding_volume.min_point, ab.min_point)));
+					EXPECT_TRUE(glm::all(glm::greaterThanEqual(n.bounding_volume.max_point, ab.max_point)));
+				}
+				return;
+			}
+			for (auto c : bvh.children(n)) {
+				ASSERT_NE(c, nullptr);
+				EXPECT_EQ(bvh.parent(*c), &n);
+				EXPECT_TRUE(glm::all(glm::lessThanEqual(n.bounding_volume.min_point, c->bounding_volume.min_point)));
+				EXPECT_TRUE(glm::all(glm::greaterThanEqual(n.bounding_volume.max_point, c->bounding_volume.max_point)));
+			}
+		});
+	}
+
+	TEST(bv_hierarchy, flat_top_down_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy bvh;
+		bvh.build_top_down(objects_ptr);
+		// one object per leaf, every node used
+		EXPECT_EQ(bvh.node_capacity(), 2 * objects.size() - 1);
+		expect_valid_tree(bvh);
+		auto found = collect_objects(bvh);
+		std::sort(found.begin(), found.end());
+		std::vector<const Object*> expected(objects_ptr.begin(), objects_ptr.end());
+		std::sort(expected.begin(), expected.end());
+		EXPECT_EQ(found, expected);
+	}
+	TEST(bv_hierarchy, sah_top_down_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy midpoint;
+		midpoint.build_top_down(objects_ptr);
+		bounding_volume_hierarchy sah;
+		sah.build_config().split = bvh_split_sah;
+		sah.build_top_down(objects_ptr);
+		expect_valid_tree(sah);
+		EXPECT_EQ(collect_objects(sah).size(), objects.size());
+		// same costs for both, sah must be cheaper
+		EXPECT_LT(sah.sah_cost(), midpoint.sah_cost());
+	}
+	TEST(bv_hierarchy, flat_bottom_up_100)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_100");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy bvh;
+		bvh.build_bottom_up(objects_ptr);
+		EXPECT_EQ(bvh.node_capacity(), 2 * objects.size() - 1);
+		expect_valid_tree(bvh);
+		EXPECT_EQ(collect_objects(bvh).size(), objects.size());
+	}
+	TEST(bv_hierarchy, flat_insert_remove_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		bounding_volume_hierarchy bvh;
+		for (auto &o : objects)
+			EXPECT_NE(bvh.add_object(o), BVH::invalid_index);
+		expect_valid_tree(bvh);
+		EXPECT_EQ(collect_objects(bvh).size(), objects.size());
+		// remove even objects
+		for (size_t i = 0; i < objects.size(); i += 2)
+			EXPECT_TRUE(bvh.remove_object(objects[i]));
+		EXPECT_FALSE(bvh.remove_object(objects[0]));
+		expect_valid_tree(bvh);
+		EXPECT_EQ(collect_objects(bvh).size(), objects.size() / 2);
+		// released nodes are reused
+		size_t capacity = bvh.node_capacity();
+		for (size_t i = 0; i < objects.size(); i += 2)
+			EXPECT_NE(bvh.add_object(objects[i]), BVH::invalid_index);
+		EXPECT_EQ(bvh.node_capacity(), capacity);
+		expect_valid_tree(bvh);
+		// remove all
+		for (auto &o : objects)
+			EXPECT_TRUE(bvh.remove_object(o));
+		EXPECT_EQ(bvh.root(), nullptr);
+	}
+	TEST(bv_hierarchy, linear_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		for (int bits : { 30, 63 }) {
+			bounding_volume_hierarchy bvh;
+			bvh.build_config().morton_bits = bits;
+			bvh.build_linear(objects_ptr);
+			EXPECT_EQ(bvh.node_capacity(), 2 * objects.size() - 1);
+			expect_valid_tree(bvh);
+			auto found = collect_objects(bvh);
+			std::sort(found.begin(), found.end());
+			std::vector<const Object*> expected(objects_ptr.begin(), objects_ptr.end());
+			std::sort(expected.begin(), expected.end());
+			EXPECT_EQ(found, expected);
+		}
+	}
+	TEST(bv_hierarchy, linear_deterministic)
+	{
+		std::vector<Object> objects(20000);
+		for (size_t i = 0; i < objects.size(); ++i) {
+			vec3 pos = glm::linearRand(vec3{ -100.f }, vec3{ 100.f });
+			objects[i].set_aabb(AABB{ pos - vec3{ 0.5f }, pos + vec3{ 0.5f } });
+		}
+		// duplicated centers must also split
+		objects[1].set_aabb(objects[0].get_aabb());
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		u32 workers = worker_count();
+		bounding_volume_hierarchy serial, parallel;
+		set_worker_count(1);
+		serial.build_linear(objects_ptr);
+		set_worker_count(4);
+		parallel.build_linear(objects_ptr);
+		set_worker_count(workers);
+		expect_valid_tree(parallel);
+		ASSERT_EQ(serial.node_capacity(), parallel.node_capacity());
+		std::vector<const BVH::node*> serial_nodes, parallel_nodes;
+		serial.traverse_preorder([&](const BVH::node& n) { serial_nodes.push_back(&n); });
+		parallel.traverse_preorder([&](const BVH::node& n) { parallel_nodes.push_back(&n); });
+		ASSERT_EQ(serial_nodes.size(), parallel_nodes.size());
+		for (size_t i = 0; i < serial_nodes.size(); ++i) {
+			EXPECT_EQ(serial.index(*serial_nodes[i]), parallel.index(*parallel_nodes[i]));
+			EXPECT_TRUE(serial_nodes[i]->bounding_volume.min_point == parallel_nodes[i]->bounding_volume.min_point);
+			EXPECT_TRUE(serial_nodes[i]->bounding_volume.max_point == parallel_nodes[i]->bounding_volume.max_point);
+			if (serial_nodes[i]->is_leaf()) {
+				EXPECT_EQ(serial.object(*serial_nodes[i]), parallel.object(*parallel_nodes[i]));
+			}
+		}
+	}
+	TEST(bv_hierarchy, bottom_up_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy bvh;
+		bvh.build_bottom_up(objects_ptr);
+		EXPECT_EQ(bvh.node_capacity(), 2 * objects.size() - 1);
+		expect_valid_tree(bvh);
+		auto found = collect_objects(bvh);
+		std::sort(found.begin(), found.end());
+		std::vector<const Object*> expected(objects_ptr.begin(), objects_ptr.end());
+		std::sort(expected.begin(), expected.end());
+		EXPECT_EQ(found, expected);
+		// clustering should not be worse than the morton split alone
+		bounding_volume_hierarchy linear;
+		linear.build_linear(objects_ptr);
+		EXPECT_LE(bvh.sah_cost(), linear.sah_cost());
+		// same object everywhere, only ties
+		std::vector<Object> same(64);
+		std::vector<Object*> same_ptr;
+		for (auto &o : same) {
+			o.set_aabb(objects[0].get_aabb());
+			same_ptr.push_back(&o);
+		}
+		bounding_volume_hierarchy ties;
+		ties.build_bottom_up(same_ptr);
+		EXPECT_EQ(collect_objects(ties).size(), same.size());
+	}
+	TEST(bv_hierarchy, bottom_up_deterministic)
+	{
+		std::vector<Object> objects(20000);
+		for (size_t i = 0; i < objects.size(); ++i) {
+			vec3 pos = glm::linearRand(vec3{ -100.f }, vec3{ 100.f });
+			objects[i].set_aabb(AABB{ pos - vec3{ 0.5f }, pos + vec3{ 0.5f } });
+		}
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		u32 workers = worker_count();
+		bounding_volume_hierarchy serial, parallel;
+		set_worker_count(1);
+		serial.build_bottom_up(objects_ptr);
+		set_worker_count(4);
+		parallel.build_bottom_up(objects_ptr);
+		set_worker_count(workers);
+		expect_valid_tree(parallel);
+		EXPECT_EQ(serial.sah_cost(), parallel.sah_cost());
+		std::vector<const Object*> serial_objects = collect_objects(serial);
+		EXPECT_EQ(serial_objects, collect_objects(parallel));
+	}
+	TEST(bv_hierarchy, top_down_parallel_deterministic)
+	{
+		std::vector<Object> objects(50000);
+		for (size_t i = 0; i < objects.size(); ++i) {
+			vec3 pos = glm::linearRand(vec3{ -100.f }, vec3{ 100.f });
+			objects[i].set_aabb(AABB{ pos - vec3{ 0.5f }, pos + vec3{ 0.5f } });
+		}
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		u32 workers = worker_count();
+		for (int split = 0; split < bvh_split_count; ++split) {
+			bounding_volume_hierarchy serial, parallel;
+			serial.build_config().split = parallel.build_config().split = (BVHSplit)split;
+			serial.build_config().parallel_threshold = 0;
+			parallel.build_config().parallel_threshold = 256;
+			serial.build_top_down(objects_ptr);
+			set_worker_count(4);
+			parallel.build_top_down(objects_ptr);
+			set_worker_count(workers);
+			expect_valid_tree(parallel);
+			// same node at the same index
+			ASSERT_EQ(serial.node_capacity(), parallel.node_capacity());
+			std::vector<const BVH::node*> serial_nodes, parallel_nodes;
+			serial.traverse_preorder([&](const BVH::node& n) { serial_nodes.push_back(&n); });
+			parallel.traverse_preorder([&](const BVH::node& n) { parallel_nodes.push_back(&n); });
+			ASSERT_EQ(serial_nodes.size(), parallel_nodes.size());
+			for (size_t i = 0; i < serial_nodes.size(); ++i) {
+				EXPECT_EQ(serial.index(*serial_nodes[i]), parallel.index(*parallel_nodes[i]));
+				EXPECT_TRUE(serial_nodes[i]->bounding_volume.min_point == parallel_nodes[i]->bounding_volume.min_point);
+				EXPECT_TRUE(serial_nodes[i]->bounding_volume.max_point == parallel_nodes[i]->bounding_volume.max_point);
+				if (serial_nodes[i]->is_leaf()) {
+					EXPECT_EQ(serial.object(*serial_nodes[i]), parallel.object(*parallel_nodes[i]));
+				}
+			}
+		}
+	}
+	TEST(bv_hierarchy, refit_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy bvh;
+		bvh.build_top_down(objects_ptr);
+		EXPECT_EQ(bvh.quality_ratio(), 1.f);
+		auto move = [](Object& o, const vec3& delta) {
+			AABB ab = o.get_aabb();
+			o.set_aabb(AABB{ ab.min_point + delta, ab.max_point + delta });
+		};
+		// move a few objects, only their ancestors are refitted
+		std::vector<const Object*> dirty;
+		for (size_t i = 0; i < objects.size(); i += 10) {
+			move(objects[i], glm::linearRand(vec3{ -20.f }, vec3{ 20.f }));
+			dirty.push_back(&objects[i]);
+		}
+		bvh.refit(dirty);
+		expect_valid_tree(bvh);
+		EXPECT_GT(bvh.quality_ratio(), 1.f);
+		// move everything
+		for (auto &o : objects)
+			move(o, glm::linearRand(vec3{ -1.f }, vec3{ 1.f }));
+		bvh.refit();
+		expect_valid_tree(bvh);
+		EXPECT_EQ(collect_objects(bvh).size(), objects.size());
+		// a rebuild keeps the objects of the tree, not the ones it was first built with
+		for (size_t i = 0; i < objects.size(); i += 4)
+			bvh.remove_object(objects[i]);
+		bvh.rebuild();
+		expect_valid_tree(bvh);
+		EXPECT_EQ(bvh.quality_ratio(), 1.f);
+		EXPECT_EQ(collect_objects(bvh).size(), objects.size() - (objects.size() + 3) / 4);
+		for (size_t i = 0; i < objects.size(); ++i)
+			EXPECT_EQ(bvh.contains(objects[i]), i % 4 != 0);
+		// after insertions and removals (an object is in one tree at most)
+		bvh.destroy();
+		bounding_volume_hierarchy dynamic;
+		for (auto &o : objects)
+			dynamic.add_object(o);
+		for (size_t i = 0; i < objects.size(); i += 3)
+			dynamic.remove_object(objects[i]);
+		for (size_t i = 0; i < objects.size(); i += 6)
+			dynamic.add_object(objects[i]);
+		for (auto &o : objects)
+			move(o, glm::linearRand(vec3{ -5.f }, vec3{ 5.f }));
+		dirty.clear();
+		for (auto &o : objects)
+			dirty.push_back(&o);
+		dynamic.refit(dirty);
+		expect_valid_tree(dynamic);
+		const size_t dynamic_count = collect_objects(dynamic).size();
+		dynamic.rebuild();
+		expect_valid_tree(dynamic);
+		EXPECT_EQ(collect_objects(dynamic).size(), dynamic_count);
+	}
+	TEST(bv_hierarchy, fat_leaves_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		bounding_volume_hierarchy bvh;
+		bvh.build_config().fat_leaves = true;
+		bvh.build_config().fat_margin = 0.5f;
+		bvh.build_config().fat_prediction = 0.f;
+		for (auto &o : objects)
+			EXPECT_NE(bvh.add_object(o), BVH::invalid_index);
+		expect_valid_tree(bvh);
+		auto move = [](Object& o, const vec3& delta) {
+			AABB ab = o.get_aabb();
+			o.set_aabb(AABB{ ab.min_point + delta, ab.max_point + delta });
+		};
+		// small motion stays in the fat box
+		for (auto &o : objects) {
+			move(o, vec3{ 0.25f, 0.f, -0.25f });
+			EXPECT_FALSE(bvh.move_object(o));
+		}
+		EXPECT_EQ(bvh.counters().moves, objects.size());
+		EXPECT_EQ(bvh.counters().reinsertions, 0u);
+		// big motion reinserts
+		for (size_t i = 0; i < objects.size(); i += 2) {
+			move(objects[i], vec3{ 1.f, 0.f, 0.f });
+			EXPECT_TRUE(bvh.move_object(objects[i]));
+		}
+		EXPECT_EQ(bvh.counters().reinsertions, objects.size() / 2);
+		EXPECT_FLOAT_EQ(bvh.counters().reinsertion_rate(), 1.f / 3.f);
+		expect_valid_tree(bvh);
+		EXPECT_EQ(collect_objects(bvh).size(), objects.size());
+		// velocity extends the box only forward
+		Object fast;
+		fast.set_aabb(AABB{ vec3{ 0.f }, vec3{ 1.f } });
+		fast.set_vel(vec3{ 10.f, 0.f, 0.f });
+		bounding_volume_hierarchy predicted;
+		predicted.build_config().fat_leaves = true;
+		predicted.build_config().fat_margin = 0.f;
+		predicted.build_config().fat_prediction = 0.5f;
+		predicted.add_object(fast);
+		move(fast, vec3{ 4.f, 0.f, 0.f });
+		EXPECT_FALSE(predicted.move_object(fast));
+		move(fast, vec3{ -4.f, 0.f, 0.f });
+		EXPECT_FALSE(predicted.move_object(fast));
+		move(fast, vec3{ -0.5f, 0.f, 0.f });
+		EXPECT_TRUE(predicted.move_object(fast));
+		bvh.reset_counters();
+		EXPECT_EQ(bvh.counters().moves, 0u);
+	}
+	TEST(bv_hierarchy, fat_leaves_build_1000)
+	{
+		const auto original = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		// every builder stores the enlarged boxes, small motions right after a build do not reinsert
+		for (int builder = 0; builder < 3; ++builder) {
+			for (int max_leaf_size : { 1, 4 }) {
+				auto objects = original;
+				std::vector<Object*> objects_ptr;
+				for (auto &o : objects)
+					objects_ptr.push_back(&o);
+				bounding_volume_hierarchy bvh;
+				bvh.build_config().fat_leaves = true;
+				bvh.build_config().fat_margin = 0.5f;
+				bvh.build_config().fat_prediction = 0.f;
+				bvh.build_config().max_leaf_size = max_leaf_size;
+				if (builder == 0)
+					bvh.build_top_down(objects_ptr);
+				else if (builder == 1)
+					bvh.build_bottom_up(objects_ptr);
+				else
+					bvh.build_linear(objects_ptr);
+				expect_valid_tree(bvh);
+				EXPECT_FLOAT_EQ(bvh.quality_ratio(), 1.f);
+				for (auto &o : objects) {
+					const AABB ab = o.get_aabb();
+					o.set_aabb(AABB{ ab.min_point + vec3{ 0.25f, 0.f, -0.25f }, ab.max_point + vec3{ 0.25f, 0.f, -0.25f } });
+					EXPECT_FALSE(bvh.move_object(o));
+				}
+				EXPECT_EQ(bvh.counters().moves, objects.size());
+				EXPECT_EQ(bvh.counters().reinsertions, 0u) << "builder " << builder << ", max leaf size " << max_leaf_size;
+			}
+		}
+	}
+	TEST(bv_hierarchy, object_handles_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		bounding_volume_hierarchy bvh;
+		for (auto &o : objects) {
+			u32 proxy = bvh.add_object(o);
+			ASSERT_NE(proxy, BVH::invalid_index);
+			EXPECT_EQ(o.get_bvh_proxy(), proxy);
+		}
+		// already in the tree
+		EXPECT_EQ(bvh.add_object(objects[0]), BVH::invalid_index);
+		// handles survive other removals
+		for (size_t i = 0; i < objects.size(); i += 2) {
+			u32 proxy = objects[i + 1].get_bvh_proxy();
+			EXPECT_TRUE(bvh.remove_object(objects[i]));
+			EXPECT_EQ(objects[i].get_bvh_proxy(), BVH::invalid_index);
+			EXPECT_EQ(objects[i + 1].get_bvh_proxy(), proxy);
+			EXPECT_FALSE(bvh.contains(objects[i]));
+			EXPECT_TRUE(bvh.contains(objects[i + 1]));
+		}
+		EXPECT_FALSE(bvh.remove_object(objects[0]));
+		expect_valid_tree(bvh);
+		// update goes straight to the leaf
+		for (size_t i = 1; i < objects.size(); i += 2) {
+			AABB ab = objects[i].get_aabb();
+			objects[i].set_aabb(AABB{ ab.min_point + vec3{ 3.f }, ab.max_point + vec3{ 3.f } });
+			EXPECT_TRUE(bvh.update_object(objects[i]));
+		}
+		EXPECT_FALSE(bvh.update_object(objects[0]));
+		expect_valid_tree(bvh);
+		// builders assign the handles too
+		std::vector<Object*> objects_ptr;
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy built;
+		built.build_top_down(objects_ptr);
+		// the build took the objects of the first tree, destroying that one leaves their handles alone
+		for (size_t i = 1; i < objects.size(); i += 2)
+			EXPECT_FALSE(bvh.contains(objects[i]));
+		bvh.destroy();
+		// same build twice, same handles in the same slots: only the last tree has them
+		bounding_volume_hierarchy again;
+		again.build_top_down(objects_ptr);
+		for (auto &o : objects)
+			EXPECT_FALSE(built.contains(o));
+		again.destroy();
+		for (auto &o : objects)
+			EXPECT_FALSE(built.remove_object(o));
+		built.destroy();
+		built.build_top_down(objects_ptr);
+		for (auto &o : objects)
+			EXPECT_TRUE(built.remove_object(o));
+		EXPECT_EQ(built.root(), nullptr);
+
+		// multi-object leaves move objects between slots, their handles stay
+		bounding_volume_hierarchy leaves;
+		leaves.build_config().max_leaf_size = 8;
+		leaves.build_config().fat_leaves = true;
+		leaves.build_top_down(objects_ptr);
+		std::vector<u32> handles;
+		for (auto &o : objects)
+			handles.push_back(o.get_bvh_proxy());
+		EXPECT_EQ(std::set<u32>(handles.begin(), handles.end()).size(), objects.size());
+		for (size_t i = 0; i < objects.size(); i += 3)
+			EXPECT_TRUE(leaves.remove_object(objects[i]));
+		for (size_t i = 0; i < objects.size(); ++i) {
+			if (i % 3 == 0)
+				continue;
+			EXPECT_EQ(objects[i].get_bvh_proxy(), handles[i]);
+			EXPECT_TRUE(leaves.contains(objects[i]));
+			// reinsertion keeps the handle too
+			AABB ab = objects[i].get_aabb();
+			objects[i].set_aabb(AABB{ ab.min_point + vec3{ 5.f }, ab.max_point + vec3{ 5.f } });
+			leaves.move_object(objects[i]);
+			EXPECT_EQ(objects[i].get_bvh_proxy(), handles[i]);
+		}
+		EXPECT_GT(leaves.counters().reinsertions, 0u);
+		expect_valid_tree(leaves);
+		// released handles are reused by new objects
+		for (size_t i = 0; i < objects.size(); i += 3) {
+			const u32 handle = leaves.add_object(objects[i]);
+			EXPECT_EQ(handle, objects[i].get_bvh_proxy());
+			EXPECT_LT(handle, objects.size());
+		}
+		EXPECT_EQ(collect_objects(leaves).size(), objects.size());
+		// out of every tree after a destroy, the objects can go to another one
+		leaves.destroy();
+		bounding_volume_hierarchy next;
+		for (auto &o : objects)
+			EXPECT_NE(next.add_object(o), BVH::invalid_index);
+	}
+	TEST(bv_hierarchy, rotations_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		// worst insertion order for the greedy descent
+		std::sort(objects.begin(), objects.end(), [](const Object& a, const Object& b) {
+			return a.get_aabb().min_point.x < b.get_aabb().min_point.x;
+		});
+		// an object is in one tree at most, the plain tree gets copies
+		auto plain_objects = objects;
+		bounding_volume_hierarchy plain, rotated;
+		rotated.build_config().rotations = true;
+		for (auto &o : plain_objects)
+			plain.add_object(o);
+		for (auto &o : objects)
+			rotated.add_object(o);
+		expect_valid_tree(rotated);
+		EXPECT_EQ(collect_objects(rotated).size(), objects.size());
+		EXPECT_LT(rotated.sah_cost(), plain.sah_cost());
+		// handles still point to the right leaves
+		for (size_t i = 0; i < objects.size(); i += 2)
+			EXPECT_TRUE(rotated.remove_object(objects[i]));
+		expect_valid_tree(rotated);
+		// optimize with a node budget
+		float before = plain.sah_cost();
+		u32 rotations = 0;
+		for (int pass = 0; pass < 8; ++pass)
+			rotations += plain.optimize((u32)plain.node_capacity());
+		EXPECT_GT(rotations, 0u);
+		EXPECT_LT(plain.sah_cost(), before);
+		expect_valid_tree(plain);
+		EXPECT_EQ(collect_objects(plain).size(), objects.size());
+		// no budget, no rotations
+		EXPECT_EQ(plain.optimize(0), 0u);
+	}
+	TEST(bv_hierarchy, branch_and_bound_insertion_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		// an object is in one tree at most, the greedy tree gets copies
+		auto greedy_objects = objects;
+		bounding_volume_hierarchy greedy, bounded;
+		bounded.build_config().insertion = bvh_insertion_branch_and_bound;
+		for (auto &o : greedy_objects)
+			greedy.add_object(o);
+		for (auto &o : objects)
+			EXPECT_NE(bounded.add_object(o), BVH::invalid_index);
+		expect_valid_tree(bounded);
+		EXPECT_EQ(collect_objects(bounded).size(), objects.size());
+		EXPECT_LT(bounded.sah_cost(), greedy.sah_cost());
+		// siblings may be intermediate nodes, removal must still work
+		for (size_t i = 0; i < objects.size(); i += 2)
+			EXPECT_TRUE(bounded.remove_object(objects[i]));
+		expect_valid_tree(bounded);
+		EXPECT_EQ(collect_objects(bounded).size(), objects.size() / 2);
+	}
+	TEST(bv_hierarchy, multi_object_leaves_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		for (int builder = 0; builder < 3; ++builder) {
+			bounding_volume_hierarchy single, bvh;
+			bvh.build_config().max_leaf_size = 8;
+			// testing objects cheaper than visiting nodes
+			single.build_config().traversal_cost = bvh.build_config().traversal_cost = 2.f;
+			single.build_config().intersection_cost = bvh.build_config().intersection_cost = 1.f;
+			switch (builder) {
+			case 0: single.build_top_down(objects_ptr); bvh.build_top_down(objects_ptr); break;
+			case 1: single.build_bottom_up(objects_ptr); bvh.build_bottom_up(objects_ptr); break;
+			case 2: single.build_linear(objects_ptr); bvh.build_linear(objects_ptr); break;
+			}
+			expect_valid_tree(bvh);
+			auto found = collect_objects(bvh);
+			std::sort(found.begin(), found.end());
+			std::vector<const Object*> expected(objects_ptr.begin(), objects_ptr.end());
+			std::sort(expected.begin(), expected.end());
+			EXPECT_EQ(found, expected);
+			// fewer nodes, never more expensive
+			u32 max_count = 0;
+			bvh.traverse_preorder([&](const BVH::node& n) { max_count = glm::max(max_count, n.count); });
+			EXPECT_GT(max_count, 1u);
+			EXPECT_LE(max_count, 8u);
+			EXPECT_LT(bvh.node_capacity(), single.node_capacity());
+			EXPECT_LE(bvh.sah_cost(), single.sah_cost() * 1.0001f);
+		}
+		// removal and insertion with multi-object leaves
+		bounding_volume_hierarchy bvh;
+		bvh.build_config().max_leaf_size = 4;
+		bvh.build_config().traversal_cost = 2.f;
+		bvh.build_top_down(objects_ptr);
+		for (size_t i = 0; i < objects.size(); i += 3)
+			EXPECT_TRUE(bvh.remove_object(objects[i]));
+		expect_valid_tree(bvh);
+		EXPECT_EQ(collect_objects(bvh).size(), objects.size() - (objects.size() + 2) / 3);
+		for (size_t i = 0; i < objects.size(); i += 3) {
+			EXPECT_FALSE(bvh.remove_object(objects[i]));
+			EXPECT_NE(bvh.add_object(objects[i]), BVH::invalid_index);
+		}
+		expect_valid_tree(bvh);
+		for (auto &o : objects)
+			EXPECT_TRUE(bvh.remove_object(o));
+		EXPECT_EQ(bvh.root(), nullptr);
+	}
+	/**
+	*
+	* @brief oriented box given as six inward planes
+	* @param center
+	* @param half
+	* @return
+	*/
+	Frustum make_box_frustum(const vec3& center, const vec3& half)
+	{
+		mat3 r = glm::mat3_cast(glm::angleAxis(glm::linearRand(0.f, glm::two_pi<float>()), glm::sphericalRand(1.f)));
+		std::array<Plane, 6> planes;
+		for (int i = 0; i < 3; ++i) {
+			planes[2 * i] = Plane(r[i], center - r[i] * half[i]);
+			planes[2 * i + 1] = Plane(-r[i], center + r[i] * half[i]);
+		}
+		return Frustum(planes);
+	}
+	/**
+	*
+	* @brief wide tree queries must find exactly what brute force finds
+	* @param bvh
+	* @param objects
+	*/
+	template<u32 WIDTH>
+	void expect_same_queries(const BVH& bvh, const std::vector<Object>& objects)
+	{
+		wide_bounding_volume_hierarchy<WIDTH> wide;
+		wide.build(bvh);
+		EXPECT_EQ(wide.primitive_count(), objects.size());
+		EXPECT_LT(wide.node_count(), bvh.node_capacity());
+
+		std::vector<Object*> found;
+		std::vector<const Object*> got, expected;
+		for (int q = 0; q < 100; ++q) {
+			vec3 p = glm::linearRand(vec3{ -10.f }, vec3{ 10.f });
+			AABB ab{ p - vec3{ 1.5f }, p + vec3{ 1.5f } };
+			Frustum f = make_box_frustum(p, glm::linearRand(vec3{ 0.5f }, vec3{ 4.f }));
+			for (int type = 0; type < 2; ++type) {
+				found.clear();
+				expected.clear();
+				if (type == 0)
+					wide.query_aabb(ab, found);
+				else
+					wide.query_frustum(f, found);
+				for (auto& o : objects) {
+					const AABB& b = o.get_aabb();
+					bool overlap = type == 0
+						? glm::all(glm::lessThanEqual(b.min_point, ab.max_point)) && glm::all(glm::lessThanEqual(ab.min_point, b.max_point))
+						: intersection_frustum_aabb(f, b) != OUTSIDE;
+					if (overlap)
+						expected.push_back(&o);
+				}
+				got.assign(found.begin(), found.end());
+				std::sort(got.begin(), got.end());
+				std::sort(expected.begin(), expected.end());
+				EXPECT_EQ(got, expected);
+			}
+			// closest hit
+			Ray r(glm::linearRand(vec3{ -15.f }, vec3{ 15.f }), glm::sphericalRand(1.f));
+			if (q % 10 == 0)
+				r.dir = vec3{ 0.f, 0.f, q % 20 ? 1.f : -1.f };	// zero components
+			float closest_t = FLT_MAX;
+			for (auto& o : objects) {
+				float t = intersection_ray_aabb(r, o.get_aabb());
+				if (t >= 0.f)
+					closest_t = glm::min(closest_t, t);
+			}
+			float t = -1.f;
+			Object* hit = wide.raycast(r, t);
+			if (closest_t == FLT_MAX) {
+				EXPECT_EQ(hit, nullptr);
+			}
+			else {
+				ASSERT_NE(hit, nullptr);
+				EXPECT_NEAR(t, closest_t, 1e-4f);
+				EXPECT_NEAR(intersection_ray_aabb(r, hit->get_aabb()), closest_t, 1e-4f);
+			}
+		}
+	}
+	TEST(bv_hierarchy, wide_queries_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy bvh;
+		bvh.build_top_down(objects_ptr);
+		expect_same_queries<4>(bvh, objects);
+		expect_same_queries<8>(bvh, objects);
+		// multi-object leaves
+		bvh.build_config().max_leaf_size = 4;
+		bvh.build_config().traversal_cost = 2.f;
+		bvh.destroy();
+		bvh.build_bottom_up(objects_ptr);
+		expect_same_queries<4>(bvh, objects);
+		expect_same_queries<8>(bvh, objects);
+
+		// refit follows the objects
+		BVH4 wide;
+		wide.build(bvh);
+		for (auto& o : objects) {
+			AABB ab = o.get_aabb();
+			o.set_aabb(AABB{ ab.min_point + vec3{ 100.f }, ab.max_point + vec3{ 100.f } });
+		}
+		wide.refit();
+		std::vector<Object*> found;
+		wide.query_aabb(AABB{ vec3{ -20.f }, vec3{ 20.f } }, found);
+		EXPECT_TRUE(found.empty());
+		wide.query_aabb(AABB{ vec3{ 80.f }, vec3{ 120.f } }, found);
+		EXPECT_EQ(found.size(), objects.size());
+		// single leaf and empty trees
+		bvh.destroy();
+		bounding_volume_hierarchy one;
+		one.add_object(objects[0]);
+		wide.build(one);
+		found.clear();
+		wide.query_aabb(objects[0].get_aabb(), found);
+		EXPECT_EQ(found.size(), 1u);
+		one.destroy();
+		wide.build(one);
+		EXPECT_TRUE(wide.empty());
+		float t = 0.f;
+		EXPECT_EQ(wide.raycast(Ray(vec3{ 0.f }, vec3{ 1.f, 0.f, 0.f }), t), nullptr);
+	}
+	TEST(bv_hierarchy, raycast_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy bvh;
+		bvh.build_config().max_leaf_size = 4;
+		bvh.build_config().traversal_cost = 2.f;
+		bvh.build_top_down(objects_ptr);
+		for (int q = 0; q < 200; ++q) {
+			Ray r(glm::linearRand(vec3{ -15.f }, vec3{ 15.f }), glm::sphericalRand(1.f));
+			float t_max = q % 4 ? FLT_MAX : 3.f;
+			float closest_t = FLT_MAX, narrow_t = FLT_MAX;
+			for (auto& o : objects) {
+				float t = intersection_ray_aabb(r, o.get_aabb());
+				if (t < 0.f || t > t_max)
+					continue;
+				closest_t = glm::min(closest_t, t);
+				if ((&o - objects.data()) % 2 == 0)
+					narrow_t = glm::min(narrow_t, t);
+			}
+			bvh_ray_hit hit = bvh.raycast_closest(r, t_max);
+			Object* any = bvh.raycast_any(r, t_max);
+			if (closest_t == FLT_MAX) {
+				EXPECT_EQ(hit.object, nullptr);
+				EXPECT_EQ(any, nullptr);
+				continue;
+			}
+			ASSERT_NE(hit.object, nullptr);
+			EXPECT_EQ(hit.t, closest_t);
+			EXPECT_EQ(intersection_ray_aabb(r, hit.object->get_aabb()), closest_t);
+			ASSERT_NE(any, nullptr);
+			EXPECT_GE(intersection_ray_aabb(r, any->get_aabb()), 0.f);
+			EXPECT_LE(intersection_ray_aabb(r, any->get_aabb()), t_max);
+
+			// narrow phase that only accepts half of the objects
+			hit = bvh.raycast_closest(r, t_max, [&](Object& o, float) {
+				return (&o - objects.data()) % 2 ? -1.f : intersection_ray_aabb(r, o.get_aabb());
+			});
+			if (narrow_t == FLT_MAX) {
+				EXPECT_EQ(hit.object, nullptr);
+			}
+			else {
+				ASSERT_NE(hit.object, nullptr);
+				EXPECT_EQ((hit.object - objects.data()) % 2, 0);
+				EXPECT_EQ(hit.t, narrow_t);
+			}
+		}
+
+		// sorted insertions make a deep tree, the traversal stack must grow
+		std::vector<Object> line(300);
+		for (int i = 0; i < (int)line.size(); ++i)
+			line[i].set_aabb(AABB{ vec3{ (float)i, 0.f, 0.f }, vec3{ i + 0.5f, 1.f, 1.f } });
+		bounding_volume_hierarchy deep;
+		for (auto& o : line)
+			deep.add_object(o);
+		for (int i = 0; i < (int)line.size(); i += 7) {
+			bvh_ray_hit hit = deep.raycast_closest(Ray(vec3{ i + 0.25f, 0.5f, 10.f }, vec3{ 0.f, 0.f, -1.f }));
+			EXPECT_EQ(hit.object, &line[i]);
+			EXPECT_EQ(hit.t, 9.f);
+		}
+		bvh_ray_hit hit = deep.raycast_closest(Ray(vec3{ -1.f, 0.5f, 0.5f }, vec3{ 1.f, 0.f, 0.f }));
+		EXPECT_EQ(hit.object, &line[0]);
+		EXPECT_EQ(deep.raycast_any(Ray(vec3{ -1.f, 0.5f, 0.5f }, vec3{ 1.f, 0.f, 0.f }), 0.5f), nullptr);
+	}
+	/**
+	*
+	* @brief packets must return the same hits as one ray at a time
+	* @param bvh
+	* @param rays
+	* @param t_max
+	*/
+	template<u32 WIDTH>
+	void expect_same_packet_hits(const BVH& bvh, const std::vector<Ray>& rays, float t_max)
+	{
+		std::array<bvh_ray_hit, WIDTH> hits;
+		for (size_t i = 0; i < rays.size(); i += WIDTH) {
+			// last packet may be partial
+			u32 count = (u32)glm::min(rays.size() - i, (size_t)WIDTH);
+			bvh.raycast_packet(RayPacket<WIDTH>(&rays[i], count), hits.data(), t_max);
+			for (u32 lane = 0; lane < count; ++lane) {
+				bvh_ray_hit expected = bvh.raycast_closest(rays[i + lane], t_max);
+				EXPECT_EQ(hits[lane].t, expected.t);
+				EXPECT_EQ(hits[lane].object == nullptr, expected.object == nullptr);
+				if (hits[lane].object) {
+					EXPECT_EQ(intersection_ray_aabb(rays[i + lane], hits[lane].object->get_aabb()), expected.t);
+				}
+			}
+		}
+	}
+	TEST(bv_hierarchy, raycast_packet_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy bvh;
+		bvh.build_config().max_leaf_size = 4;
+		bvh.build_config().traversal_cost = 2.f;
+		bvh.build_top_down(objects_ptr);
+
+		// incoherent rays, coherent rays from one point and axis aligned rays
+		std::vector<Ray> rays;
+		for (int i = 0; i < 203; ++i)
+			rays.emplace_back(glm::linearRand(vec3{ -15.f }, vec3{ 15.f }), glm::sphericalRand(1.f));
+		for (int y = 0; y < 16; ++y)
+			for (int x = 0; x < 16; ++x)
+				rays.emplace_back(vec3{ 0.f, 0.f, -20.f }, vec3{ x - 7.5f, y - 7.5f, 20.f });
+		for (int i = 0; i < 37; ++i)
+			rays.emplace_back(glm::linearRand(vec3{ -15.f }, vec3{ 15.f }), vec3{ 0.f, i % 2 ? 1.f : -1.f, 0.f });
+		expect_same_packet_hits<4>(bvh, rays, FLT_MAX);
+		expect_same_packet_hits<8>(bvh, rays, FLT_MAX);
+		expect_same_packet_hits<4>(bvh, rays, 3.f);
+		expect_same_packet_hits<8>(bvh, rays, 3.f);
+
+		// narrow phase per lane, only even objects count
+		std::array<bvh_ray_hit, 8> hits;
+		for (size_t i = 0; i + 8 <= rays.size(); i += 8) {
+			RayPacket<8> packet(&rays[i], 8);
+			bvh.raycast_packet(packet, hits.data(), FLT_MAX, [&](Object& o, u32 lane, float) {
+				return (&o - objects.data()) % 2 ? -1.f : intersection_ray_aabb(rays[i + lane], o.get_aabb());
+			});
+			for (u32 lane = 0; lane < 8; ++lane) {
+				bvh_ray_hit expected = bvh.raycast_closest(rays[i + lane], FLT_MAX, [&](Object& o, float) {
+					return (&o - objects.data()) % 2 ? -1.f : intersection_ray_aabb(rays[i + lane], o.get_aabb());
+				});
+				EXPECT_EQ(hits[lane].t, expected.t);
+				if (hits[lane].object) {
+					EXPECT_EQ((hits[lane].object - objects.data()) % 2, 0);
+				}
+			}
+		}
+	}
+	TEST(bv_hierarchy, raycast_batch_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy bvh;
+		bvh.build_config().max_leaf_size = 4;
+		bvh.build_config().traversal_cost = 2.f;
+		bvh.build_top_down(objects_ptr);
+
+		std::vector<Ray> rays;
+		for (int i = 0; i < 5000; ++i)
+			rays.emplace_back(glm::linearRand(vec3{ -15.f }, vec3{ 15.f }), glm::sphericalRand(1.f));
+		std::vector<bvh_ray_hit> hits(rays.size());
+		bvh_ray_batch batch;
+		// more workers than cores still runs chunks concurrently
+		set_worker_count(4);
+		for (int sort = 0; sort < 2; ++sort) {
+			batch.sort = sort != 0;
+			bvh.raycast_batch(rays.data(), rays.size(), hits.data(), batch);
+			for (size_t i = 0; i < rays.size(); ++i) {
+				bvh_ray_hit expected = bvh.raycast_closest(rays[i]);
+				EXPECT_EQ(hits[i].object, expected.object);
+				EXPECT_EQ(hits[i].t, expected.t);
+				EXPECT_EQ(hits[i].triangle, ~0u);
+			}
+		}
+		// smaller batches reuse the scratch
+		const size_t capacity = batch.keys.capacity();
+		const size_t count = rays.size() / 2;
+		bvh.raycast_batch(rays.data(), count, hits.data(), batch, 5.f, [&](Object& o, const Ray& r, float, u32& triangle) {
+			triangle = (u32)(&o - objects.data());
+			return intersection_ray_aabb(r, o.get_aabb());
+		});
+		EXPECT_EQ(batch.keys.capacity(), capacity);
+		for (size_t i = 0; i < count; ++i) {
+			bvh_ray_hit expected = bvh.raycast_closest(rays[i], 5.f);
+			EXPECT_EQ(hits[i].t, expected.t);
+			if (hits[i].object) {
+				EXPECT_EQ(hits[i].triangle, (u32)(hits[i].object - objects.data()));
+			}
+		}
+		set_worker_count(0);
+		// empty batch and empty tree
+		bvh.raycast_batch(rays.data(), 0, hits.data(), batch);
+		bounding_volume_hierarchy empty;
+		empty.raycast_batch(rays.data(), 10, hits.data(), batch);
+		for (size_t i = 0; i < 10; ++i)
+			EXPECT_EQ(hits[i].object, nullptr);
+	}
+	/**
+	*
+	* @brief query_frustum must report what brute force finds, each object once
+	* @param structure	BVH, loose octree...
+	* @param objects
+	* @param f
+	*/
+	template<typename STRUCTURE>
+	void expect_same_frustum_query(const STRUCTURE& structure, const std::vector<Object>& objects, const Frustum& f)
+	{
+		std::vector<const Object*> got, expected;
+		structure.query_frustum(f, [&got](Object& o) { got.push_back(&o); });
+		for (auto& o : objects)
+			if (intersection_frustum_aabb(f, o.get_aabb()) != OUTSIDE)
+				expected.push_back(&o);
+		std::sort(got.begin(), got.end());
+		std::sort(expected.begin(), expected.end());
+		EXPECT_EQ(got, expected);
+	}
+	TEST(bv_hierarchy, query_frustum_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy bvh;
+		for (int leaf_size : { 1, 4 }) {
+			bvh.destroy();
+			bvh.build_config().max_leaf_size = leaf_size;
+			bvh.build_config().traversal_cost = 2.f;
+			bvh.build_top_down(objects_ptr);
+			for (int q = 0; q < 100; ++q) {
+				vec3 p = glm::linearRand(vec3{ -10.f }, vec3{ 10.f });
+				expect_same_frustum_query(bvh, objects, make_box_frustum(p, glm::linearRand(vec3{ 0.5f }, vec3{ 6.f })));
+				// perspective camera somewhere around the objects
+				Camera camera;
+				camera.pos = p * 2.f;
+				camera.target = glm::linearRand(vec3{ -5.f }, vec3{ 5.f });
+				camera.far = glm::distance(camera.pos, camera.target) + glm::linearRand(1.f, 30.f);
+				const Frustum view = camera.get_frustum();
+				EXPECT_EQ(intersection_frustum_aabb(view, AABB{ camera.target - vec3{ 0.1f }, camera.target + vec3{ 0.1f } }), INSIDE);
+				EXPECT_EQ(intersection_point_plane(2.f * camera.pos - camera.target, view.planes[5], cEpsilon), OUTSIDE);
+				expect_same_frustum_query(bvh, objects, view);
+			}
+			// everything inside, the root accepts the whole tree
+			expect_same_frustum_query(bvh, objects, make_box_frustum(vec3{ 0.f }, vec3{ 1000.f }));
+			u32 count = 0;
+			bvh.query_frustum(make_box_frustum(vec3{ 0.f }, vec3{ 1000.f }), [&count](Object&) { count++; });
+			EXPECT_EQ(count, objects.size());
+		}
+		// dynamic tree, fat leaf boxes must not leak objects out of the frustum
+		bvh.destroy();
+		bvh.build_config() = bvh_build_config{};
+		bvh.build_config().fat_leaves = true;
+		bvh.build_config().fat_margin = 1.f;
+		for (auto& o : objects)
+			bvh.add_object(o);
+		for (int q = 0; q < 100; ++q)
+			expect_same_frustum_query(bvh, objects, make_box_frustum(glm::linearRand(vec3{ -10.f }, vec3{ 10.f }), glm::linearRand(vec3{ 0.5f }, vec3{ 6.f })));
+		// empty tree
+		bvh.destroy();
+		bvh.query_frustum(make_box_frustum(vec3{ 0.f }, vec3{ 1000.f }), [](Object&) { FAIL(); });
+	}
+	TEST(bv_hierarchy, query_frustum_coherence_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		bounding_volume_hierarchy bvh;
+		bvh.build_config().max_leaf_size = 4;
+		bvh.build_top_down(objects_ptr);
+
+		// camera turning slowly around the objects
+		bvh_frustum_cache cache;
+		u64 fresh_plane_tests = 0;
+		std::vector<const Object*> got, expected;
+		Camera camera;
+		camera.far = 20.f;
+		for (int frame = 0; frame < 100; ++frame) {
+			float a = glm::two_pi<float>() * frame / 100.f;
+			camera.pos = vec3{ std::cos(a) * 15.f, 2.f, std::sin(a) * 15.f };
+			camera.target = vec3{ 0.f };
+			const Frustum f = camera.get_frustum();
+			got.clear();
+			expected.clear();
+			bvh.query_frustum(f, [&got](Object& o) { got.push_back(&o); }, cache);
+			bvh.query_frustum(f, [&expected](Object& o) { expected.push_back(&o); });
+			EXPECT_EQ(got, expected);
+			bvh_frustum_cache fresh;
+			bvh.query_frustum(f, [](Object&) {}, fresh);
+			fresh_plane_tests += fresh.stats.plane_tests;
+		}
+		EXPECT_GT(cache.stats.cached_rejections, 0u);
+		EXPECT_LT(cache.stats.plane_tests, fresh_plane_tests);
+
+		// stale entries after the tree changes only cost tests
+		for (int i = 0; i < 200; ++i)
+			bvh.remove_object(objects[i]);
+		got.clear();
+		expected.clear();
+		bvh.query_frustum(camera.get_frustum(), [&got](Object& o) { got.push_back(&o); }, cache);
+		bvh.query_frustum(camera.get_frustum(), [&expected](Object& o) { expected.push_back(&o); });
+		EXPECT_EQ(got, expected);
+	}
+	/**
+	*
+	* @brief every overlapping pair of a and b, smaller pointer first (a == b for the pairs inside one set)
+	* @param a
+	* @param b
+	* @return sorted
+	*/
+	std::vector<bvh_object_pair> brute_force_pairs(std::vector<Object>& a, std::vector<Object>& b)
+	{
+		std::vector<bvh_object_pair> pairs;
+		for (size_t i = 0; i < a.size(); ++i) {
+			for (size_t j = &a == &b ? i + 1 : 0; j < b.size(); ++j) {
+				const AABB& ab0 = a[i].get_aabb();
+				const AABB& ab1 = b[j].get_aabb();
+				if (glm::all(glm::lessThanEqual(ab0.min_point, ab1.max_point)) && glm::all(glm::lessThanEqual(ab1.min_point, ab0.max_point)))
+					pairs.push_back({ std::min(&a[i], &b[j]), std::max(&a[i], &b[j]) });
+			}
+		}
+		std::sort(pairs.begin(), pairs.end());
+		return pairs;
+	}
+	/**
+	*
+	* @param pairs
+	* @return smaller pointer first, sorted (duplicates are kept)
+	*/
+	std::vector<bvh_object_pair> normalized(std::vector<bvh_object_pair> pairs)
+	{
+		for (auto& p : pairs)
+			p = { std::min(p.first, p.second), std::max(p.first, p.second) };
+		std::sort(pairs.begin(), pairs.end());
+		return pairs;
+	}
+	TEST(bv_hierarchy, overlapping_pairs_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		const auto expected = brute_force_pairs(objects, objects);
+		ASSERT_FALSE(expected.empty());
+
+		bounding_volume_hierarchy bvh;
+		std::vector<bvh_object_pair> pairs;
+		auto collect = [&pairs](Object& a, Object& b) { pairs.push_back({ &a, &b }); };
+		for (int leaf_size : { 1, 4 }) {
+			bvh.destroy();
+			bvh.build_config().max_leaf_size = leaf_size;
+			bvh.build_config().traversal_cost = 2.f;
+			bvh.build_top_down(objects_ptr);
+			pairs.clear();
+			bvh.query_overlapping_pairs(collect);
+			EXPECT_EQ(normalized(pairs), expected);
+			// parallel, same pairs in the same order every call
+			set_worker_count(4);
+			std::vector<bvh_object_pair> parallel, again;
+			bvh.query_overlapping_pairs_parallel(parallel);
+			bvh.query_overlapping_pairs_parallel(again);
+			EXPECT_EQ(normalized(parallel), expected);
+			EXPECT_EQ(parallel, again);
+			set_worker_count(0);
+		}
+		// fat leaves only widen the nodes
+		bvh.destroy();
+		bvh.build_config() = bvh_build_config{};
+		bvh.build_config().fat_leaves = true;
+		bvh.build_config().fat_margin = 1.f;
+		for (auto& o : objects)
+			bvh.add_object(o);
+		pairs.clear();
+		bvh.query_overlapping_pairs(collect);
+		EXPECT_EQ(normalized(pairs), expected);
+
+		// static vs dynamic, the first object of each pair comes from the queried tree
+		bvh.destroy();
+		std::vector<Object> statics(objects.begin(), objects.begin() + 600), dynamics(objects.begin() + 600, objects.end());
+		bounding_volume_hierarchy static_bvh, dynamic_bvh;
+		for (auto& o : statics)
+			static_bvh.add_object(o);
+		std::vector<Object*> dynamics_ptr;
+		for (auto& o : dynamics)
+			dynamics_ptr.push_back(&o);
+		dynamic_bvh.build_config().max_leaf_size = 4;
+		dynamic_bvh.build_top_down(dynamics_ptr);
+		pairs.clear();
+		dynamic_bvh.query_overlapping_pairs(static_bvh, collect);
+		for (const auto& p : pairs) {
+			EXPECT_TRUE(p.first >= dynamics.data() && p.first < dynamics.data() + dynamics.size());
+		}
+		const auto expected_cross = brute_force_pairs(statics, dynamics);
+		EXPECT_EQ(normalized(pairs), expected_cross);
+		std::vector<bvh_object_pair> parallel;
+		dynamic_bvh.query_overlapping_pairs_parallel(parallel, &static_bvh);
+		EXPECT_EQ(normalized(parallel), expected_cross);
+
+		// empty trees
+		bounding_volume_hierarchy empty;
+		empty.query_overlapping_pairs([](Object&, Object&) { FAIL(); });
+		empty.query_overlapping_pairs(static_bvh, [](Object&, Object&) { FAIL(); });
+		static_bvh.query_overlapping_pairs(empty, [](Object&, Object&) { FAIL(); });
+	}
+	/**
+	*
+	* @brief applies the events of the last update to pairs, each event must change the set
+	* @param manager
+	* @param pairs	smaller pointer first
+	*/
+	void apply_events(const bvh_pair_manager& manager, std::set<bvh_object_pair>& pairs)
+	{
+		for (const auto& p : normalized(manager.end_events())) {
+			EXPECT_EQ(pairs.erase(p), 1u);
+		}
+		for (const auto& p : normalized(manager.begin_events())) {
+			EXPECT_TRUE(pairs.insert(p).second);
+		}
+	}
+	TEST(bv_hierarchy, pair_manager_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		bounding_volume_hierarchy bvh;
+		bvh.build_config().fat_leaves = true;
+		bvh_pair_manager manager;
+		for (auto& o : objects) {
+			bvh.add_object(o);
+			manager.add_object(o);
+		}
+		manager.update(bvh);
+		std::set<bvh_object_pair> pairs;
+		apply_events(manager, pairs);
+		EXPECT_TRUE(manager.end_events().empty());
+		auto expected = brute_force_pairs(objects, objects);
+		EXPECT_EQ(std::vector<bvh_object_pair>(pairs.begin(), pairs.end()), expected);
+		EXPECT_EQ(manager.pair_count(), expected.size());
+
+		// objects move every frame, the events keep the set up to date. Few moves query object by object,
+		// many moves query the whole tree
+		for (int frame = 0; frame < 20; ++frame) {
+			for (int i = 0; i < (frame % 2 ? 400 : 50); ++i) {
+				Object& o = objects[glm::linearRand<size_t>(0, objects.size() - 1)];
+				const vec3 offset = glm::linearRand(vec3{ -1.f }, vec3{ 1.f });
+				const AABB ab = o.get_aabb();
+				o.set_aabb(AABB{ ab.min_point + offset, ab.max_point + offset });
+				bvh.move_object(o);
+				manager.mark_moved(o);
+			}
+			manager.update(bvh);
+			apply_events(manager, pairs);
+			expected = brute_force_pairs(objects, objects);
+			EXPECT_EQ(std::vector<bvh_object_pair>(pairs.begin(), pairs.end()), expected);
+			EXPECT_EQ(manager.pair_count(), expected.size());
+		}
+		for (const auto& p : expected) {
+			EXPECT_TRUE(manager.overlapping(*p.first, *p.second));
+			EXPECT_TRUE(manager.overlapping(*p.second, *p.first));
+		}
+		EXPECT_FALSE(manager.overlapping(objects[0], objects[0]));
+		// nothing moved, nothing happens
+		manager.update(bvh);
+		EXPECT_TRUE(manager.begin_events().empty());
+		EXPECT_TRUE(manager.end_events().empty());
+
+		// removed objects end their pairs on the next update
+		std::set<const Object*> removed;
+		for (size_t i = 0; i < objects.size(); i += 10) {
+			bvh.remove_object(objects[i]);
+			manager.remove_object(objects[i]);
+			removed.insert(&objects[i]);
+		}
+		EXPECT_EQ(manager.object_count(), objects.size() - removed.size());
+		manager.update(bvh);
+		EXPECT_TRUE(manager.begin_events().empty());
+		apply_events(manager, pairs);
+		expected.erase(std::remove_if(expected.begin(), expected.end(), [&removed](const bvh_object_pair& p) {
+			return removed.count(p.first) || removed.count(p.second);
+		}), expected.end());
+		EXPECT_EQ(std::vector<bvh_object_pair>(pairs.begin(), pairs.end()), expected);
+		// their ids are reused, pairs begin again
+		for (size_t i = 0; i < objects.size(); i += 10) {
+			bvh.add_object(objects[i]);
+			manager.add_object(objects[i]);
+		}
+		manager.update(bvh);
+		EXPECT_TRUE(manager.end_events().empty());
+		apply_events(manager, pairs);
+		EXPECT_EQ(std::vector<bvh_object_pair>(pairs.begin(), pairs.end()), brute_force_pairs(objects, objects));
+
+		manager.clear();
+		EXPECT_EQ(manager.pair_count(), 0u);
+		EXPECT_EQ(objects[0].get_pair_proxy(), bvh_pair_manager::invalid_id);
+	}
+	TEST(bv_hierarchy, query_nearest_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		// the center is inside the aabb, never closer than it
+		const bvh_distance_callback to_center = [](Object& o, const vec3& p, float) { return glm::distance2(o.get_aabb().center(), p); };
+		auto distance2 = [&to_center](Object& o, const vec3& p, bool exact) {
+			return exact ? to_center(o, p, FLT_MAX) : distance2_point_aabb(p, o.get_aabb());
+		};
+		// closest first, ties may come in any order so only the distances are compared
+		auto expect_nearest = [&](const BVH& bvh, const vec3& p, bool exact) {
+			std::vector<float> expected;
+			for (auto& o : objects)
+				expected.push_back(distance2(o, p, exact));
+			std::sort(expected.begin(), expected.end());
+			std::vector<bvh_nearest_hit> hits;
+			for (u32 k : { 1u, 8u, 100u, 2000u }) {
+				bvh.query_nearest(p, k, hits, FLT_MAX, exact ? to_center : nullptr);
+				ASSERT_EQ(hits.size(), glm::min((size_t)k, objects.size()));
+				std::set<Object*> unique;
+				for (size_t j = 0; j < hits.size(); ++j) {
+					EXPECT_EQ(hits[j].distance2, expected[j]);
+					EXPECT_EQ(hits[j].distance2, distance2(*hits[j].object, p, exact));
+					unique.insert(hits[j].object);
+				}
+				EXPECT_EQ(unique.size(), hits.size());
+			}
+			// radius and max distance agree with brute force
+			const float radius = 3.f;
+			std::vector<std::pair<Object*, float>> got, in_radius;
+			bvh.query_radius(p, radius, [&got](Object& o, float d) { got.push_back({ &o, d }); }, exact ? to_center : nullptr);
+			for (auto& o : objects)
+				if (distance2(o, p, exact) <= radius * radius)
+					in_radius.push_back({ &o, distance2(o, p, exact) });
+			std::sort(got.begin(), got.end());
+			EXPECT_EQ(got, in_radius);
+			bvh.query_nearest(p, 2000u, hits, radius, exact ? to_center : nullptr);
+			EXPECT_EQ(hits.size(), in_radius.size());
+		};
+
+		BVH bvh;
+		std::vector<bvh_nearest_hit> hits(1);
+		bvh.query_nearest(vec3{ 0.f }, 8u, hits);
+		EXPECT_TRUE(hits.empty());
+		bvh.build_top_down(objects_ptr);
+		bvh.query_nearest(vec3{ 0.f }, 0u, hits);
+		EXPECT_TRUE(hits.empty());
+		for (int q = 0; q < 20; ++q) {
+			const vec3 p = glm::linearRand(vec3{ -12.f }, vec3{ 12.f });
+			expect_nearest(bvh, p, false);
+			expect_nearest(bvh, p, true);
+		}
+
+		// batch matches the single queries, missing hits are left null
+		std::vector<vec3> points(300);
+		for (auto& p : points)
+			p = glm::linearRand(vec3{ -12.f }, vec3{ 12.f });
+		for (u32 k : { 4u, 1500u }) {
+			std::vector<bvh_nearest_hit> batch(points.size() * k);
+			bvh.query_nearest_batch(points.data(), points.size(), k, batch.data(), FLT_MAX, to_center);
+			for (size_t i = 0; i < points.size(); ++i) {
+				bvh.query_nearest(points[i], k, hits, FLT_MAX, to_center);
+				for (u32 j = 0; j < k; ++j) {
+					if (j < hits.size()) {
+						EXPECT_EQ(batch[i * k + j].object, hits[j].object);
+						EXPECT_EQ(batch[i * k + j].distance2, hits[j].distance2);
+					}
+					else
+						EXPECT_EQ(batch[i * k + j].object, nullptr);
+				}
+			}
+		}
+
+		// dynamic tree with fat leaves, the cached aabbs are the ones of the last move
+		bvh.destroy();
+		BVH dynamic;
+		for (auto& o : objects)
+			dynamic.add_object(o);
+		for (auto& o : objects) {
+			const vec3 offset = glm::linearRand(vec3{ -1.f }, vec3{ 1.f });
+			const AABB ab = o.get_aabb();
+			o.set_aabb(AABB{ ab.min_point + offset, ab.max_point + offset });
+			dynamic.move_object(o);
+		}
+		for (int q = 0; q < 20; ++q)
+			expect_nearest(dynamic, glm::linearRand(vec3{ -12.f }, vec3{ 12.f }), false);
+	}
+	/**
+	*
+	* @brief aabb queries must find exactly what brute force finds
+	* @param structure	sweep and prune, hash grid...
+	* @param objects	only the ones in structure
+	*/
+	template<typename STRUCTURE>
+	void expect_same_aabb_queries(const STRUCTURE& structure, const std::vector<Object*>& objects)
+	{
+		std::vector<Object*> got, expected;
+		for (int q = 0; q < 100; ++q) {
+			const vec3 p = glm::linearRand(vec3{ -10.f }, vec3{ 10.f });
+			const AABB ab{ p - vec3{ 1.5f }, p + vec3{ 1.5f } };
+			got.clear();
+			expected.clear();
+			structure.query_aabb(ab, [&got](Object& o) { got.push_back(&o); });
+			for (Object* o : objects) {
+				const AABB& b = o->get_aabb();
+				if (glm::all(glm::lessThanEqual(b.min_point, ab.max_point)) && glm::all(glm::lessThanEqual(ab.min_point, b.max_point)))
+					expected.push_back(o);
+			}
+			std::sort(got.begin(), got.end());
+			std::sort(expected.begin(), expected.end());
+			EXPECT_EQ(got, expected);
+		}
+	}
+	TEST(sweep_and_prune, pairs_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		sweep_and_prune sap;
+		sap.build(objects_ptr);
+		EXPECT_EQ(sap.object_count(), objects.size());
+		std::vector<bvh_object_pair> pairs;
+		auto collect = [&pairs](Object& a, Object& b) { pairs.push_back({ &a, &b }); };
+		sap.query_overlapping_pairs(collect);
+		EXPECT_EQ(normalized(pairs), brute_force_pairs(objects, objects));
+		expect_same_aabb_queries(sap, objects_ptr);
+		// unbounded boxes pass the padding mins, the sweep must still stop at the last entry
+		for (u32 count : { 1000u, 50u, 3u }) {
+			std::vector<Object> copies(objects.begin(), objects.begin() + count);
+			for (auto& o : copies)
+				o.set_sap_proxy(sweep_and_prune::invalid_index);
+			sweep_and_prune part;
+			for (auto& o : copies)
+				part.add_object(o);
+			for (float size : { 1e10f, FLT_MAX }) {
+				size_t found = 0;
+				part.query_aabb(AABB{ vec3{ -size }, vec3{ size } }, [&found](Object&) { found++; });
+				EXPECT_EQ(found, count);
+			}
+		}
+
+		// objects move, the order is fixed by the insertion sort steps
+		for (int frame = 0; frame < 10; ++frame) {
+			for (auto& o : objects) {
+				const vec3 offset = glm::linearRand(vec3{ -1.f }, vec3{ 1.f });
+				const AABB ab = o.get_aabb();
+				o.set_aabb(AABB{ ab.min_point + offset, ab.max_point + offset });
+				sap.move_object(o);
+			}
+			pairs.clear();
+			sap.query_overlapping_pairs(collect);
+			EXPECT_EQ(normalized(pairs), brute_force_pairs(objects, objects));
+		}
+		expect_same_aabb_queries(sap, objects_ptr);
+		// parallel, same pairs in the same order every call
+		set_worker_count(4);
+		std::vector<bvh_object_pair> parallel, again;
+		sap.query_overlapping_pairs_parallel(parallel);
+		sap.query_overlapping_pairs_parallel(again);
+		EXPECT_EQ(normalized(parallel), normalized(pairs));
+		EXPECT_EQ(parallel, again);
+		set_worker_count(0);
+
+		// removed objects are not found, their handles are reused
+		std::vector<Object*> kept;
+		for (size_t i = 0; i < objects.size(); ++i) {
+			if (i % 10 == 0) {
+				EXPECT_TRUE(sap.remove_object(objects[i]));
+			}
+			else
+				kept.push_back(&objects[i]);
+		}
+		EXPECT_FALSE(sap.remove_object(objects[0]));
+		EXPECT_EQ(sap.object_count(), kept.size());
+		expect_same_aabb_queries(sap, kept);
+		for (size_t i = 0; i < objects.size(); i += 10) {
+			EXPECT_NE(sap.add_object(objects[i]), sweep_and_prune::invalid_index);
+		}
+		EXPECT_EQ(sap.add_object(objects[0]), sweep_and_prune::invalid_index);
+		pairs.clear();
+		sap.query_overlapping_pairs(collect);
+		EXPECT_EQ(normalized(pairs), brute_force_pairs(objects, objects));
+
+		// static vs dynamic, the first object of each pair comes from the queried set
+		std::vector<Object> statics(objects.begin(), objects.begin() + 600), dynamics(objects.begin() + 600, objects.end());
+		sweep_and_prune static_sap, dynamic_sap;
+		for (auto& o : statics)
+			static_sap.add_object(o);
+		std::vector<Object*> dynamics_ptr;
+		for (auto& o : dynamics) {
+			o.set_sap_proxy(sweep_and_prune::invalid_index);
+			dynamics_ptr.push_back(&o);
+		}
+		dynamic_sap.build(dynamics_ptr);
+		pairs.clear();
+		dynamic_sap.query_overlapping_pairs(static_sap, collect);
+		for (const auto& p : pairs) {
+			EXPECT_TRUE(p.first >= dynamics.data() && p.first < dynamics.data() + dynamics.size());
+		}
+		const auto expected_cross = brute_force_pairs(statics, dynamics);
+		EXPECT_EQ(normalized(pairs), expected_cross);
+		parallel.clear();
+		dynamic_sap.query_overlapping_pairs_parallel(parallel, &static_sap);
+		EXPECT_EQ(normalized(parallel), expected_cross);
+
+		sweep_and_prune empty;
+		empty.query_overlapping_pairs([](Object&, Object&) { FAIL(); });
+		empty.query_overlapping_pairs(static_sap, [](Object&, Object&) { FAIL(); });
+		static_sap.query_overlapping_pairs(empty, [](Object&, Object&) { FAIL(); });
+		empty.query_aabb(AABB{ vec3{ -1.f }, vec3{ 1.f } }, [](Object&) { FAIL(); });
+	}
+	/**
+	*
+	* @brief closest hits must match brute force
+	* @param structure	hash grid, loose octree...
+	* @param objects	only the ones in structure
+	*/
+	template<typename STRUCTURE>
+	void expect_same_raycasts(const STRUCTURE& structure, const std::vector<Object*>& objects)
+	{
+		for (int q = 0; q < 100; ++q) {
+			Ray r(glm::linearRand(vec3{ -15.f }, vec3{ 15.f }), glm::sphericalRand(1.f));
+			if (q % 10 == 0)
+				r.dir = vec3{ 0.f, 0.f, q % 20 ? 1.f : -1.f };	// zero components
+			const float t_max = q % 3 ? FLT_MAX : 10.f;
+			float closest_t = FLT_MAX;
+			for (const Object* o : objects) {
+				float t = intersection_ray_aabb(r, o->get_aabb());
+				if (t >= 0.f && t <= t_max)
+					closest_t = glm::min(closest_t, t);
+			}
+			const bvh_ray_hit hit = structure.raycast_closest(r, t_max);
+			Object* any = structure.raycast_any(r, t_max);
+			if (closest_t == FLT_MAX) {
+				EXPECT_EQ(hit.object, nullptr);
+				EXPECT_EQ(any, nullptr);
+			}
+			else {
+				ASSERT_NE(hit.object, nullptr);
+				EXPECT_NEAR(hit.t, closest_t, 1e-4f);
+				EXPECT_NEAR(intersection_ray_aabb(r, hit.object->get_aabb()), closest_t, 1e-4f);
+				ASSERT_NE(any, nullptr);
+				const float t = intersection_ray_aabb(r, any->get_aabb());
+				EXPECT_TRUE(t >= 0.f && t <= t_max);
+			}
+		}
+	}
+	TEST(hash_grid, queries_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		hash_grid grid;
+		std::vector<bvh_object_pair> pairs;
+		auto collect = [&pairs](Object& a, Object& b) { pairs.push_back({ &a, &b }); };
+		// few levels, the biggest objects reach more than one cell. Then 2D
+		for (int level_count : { 8, 3, -8 }) {
+			grid.config().cell_size = 0.25f;
+			grid.config().level_count = glm::abs(level_count);
+			grid.config().columns = level_count < 0;
+			grid.build(objects_ptr);
+			EXPECT_EQ(grid.object_count(), objects.size());
+			EXPECT_GE(grid.bucket_count(), objects.size());
+			pairs.clear();
+			grid.query_overlapping_pairs(collect);
+			EXPECT_EQ(normalized(pairs), brute_force_pairs(objects, objects));
+			expect_same_aabb_queries(grid, objects_ptr);
+			expect_same_raycasts(grid, objects_ptr);
+			// world-sized boxes, their cells do not fit an int
+			for (const AABB& ab : { AABB{ vec3{ -1e10f }, vec3{ 1e10f } }, AABB{ vec3{ -FLT_MAX }, vec3{ FLT_MAX } }, AABB{ vec3{ -1e10f }, vec3{ 0.f } } }) {
+				size_t found = 0, expected = 0;
+				grid.query_aabb(ab, [&found](Object&) { found++; });
+				for (auto& o : objects)
+					expected += glm::all(glm::lessThanEqual(o.get_aabb().min_point, ab.max_point)) && glm::all(glm::lessThanEqual(ab.min_point, o.get_aabb().max_point));
+				EXPECT_EQ(found, expected);
+				EXPECT_GT(found, 0u);
+			}
+			// world-sized objects in the grid: a ground under every ray start, then one containing everything
+			for (const AABB& ab : { AABB{ vec3{ -50000.f }, vec3{ 50000.f, -20.f, 50000.f } }, AABB{ vec3{ -FLT_MAX }, vec3{ FLT_MAX } } }) {
+				Object big;
+				big.set_aabb(ab);
+				grid.add_object(big);
+				auto with_big = objects_ptr;
+				with_big.push_back(&big);
+				expect_same_raycasts(grid, with_big);
+				EXPECT_TRUE(grid.remove_object(big));
+			}
+		}
+
+		// objects move, some change cell or level
+		grid.config().columns = false;
+		grid.build(objects_ptr);
+		for (int frame = 0; frame < 10; ++frame) {
+			for (auto& o : objects) {
+				const vec3 offset = glm::linearRand(vec3{ -1.f }, vec3{ 1.f });
+				const AABB ab = o.get_aabb();
+				const vec3 center = (ab.min_point + ab.max_point) * 0.5f + offset;
+				const vec3 half = (ab.max_point - ab.min_point) * 0.5f * glm::linearRand(0.8f, 1.25f);
+				o.set_aabb(AABB{ center - half, center + half });
+				grid.move_object(o);
+			}
+			pairs.clear();
+			grid.query_overlapping_pairs(collect);
+			EXPECT_EQ(normalized(pairs), brute_force_pairs(objects, objects));
+		}
+		expect_same_aabb_queries(grid, objects_ptr);
+		expect_same_raycasts(grid, objects_ptr);
+		// parallel, same pairs in the same order every call
+		set_worker_count(4);
+		std::vector<bvh_object_pair> parallel, again;
+		grid.query_overlapping_pairs_parallel(parallel);
+		grid.query_overlapping_pairs_parallel(again);
+		EXPECT_EQ(normalized(parallel), normalized(pairs));
+		EXPECT_EQ(parallel, again);
+		set_worker_count(0);
+
+		// removed objects are not found, their handles are reused
+		std::vector<Object*> kept;
+		for (size_t i = 0; i < objects.size(); ++i) {
+			if (i % 10 == 0) {
+				EXPECT_TRUE(grid.remove_object(objects[i]));
+			}
+			else
+				kept.push_back(&objects[i]);
+		}
+		EXPECT_FALSE(grid.remove_object(objects[0]));
+		EXPECT_EQ(grid.object_count(), kept.size());
+		expect_same_aabb_queries(grid, kept);
+		expect_same_raycasts(grid, kept);
+		for (size_t i = 0; i < objects.size(); i += 10) {
+			EXPECT_NE(grid.add_object(objects[i]), hash_grid::invalid_index);
+		}
+		EXPECT_EQ(grid.add_object(objects[0]), hash_grid::invalid_index);
+		pairs.clear();
+		grid.query_overlapping_pairs(collect);
+		EXPECT_EQ(normalized(pairs), brute_force_pairs(objects, objects));
+
+		// static vs dynamic, the first object of each pair comes from the queried grid
+		std::vector<Object> statics(objects.begin(), objects.begin() + 600), dynamics(objects.begin() + 600, objects.end());
+		hash_grid static_grid, dynamic_grid;
+		for (auto& o : statics)
+			static_grid.add_object(o);
+		for (auto& o : dynamics)
+			dynamic_grid.add_object(o);
+		pairs.clear();
+		dynamic_grid.query_overlapping_pairs(static_grid, collect);
+		for (const auto& p : pairs) {
+			EXPECT_TRUE(p.first >= dynamics.data() && p.first < dynamics.data() + dynamics.size());
+		}
+		const auto expected_cross = brute_force_pairs(statics, dynamics);
+		EXPECT_EQ(normalized(pairs), expected_cross);
+		parallel.clear();
+		dynamic_grid.query_overlapping_pairs_parallel(parallel, &static_grid);
+		EXPECT_EQ(normalized(parallel), expected_cross);
+
+		hash_grid empty;
+		empty.query_overlapping_pairs([](Object&, Object&) { FAIL(); });
+		empty.query_overlapping_pairs(static_grid, [](Object&, Object&) { FAIL(); });
+		static_grid.query_overlapping_pairs(empty, [](Object&, Object&) { FAIL(); });
+		empty.query_aabb(AABB{ vec3{ -1.f }, vec3{ 1.f } }, [](Object&) { FAIL(); });
+		EXPECT_EQ(empty.raycast_closest(Ray(vec3{ 0.f }, vec3{ 1.f, 0.f, 0.f })).object, nullptr);
+	}
+	TEST(loose_octree, queries_1000)
+	{
+		auto objects = read_objects("../tests/bounding_volume_hierarchy/random_objects_1000");
+		std::vector<Object*> objects_ptr; objects_ptr.reserve(objects.size());
+		for (auto &o : objects)
+			objects_ptr.push_back(&o);
+		loose_octree octree;
+		auto expect_same = [&objects, &objects_ptr](const loose_octree& octree) {
+			expect_same_aabb_queries(octree, objects_ptr);
+			expect_same_raycasts(octree, objects_ptr);
+			for (int q = 0; q < 20; ++q) {
+				const vec3 p = glm::linearRand(vec3{ -10.f }, vec3{ 10.f });
+				expect_same_frustum_query(octree, objects, make_box_frustum(p, glm::linearRand(vec3{ 0.5f }, vec3{ 6.f })));
+			}
+			expect_same_frustum_query(octree, objects, make_box_frustum(vec3{ 0.f }, vec3{ 1000.f }));
+		};
+		// a plain octree (looseness 1) keeps the objects crossing cell borders higher up
+		for (float looseness : { 2.f, 1.5f, 1.f }) {
+			for (int max_depth : { 8, 2 }) {
+				octree.config().looseness = looseness;
+				octree.config().max_depth = max_depth;
+				octree.build(objects_ptr);
+				EXPECT_EQ(octree.object_count(), objects.size());
+				expect_same(octree);
+				for (auto& o : objects) {
+					const loose_octree::node* n = octree.find(o);
+					ASSERT_NE(n, nullptr);
+					const AABB loose = octree.loose_bounds(*n);
+					EXPECT_TRUE(glm::all(glm::lessThanEqual(loose.min_point, o.get_aabb().min_point)) && glm::all(glm::lessThanEqual(o.get_aabb().max_point, loose.max_point)));
+				}
+			}
+		}
+
+		// small motions stay in the loose cell, bigger ones reinsert
+		octree.config() = loose_octree_config{};
+		octree.build(objects_ptr);
+		u32 reinserted = 0;
+		for (auto& o : objects) {
+			const AABB ab = o.get_aabb();
+			o.set_aabb(AABB{ ab.min_point + vec3{ 0.001f }, ab.max_point + vec3{ 0.001f } });
+			reinserted += octree.move_object(o);
+		}
+		EXPECT_LT(reinserted, objects.size() / 10);
+		expect_same(octree);
+		for (int frame = 0; frame < 10; ++frame) {
+			for (auto& o : objects) {
+				const vec3 offset = glm::linearRand(vec3{ -2.f }, vec3{ 2.f });
+				const AABB ab = o.get_aabb();
+				o.set_aabb(AABB{ ab.min_point + offset, ab.max_point + offset });
+				octree.move_object(o);
+			}
+		}
+		expect_same(octree);
+
+		// removing everything releases the blocks, adding again reuses them
+		const size_t capacity = octree.node_capacity();
+		for (auto& o : objects) {
+			EXPECT_TRUE(octree.remove_object(o));
+		}
+		EXPECT_FALSE(octree.remove_object(objects[0]));
+		EXPECT_TRUE(octree.empty());
+		EXPECT_EQ(octree.root()->total, 0u);
+		EXPECT_EQ(octree.root()->children, loose_octree::invalid_index);
+		for (auto& o : objects) {
+			EXPECT_NE(octree.add_object(o), loose_octree::invalid_index);
+		}
+		EXPECT_EQ(octree.add_object(objects[0]), loose_octree::invalid_index);
+		EXPECT_EQ(octree.node_capacity(), capacity);
+		expect_same(octree);
+
+		// root smaller than the scene, the objects outside stay in the root
+		octree.destroy();
+		octree.config().half_size = 4.f;
+		for (auto& o : objects)
+			octree.add_object(o);
+		EXPECT_GT(octree.root()->count, 0u);
+		expect_same(octree);
+
+		loose_octree empty;
+		empty.query_aabb(AABB{ vec3{ -1.f }, vec3{ 1.f } }, [](Object&) { FAIL(); });
+		empty.query_frustum(make_box_frustum(vec3{ 0.f }, vec3{ 1000.f }), [](Object&) { FAIL(); });
+		EXPECT_EQ(empty.raycast_closest(Ray(vec3{ 0.f }, vec3{ 1.f, 0.f, 0.f })).object, nullptr);
+	}
+}
@@ -518,6 +518,25 @@ namespace{
 		}
 	}
 
+	TEST(geometry, distance_point_aabb)
+	{
+		std::ifstream file("../tests/geometry/in_aabb_point", std::ios::in);
+		ASSERT_TRUE(file.is_open());
+
+		int line = 0;
+		while (!file.eof()){
+			line++;
+			const auto  aabb     = read_aabb(file);
+			const auto  point    = read_point(file, true);
+			const auto  expected = read_intersection_type(file);
+			const float result   = distance2_point_aabb(point, aabb);
+			if (expected == INSIDE)
+				EXPECT_EQ(result, 0.f) << "[Line " << line << "]";
+			else
+				EXPECT_NEAR(result, glm::distance2(point, glm::clamp(point, aabb.min_point, aabb.max_point)), 0.01f) << "[Line " << line << "]";
+		}
+	}
+
 	TEST(geometry, in_ray_plane)
 	{
 		std::ifstream file("../tests/geometry/in_ray_plane", std::ios::in);
@@ -590,6 +609,45 @@ namespace{
 		}
 	}
 
+	TEST(geometry, in_ray_aabb_query)
+	{
+		std::ifstream file("../tests/geometry/in_ray_aabb", std::ios::in);
+		ASSERT_TRUE(file.is_open());
+
+		int line = 0;
+		while (!file.eof()){
+			line++;
+			const auto  ray      = read_ray(file);
+			const auto  aabb     = read_aabb(file);
+			float       expected = 0.0f;
+			file >> expected;
+			const RayQuery query(ray);
+			const float intersection_time = intersection_ray_aabb(query, aabb);
+			EXPECT_FLOAT_EQ_DECS(intersection_time, expected) << "[Line " << line << "]";
+			EXPECT_EQ(intersection_time, intersection_ray_aabb(ray, aabb)) << "[Line " << line << "]";
+			float t_enter, t_exit;
+			EXPECT_EQ(intersection_ray_aabb(query, aabb, t_enter, t_exit), intersection_time >= 0.f) << "[Line " << line << "]";
+		}
+		// random rays, some parallel to an axis
+		for (int i = 0; i < 10000; ++i) {
+			vec3 dir = glm::sphericalRand(1.f);
+			if (i % 4 == 0)
+				dir[i % 3] = 0.f;
+			const Ray ray(glm::linearRand(vec3{ -5.f }, vec3{ 5.f }), dir);
+			const vec3 c = glm::linearRand(vec3{ -3.f }, vec3{ 3.f }), half = glm::linearRand(vec3{ 0.1f }, vec3{ 2.f });
+			const AABB aabb{ c - half, c + half };
+			const RayQuery query(ray);
+			const float expected = intersection_ray_aabb(ray, aabb);
+			EXPECT_EQ(intersection_ray_aabb(query, aabb), expected) << "[Ray " << i << "]";
+			float t_enter, t_exit;
+			if (intersection_ray_aabb(query, aabb, t_enter, t_exit)) {
+				// exit point on the box surface
+				EXPECT_GE(t_exit, t_enter);
+				EXPECT_EQ(intersection_point_aabb(ray.start + ray.dir * (t_enter + t_exit) * 0.5f, AABB{ aabb.min_point - vec3{ 1e-4f }, aabb.max_point + vec3{ 1e-4f } }), INSIDE);
+			}
+		}
+	}
+
 	TEST(geometry, in_plane_triangle)
 	{
 		std::ifstream file("../tests/geometry/in_plane_triangle", std::ios::in);
@@ -676,6 +734,52 @@ namespace{
 		}
 	}
 
+	TEST(geometry, in_frustum_aabb_query)
+	{
+		std::ifstream file("../tests/geometry/in_frustum_aabb", std::ios::in);
+		ASSERT_TRUE(file.is_open());
+
+		std::vector<AABB> boxes;
+		std::vector<intersection_type> expected_results;
+		std::vector<FrustumQuery> queries;
+		int line = 0;
+		while (!file.eof()){
+			line++;
+			const auto  frustum  = read_frustum(file);
+			const auto  aabb     = read_aabb(file);
+			const auto  expected = read_intersection_type(file);
+			const FrustumQuery query(frustum);
+			EXPECT_EQ(intersection_frustum_aabb(query, aabb), expected) << "[Line " << line << "]";
+			u32 planes = (1u << 6) - 1;
+			EXPECT_EQ(intersection_frustum_aabb(query, aabb, planes), expected) << "[Line " << line << "]";
+			EXPECT_EQ(planes == 0, expected == INSIDE) << "[Line " << line << "]";
+			queries.push_back(query);
+			boxes.push_back(aabb);
+			expected_results.push_back(expected);
+		}
+		// batch, one frustum against all the boxes
+		std::vector<intersection_type> results(boxes.size());
+		intersection_frustum_aabb(queries[0], boxes.data(), boxes.size(), results.data());
+		for (size_t i = 0; i < boxes.size(); ++i)
+			EXPECT_EQ(results[i], intersection_frustum_aabb(queries[0].frustum, boxes[i])) << "[Box " << i << "]";
+		// random boxes, same distances as the 8 corner test
+		for (int i = 0; i < 10000; ++i) {
+			const FrustumQuery& query = queries[i % queries.size()];
+			const vec3 c = glm::linearRand(vec3{ -10.f }, vec3{ 10.f }), half = glm::linearRand(vec3{ 0.1f }, vec3{ 5.f });
+			const AABB aabb{ c - half, c + half };
+			EXPECT_EQ(intersection_frustum_aabb(query, aabb), intersection_frustum_aabb(query.frustum, aabb)) << "[Box " << i << "]";
+			for (const Plane& pl : query.frustum.planes) {
+				const intersection_type plane_result = intersection_plane_aabb(pl, aabb);
+				// plane test against the single plane frustum
+				int corner_flags = 0;
+				for (int j = 0; j < 8; ++j)
+					corner_flags |= intersection_point_plane(vec3{ j & 1 ? aabb.max_point.x : aabb.min_point.x,
+						j & 2 ? aabb.max_point.y : aabb.min_point.y, j & 4 ? aabb.max_point.z : aabb.min_point.z }, pl, cEpsilon);
+				EXPECT_EQ(plane_result, corner_flags == INSIDE || corner_flags == OUTSIDE ? corner_flags : OVERLAPS) << "[Box " << i << "]";
+			}
+		}
+	}
+
 	TEST(geometry, in_frustum_sphere)
 	{
 		std::ifstream file("../tests/geometry/in_frustum_sphere", std::ios::in);
@@ -693,6 +797,51 @@ namespace{
 		}
 	}
 
+	TEST(geometry, in_frustum_last_plane)
+	{
+		for (int type = 0; type < 2; ++type) {
+			std::ifstream file(type ? "../tests/geometry/in_frustum_sphere" : "../tests/geometry/in_frustum_aabb", std::ios::in);
+			ASSERT_TRUE(file.is_open());
+
+			int line = 0;
+			while (!file.eof()) {
+				line++;
+				const auto  frustum = read_frustum(file);
+				const auto  aabb = type ? AABB{} : read_aabb(file);
+				const auto  sphere = type ? read_sphere(file) : Sphere{};
+				const auto  expected = read_intersection_type(file);
+				// any plane first gives the same result
+				u8 last_plane = (u8)(line % 6);
+				frustum_cull_stats stats;
+				auto test = [&]() { return type ? intersection_frustum_sphere(frustum, sphere, last_plane, &stats) : intersection_frustum_aabb(frustum, aabb, last_plane, &stats); };
+				EXPECT_EQ(test(), expected) << "[Line " << line << "]";
+				if (expected != OUTSIDE) {
+					EXPECT_EQ(stats.plane_tests, 6u) << "[Line " << line << "]";
+					continue;
+				}
+				// the culling plane is tested alone next time
+				const Plane& pl = frustum.planes[last_plane];
+				EXPECT_EQ(type ? intersection_plane_sphere(pl, sphere) : intersection_plane_aabb(pl, aabb), OUTSIDE) << "[Line " << line << "]";
+				stats = frustum_cull_stats{};
+				EXPECT_EQ(test(), OUTSIDE) << "[Line " << line << "]";
+				EXPECT_EQ(stats.plane_tests, 1u) << "[Line " << line << "]";
+				EXPECT_EQ(stats.cached_rejections, 1u) << "[Line " << line << "]";
+				if (type)
+					continue;
+				// simd version
+				const FrustumQuery query(frustum);
+				u32 planes = (1u << 6) - 1;
+				last_plane = (u8)((last_plane + 1) % 6);
+				EXPECT_EQ(intersection_frustum_aabb(query, aabb, planes, last_plane, &stats), OUTSIDE) << "[Line " << line << "]";
+				EXPECT_EQ(intersection_plane_aabb(frustum.planes[last_plane], aabb), OUTSIDE) << "[Line " << line << "]";
+				planes = (1u << 6) - 1;
+				const u64 cached_rejections = stats.cached_rejections;
+				EXPECT_EQ(intersection_frustum_aabb(query, aabb, planes, last_plane, &stats), OUTSIDE) << "[Line " << line << "]";
+				EXPECT_EQ(stats.cached_rejections, cached_rejections + 1) << "[Line " << line << "]";
+			}
+		}
+	}
+
 	TEST(geometry, in_sphere_sphere)
 	{
 		std::ifstream file("../tests/geometry/in_sphere_sphere", std::ios::in);
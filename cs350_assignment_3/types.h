@@ -17,6 +17,7 @@ using u32 = unsigned int;
 using u64 = unsigned long long int;
 
 using ivec2 = glm::ivec2;
+using ivec3 = glm::ivec3;
 using vec2 = glm::vec2;
 using vec3 = glm::vec3;
 using vec4 = glm::vec4;
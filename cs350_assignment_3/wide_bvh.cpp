@@ -0,0 +1,355 @@
+/**
+* @file wide_bvh.cpp
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Implement 4-wide and 8-wide BVH with SIMD child tests
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#include "pch.h"
+
+namespace {
+	/**
+	*
+	* @param ab0
+	* @param ab1
+	* @return aabb containing both
+	*/
+	inline AABB merge_aabb(const AABB& ab0, const AABB& ab1)
+	{
+		return AABB{ glm::min(ab0.min_point, ab1.min_point), glm::max(ab0.max_point, ab1.max_point) };
+	}
+	/**
+	*
+	* @return aabb that merges into anything and overlaps nothing
+	*/
+	inline AABB empty_aabb()
+	{
+		return AABB{ vec3{ FLT_MAX }, vec3{ -FLT_MAX } };
+	}
+	/**
+	*
+	* @param a
+	* @param b
+	* @return true if a and b overlap (touching counts)
+	*/
+	inline bool overlap_aabb(const AABB& a, const AABB& b)
+	{
+		return a.min_point.x <= b.max_point.x && b.min_point.x <= a.max_point.x
+			&& a.min_point.y <= b.max_point.y && b.min_point.y <= a.max_point.y
+			&& a.min_point.z <= b.max_point.z && b.min_point.z <= a.max_point.z;
+	}
+}
+
+/**
+*
+* @param bvh
+* @param n		intermediate node of bvh
+* @param depth	of n
+* @return index of the new node
+*/
+template<u32 WIDTH>
+u32 wide_bounding_volume_hierarchy<WIDTH>::collapse(const bounding_volume_hierarchy& bvh, const bounding_volume_hierarchy::node& n, u32 depth)
+{
+	m_depth = glm::max(m_depth, depth);
+	// open the biggest intermediate child until every lane is taken
+	std::array<const bounding_volume_hierarchy::node*, WIDTH> lanes{};
+	u32 lane_count = 0;
+	if (n.is_leaf())
+		lanes[lane_count++] = &n;
+	else {
+		auto c = bvh.children(n);
+		lanes[lane_count++] = c[0];
+		lanes[lane_count++] = c[1];
+	}
+	while (lane_count < WIDTH) {
+		u32 best = invalid_index;
+		float best_area = -1.f;
+		for (u32 i = 0; i < lane_count; ++i) {
+			float area = lanes[i]->bounding_volume.surface_area();
+			if (!lanes[i]->is_leaf() && area > best_area) {
+				best = i;
+				best_area = area;
+			}
+		}
+		if (best == invalid_index)
+			break;
+		auto c = bvh.children(*lanes[best]);
+		lanes[best] = c[0];
+		lanes[lane_count++] = c[1];
+	}
+
+	const u32 idx = (u32)m_nodes.size();
+	m_nodes.emplace_back();
+	for (u32 i = 0; i < WIDTH; ++i) {
+		// m_nodes grows while recursing
+		u32 child = invalid_index, count = 0;
+		AABB bv = empty_aabb();
+		if (i < lane_count) {
+			const auto& c = *lanes[i];
+			bv = c.bounding_volume;
+			if (c.is_leaf()) {
+				child = (u32)m_primitives.size();
+				count = c.count;
+				for (u32 j = 0; j < c.count; ++j) {
+					m_primitives.push_back(bvh.object(c, j));
+					m_primitive_aabbs.push_back(bvh.object(c, j)->get_aabb());
+				}
+			}
+			else
+				child = collapse(bvh, c, depth + 1);
+		}
+		node& nd = m_nodes[idx];
+		nd.min_x[i] = bv.min_point.x; nd.min_y[i] = bv.min_point.y; nd.min_z[i] = bv.min_point.z;
+		nd.max_x[i] = bv.max_point.x; nd.max_y[i] = bv.max_point.y; nd.max_z[i] = bv.max_point.z;
+		nd.child[i] = child;
+		nd.count[i] = count;
+	}
+	return idx;
+}
+/**
+*
+* @param bvh
+*/
+template<u32 WIDTH>
+void wide_bounding_volume_hierarchy<WIDTH>::build(const bounding_volume_hierarchy& bvh)
+{
+	destroy();
+	if (!bvh.root())
+		return;
+	m_nodes.reserve(bvh.node_capacity() / (WIDTH - 1) + 1);
+	collapse(bvh, *bvh.root(), 1);
+}
+/**
+*
+*/
+template<u32 WIDTH>
+void wide_bounding_volume_hierarchy<WIDTH>::refit()
+{
+	for (size_t i = 0; i < m_primitives.size(); ++i)
+		m_primitive_aabbs[i] = m_primitives[i]->get_aabb();
+	// children always come after their parent
+	for (u32 idx = (u32)m_nodes.size(); idx-- > 0;) {
+		node& nd = m_nodes[idx];
+		for (u32 i = 0; i < WIDTH; ++i) {
+			if (nd.child[i] == invalid_index)
+				continue;
+			AABB bv = empty_aabb();
+			if (nd.count[i]) {
+				for (u32 j = 0; j < nd.count[i]; ++j)
+					bv = merge_aabb(bv, m_primitive_aabbs[nd.child[i] + j]);
+			}
+			else {
+				const node& c = m_nodes[nd.child[i]];
+				for (u32 j = 0; j < WIDTH; ++j) {
+					bv.min_point = glm::min(bv.min_point, vec3{ c.min_x[j], c.min_y[j], c.min_z[j] });
+					bv.max_point = glm::max(bv.max_point, vec3{ c.max_x[j], c.max_y[j], c.max_z[j] });
+				}
+			}
+			nd.min_x[i] = bv.min_point.x; nd.min_y[i] = bv.min_point.y; nd.min_z[i] = bv.min_point.z;
+			nd.max_x[i] = bv.max_point.x; nd.max_y[i] = bv.max_point.y; nd.max_z[i] = bv.max_point.z;
+		}
+	}
+}
+/**
+*
+*/
+template<u32 WIDTH>
+void wide_bounding_volume_hierarchy<WIDTH>::destroy()
+{
+	m_nodes.clear();
+	m_primitives.clear();
+	m_primitive_aabbs.clear();
+	m_depth = 0;
+}
+
+/**
+*
+* @param n
+* @param ab
+* @return lanes overlapping ab
+*/
+template<u32 WIDTH>
+u32 wide_bounding_volume_hierarchy<WIDTH>::overlap_mask(const node& n, const AABB& ab) const
+{
+	using S = simd<WIDTH>;
+	// empty lanes have min > max and fail on their own
+	auto hit = S::both(S::le(S::load(n.min_x), S::set(ab.max_point.x)), S::le(S::set(ab.min_point.x), S::load(n.max_x)));
+	hit = S::both(hit, S::both(S::le(S::load(n.min_y), S::set(ab.max_point.y)), S::le(S::set(ab.min_point.y), S::load(n.max_y))));
+	hit = S::both(hit, S::both(S::le(S::load(n.min_z), S::set(ab.max_point.z)), S::le(S::set(ab.min_point.z), S::load(n.max_z))));
+	return S::mask(hit);
+}
+/**
+*
+* @brief positive vertex of each lane against each plane, outside if it is behind by more than cEpsilon
+* @param n
+* @param f
+* @return lanes not outside f
+*/
+template<u32 WIDTH>
+u32 wide_bounding_volume_hierarchy<WIDTH>::frustum_mask(const node& n, const Frustum& f) const
+{
+	using S = simd<WIDTH>;
+	const auto min_x = S::load(n.min_x), min_y = S::load(n.min_y), min_z = S::load(n.min_z);
+	const auto max_x = S::load(n.max_x), max_y = S::load(n.max_y), max_z = S::load(n.max_z);
+	u32 mask = (1u << WIDTH) - 1;
+	for (const Plane& pl : f.planes) {
+		// corner farthest along the normal
+		auto d = S::mul(S::set(pl.normal.x), pl.normal.x >= 0.f ? max_x : min_x);
+		d = S::add(d, S::mul(S::set(pl.normal.y), pl.normal.y >= 0.f ? max_y : min_y));
+		d = S::add(d, S::mul(S::set(pl.normal.z), pl.normal.z >= 0.f ? max_z : min_z));
+		d = S::sub(d, S::set(pl.dot_result));
+		mask &= S::mask(S::le(S::set(-cEpsilon), d));
+		if (!mask)
+			break;
+	}
+	return mask;
+}
+
+/**
+*
+* @param ab
+* @param result	objects are appended
+*/
+template<u32 WIDTH>
+void wide_bounding_volume_hierarchy<WIDTH>::query_aabb(const AABB& ab, std::vector<Object*>& result) const
+{
+	if (m_nodes.empty())
+		return;
+	// at most WIDTH - 1 pending siblings per level
+	std::array<u32, 64 * (WIDTH - 1) + 1> local;
+	std::vector<u32> heap;
+	u32* stack = local.data();
+	if (m_depth * (WIDTH - 1) + 1 > local.size()) {
+		heap.resize(m_depth * (WIDTH - 1) + 1);
+		stack = heap.data();
+	}
+	u32 size = 0;
+	stack[size++] = 0;
+	while (size) {
+		const node& n = m_nodes[stack[--size]];
+		for (u32 mask = overlap_mask(n, ab); mask; mask &= mask - 1) {
+			const u32 i = glm::findLSB(mask);
+			if (!n.count[i]) {
+				stack[size++] = n.child[i];
+				continue;
+			}
+			for (u32 j = n.child[i]; j < n.child[i] + n.count[i]; ++j)
+				if (n.count[i] == 1 || overlap_aabb(m_primitive_aabbs[j], ab))
+					result.push_back(m_primitives[j]);
+		}
+	}
+}
+/**
+*
+* @param f
+* @param result	objects are appended
+*/
+template<u32 WIDTH>
+void wide_bounding_volume_hierarchy<WIDTH>::query_frustum(const Frustum& f, std::vector<Object*>& result) const
+{
+	if (m_nodes.empty())
+		return;
+	const FrustumQuery query(f);
+	std::array<u32, 64 * (WIDTH - 1) + 1> local;
+	std::vector<u32> heap;
+	u32* stack = local.data();
+	if (m_depth * (WIDTH - 1) + 1 > local.size()) {
+		heap.resize(m_depth * (WIDTH - 1) + 1);
+		stack = heap.data();
+	}
+	u32 size = 0;
+	stack[size++] = 0;
+	while (size) {
+		const node& n = m_nodes[stack[--size]];
+		for (u32 mask = frustum_mask(n, f); mask; mask &= mask - 1) {
+			const u32 i = glm::findLSB(mask);
+			if (!n.count[i]) {
+				stack[size++] = n.child[i];
+				continue;
+			}
+			for (u32 j = n.child[i]; j < n.child[i] + n.count[i]; ++j)
+				if (intersection_frustum_aabb(query, m_primitive_aabbs[j]) != OUTSIDE)
+					result.push_back(m_primitives[j]);
+		}
+	}
+}
+/**
+*
+* @brief front to back, subtrees farther than the closest hit are skipped
+* @param r
+* @param t		distance to the closest hit (untouched if none)
+* @return
+*/
+template<u32 WIDTH>
+Object* wide_bounding_volume_hierarchy<WIDTH>::raycast(const Ray& r, float& t) const
+{
+	if (m_nodes.empty())
+		return nullptr;
+	using S = simd<WIDTH>;
+	const RayQuery rq(r);
+	alignas(16) float start[4], inv_dir[4];
+	_mm_store_ps(start, rq.origin);
+	_mm_store_ps(inv_dir, rq.inv_dir);
+	const auto start_x = S::set(start[0]), start_y = S::set(start[1]), start_z = S::set(start[2]);
+	const auto inv_x = S::set(inv_dir[0]), inv_y = S::set(inv_dir[1]), inv_z = S::set(inv_dir[2]);
+
+	struct entry { u32 node; float t; };
+	std::array<entry, 64 * (WIDTH - 1) + 1> local;
+	std::vector<entry> heap;
+	entry* stack = local.data();
+	if (m_depth * (WIDTH - 1) + 1 > local.size()) {
+		heap.resize(m_depth * (WIDTH - 1) + 1);
+		stack = heap.data();
+	}
+	u32 size = 0;
+	stack[size++] = { 0, 0.f };
+	Object* closest = nullptr;
+	float closest_t = FLT_MAX;
+	alignas(32) float t_near[WIDTH];
+	while (size) {
+		const entry e = stack[--size];
+		if (e.t > closest_t)
+			continue;
+		const node& n = m_nodes[e.node];
+		// slabs of every lane, near plane picked by the direction sign
+		auto near_t = S::max(S::set(0.f), S::mul(S::sub(S::load(rq.sign[0] ? n.max_x : n.min_x), start_x), inv_x));
+		auto far_t = S::min(S::set(closest_t), S::mul(S::sub(S::load(rq.sign[0] ? n.min_x : n.max_x), start_x), inv_x));
+		near_t = S::max(near_t, S::mul(S::sub(S::load(rq.sign[1] ? n.max_y : n.min_y), start_y), inv_y));
+		far_t = S::min(far_t, S::mul(S::sub(S::load(rq.sign[1] ? n.min_y : n.max_y), start_y), inv_y));
+		near_t = S::max(near_t, S::mul(S::sub(S::load(rq.sign[2] ? n.max_z : n.min_z), start_z), inv_z));
+		far_t = S::min(far_t, S::mul(S::sub(S::load(rq.sign[2] ? n.min_z : n.max_z), start_z), inv_z));
+		u32 mask = S::mask(S::le(near_t, far_t));
+		if (!mask)
+			continue;
+		S::store(t_near, near_t);
+
+		// leaves now, intermediate nodes sorted so the nearest is popped first
+		u32 pushed = 0;
+		for (; mask; mask &= mask - 1) {
+			const u32 i = glm::findLSB(mask);
+			if (n.count[i]) {
+				for (u32 j = n.child[i]; j < n.child[i] + n.count[i]; ++j) {
+					float t_enter, t_exit;
+					if (intersection_ray_aabb(rq, m_primitive_aabbs[j], t_enter, t_exit) && t_enter < closest_t) {
+						closest_t = t_enter;
+						closest = m_primitives[j];
+					}
+				}
+				continue;
+			}
+			entry c{ n.child[i], t_near[i] };
+			u32 k = size + pushed++;
+			for (; k > size && stack[k - 1].t < c.t; --k)
+				stack[k] = stack[k - 1];
+			stack[k] = c;
+		}
+		size += pushed;
+	}
+	if (closest)
+		t = closest_t;
+	return closest;
+}
+
+template class wide_bounding_volume_hierarchy<4>;
+template class wide_bounding_volume_hierarchy<8>;
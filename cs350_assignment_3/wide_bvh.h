@@ -0,0 +1,62 @@
+/**
+* @file wide_bvh.h
+* @author Markel Pisano , 540002615 , markel.p@digipen.edu
+* @date 2026/10/18	(eus)
+* @brief Declare 4-wide and 8-wide BVH with SIMD child tests
+*
+* @copyright Copyright (C) 2020 DigiPen I n s t i t u t e of Technology .
+*/
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+// read-only tree collapsed from a binary BVH, one node tests all its children at once (SSE / AVX)
+template<u32 WIDTH>
+class wide_bounding_volume_hierarchy {
+public:
+	static_assert(WIDTH == 4 || WIDTH == 8, "one SSE or AVX register per child bound");
+	static constexpr u32 invalid_index = ~0u;
+
+	// children bounds as structure of arrays, lane i is child i
+	struct alignas(32) node {
+		float min_x[WIDTH], min_y[WIDTH], min_z[WIDTH];
+		float max_x[WIDTH], max_y[WIDTH], max_z[WIDTH];
+		u32 child[WIDTH];	// count 0: node index, count > 0: first primitive, empty: invalid_index
+		u32 count[WIDTH];	// primitives of a leaf child (0 for nodes and empty slots)
+	};
+
+private:
+	std::vector<node> m_nodes;				// m_nodes[0] is the root (if any)
+	std::vector<Object*> m_primitives;		// leaves reference contiguous ranges of this array
+	std::vector<AABB> m_primitive_aabbs;	// same indices as m_primitives, leaves do not touch the objects
+	u32 m_depth = 0;						// nodes on the longest path, bounds the traversal stack
+
+	// emit the wide node of binary node n, returns its index
+	u32 collapse(const bounding_volume_hierarchy& bvh, const bounding_volume_hierarchy::node& n, u32 depth);
+	// children of n that hit the query, bit i for lane i
+	u32 overlap_mask(const node& n, const AABB& ab) const;
+	u32 frustum_mask(const node& n, const Frustum& f) const;
+
+public:
+	// same topology as bvh with WIDTH - 1 levels of every WIDTH removed
+	void build(const bounding_volume_hierarchy& bvh);
+	// recompute every bounding volume from the objects, topology is kept
+	void refit();
+	void destroy();
+
+	// objects whose aabb overlaps ab
+	void query_aabb(const AABB& ab, std::vector<Object*>& result) const;
+	// objects whose aabb is not outside f (same test as intersection_frustum_aabb)
+	void query_frustum(const Frustum& f, std::vector<Object*>& result) const;
+	// closest object aabb hit by r (t = 0 if the start is inside), null if none
+	Object* raycast(const Ray& r, float& t) const;
+
+	inline bool empty() const { return m_nodes.empty(); }
+	inline size_t node_count() const { return m_nodes.size(); }
+	inline size_t primitive_count() const { return m_primitives.size(); }
+	inline u32 depth() const { return m_depth; }
+};
+
+using BVH4 = wide_bounding_volume_hierarchy<4>;
+using BVH8 = wide_bounding_volume_hierarchy<8>;
+
+#endif	// WIDE_BVH_H